@@ -0,0 +1,418 @@
+#include <cmath>
+#include <cstdlib>
+#include <chrono>
+#include <limits>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#include "PointCloudSource.h"
+#include "MortonOrder.h"
+#include "RayPick.h"
+#include "RayPickKernel.h"
+
+/*
+ * Benchmarks of the point cloud spatial code over a synthetic room scan (the walls, floor and ceiling of a room seen
+ * from its centre, in sensor row order as a scanner PLY file would be). Each section checks its results against the
+ * serial or scalar reference and the program exits with status 1 on any difference, so ctest runs it over a small
+ * cloud as a test.
+ *
+ *    pointcloud_bench [-n <points>] [-q <queries>] [section ...]
+ *
+ * Sections (default all):
+ *    kdtree   kd-tree build time on 1, 4 and 16 threads, checking the vind permutation and radius and knn search
+ *             results match the serial build.
+ *    raypick  ray_pick_soa (the vectorized kernel selected for this CPU) against the scalar ray_pick_brute_force loop,
+ *             without and with a removed point mask (as used by PointIndex::pick_brute_force), checking the hits
+ *             match. Uses one ray per 20 queries.
+ *    morton   morton_order (-Z) time, then kd-tree build time, radius search latency and a sequential knn pass over
+ *             the points in storage order (a CPU stand in for the GPU vertex cache locality of a frame, which can't be
+ *             timed without a GL context) in PLY and in Morton order, with hardware cache misses where perf events
+ *             are available. Checks the order is a permutation and the searches find the same points.
+ */
+
+typedef std::chrono::steady_clock bench_clock;
+
+static double elapsed_ms(bench_clock::time_point start)
+{
+   return std::chrono::duration<double, std::milli>(bench_clock::now() - start).count();
+}
+
+// Hardware cache misses of the calling thread (Linux perf_event_open). stop returns -1 when perf events are not
+// available (other platforms, containers or kernel.perf_event_paranoid too high).
+class CacheMisses
+//===============
+{
+public:
+   CacheMisses()
+   {
+#ifdef __linux__
+      perf_event_attr attr{};
+      attr.size = sizeof(attr);
+      attr.type = PERF_TYPE_HARDWARE;
+      attr.config = PERF_COUNT_HW_CACHE_MISSES;
+      attr.disabled = 1;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      fd = static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+#endif
+   }
+   CacheMisses(const CacheMisses&) = delete;
+   CacheMisses& operator=(const CacheMisses&) = delete;
+   ~CacheMisses()
+   {
+#ifdef __linux__
+      if (fd >= 0)
+         close(fd);
+#endif
+   }
+
+   void start()
+   {
+#ifdef __linux__
+      if (fd < 0) return;
+      ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+      ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+   }
+
+   long long stop()
+   {
+#ifdef __linux__
+      if (fd < 0) return -1;
+      ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+      long long count;
+      if (read(fd, &count, sizeof(count)) == static_cast<ssize_t>(sizeof(count)))
+         return count;
+#endif
+      return -1;
+   }
+
+private:
+   int fd = -1;
+};
+
+static std::string misses_text(long long misses)
+{
+   return (misses < 0) ? std::string("n/a") : std::to_string(misses);
+}
+
+// n points on the walls, floor and ceiling of a 10 x 8 x 3 room scanned from its centre, in sensor (row major) order
+static void room_scan(size_t n, PointCloudFlannSource<float>& points)
+//-------------------------------------------------------------------
+{
+   points.resize(n);
+   const size_t rows = std::max(static_cast<size_t>(std::sqrt(n*0.8)), size_t(1)), cols = (n + rows - 1) / rows;
+   std::mt19937 rng(1);
+   std::normal_distribution<float> noise(0, 0.002f);
+   for (size_t i=0; i<n; i++)
+   {
+      const float elevation = (static_cast<float>(i / cols) / rows - 0.5f)*2,
+                  azimuth = static_cast<float>(i % cols) / cols * 6.2831853f;
+      const float dx = std::cos(elevation)*std::cos(azimuth), dy = std::cos(elevation)*std::sin(azimuth),
+                  dz = std::sin(elevation);
+      float t = std::numeric_limits<float>::max();
+      if (std::fabs(dx) > 1e-6f) t = std::min(t, 5.0f / std::fabs(dx));
+      if (std::fabs(dy) > 1e-6f) t = std::min(t, 4.0f / std::fabs(dy));
+      if (std::fabs(dz) > 1e-6f) t = std::min(t, 1.5f / std::fabs(dz));
+      t += noise(rng);
+      points.set(i, dx*t, dy*t, dz*t);
+   }
+}
+
+// Query positions near (within about 5cm of) random points of the cloud
+static std::vector<Real3<float>> query_points(const PointCloudFlannSource<float>& points, size_t n)
+//-------------------------------------------------------------------------------------------------
+{
+   std::mt19937 rng(2);
+   std::uniform_int_distribution<size_t> pick(0, points.kdtree_get_point_count() - 1);
+   std::uniform_real_distribution<float> offset(-0.05f, 0.05f);
+   std::vector<Real3<float>> queries;
+   for (size_t q=0; q<n; q++)
+   {
+      const Real3<float> p = points.get(pick(rng));
+      queries.emplace_back(p.x + offset(rng), p.y + offset(rng), p.z + offset(rng));
+   }
+   return queries;
+}
+
+static bool bench_kdtree(const PointCloudFlannSource<float>& points, size_t query_count)
+//--------------------------------------------------------------------------------------
+{
+   const size_t n = points.kdtree_get_point_count();
+   std::cout << "kd-tree build (" << n << " points, " << std::thread::hardware_concurrency() << " cores)" << std::endl;
+   std::vector<std::unique_ptr<kd_tree_t>> trees;
+   double serial_ms = 0;
+   for (unsigned threads : { 1u, 4u, 16u })
+   {
+      const bench_clock::time_point start = bench_clock::now();
+      trees.emplace_back(new kd_tree_t(3, points, nanoflann::KDTreeSingleIndexAdaptorParams(10, threads)));
+      trees.back()->buildIndex();
+      const double ms = elapsed_ms(start);
+      if (threads == 1)
+         serial_ms = ms;
+      std::cout << "   " << threads << " threads: " << ms << " ms (x" << serial_ms / ms << ")" << std::endl;
+   }
+
+   const kd_tree_t& serial = *trees.front();
+   const std::vector<Real3<float>> queries = query_points(points, query_count);
+   const size_t k = 8;
+   bool is_ok = true;
+   for (size_t t=1; t<trees.size(); t++)
+   {
+      const kd_tree_t& tree = *trees[t];
+      if (tree.vind != serial.vind)
+      {
+         std::cerr << "   FAIL: vind differs from the serial build (tree " << t << ")" << std::endl;
+         is_ok = false;
+      }
+      size_t mismatches = 0;
+      std::vector<std::pair<size_t, float>> expected, matches;
+      std::vector<size_t> expected_i(k), indices(k);
+      std::vector<float> expected_d(k), dists(k);
+      for (const Real3<float>& q : queries)
+      {
+         const float query[3] = { q.x, q.y, q.z };
+         serial.radiusSearch(query, 0.01f, expected, nanoflann::SearchParams());
+         tree.radiusSearch(query, 0.01f, matches, nanoflann::SearchParams());
+         const size_t found = serial.knnSearch(query, k, expected_i.data(), expected_d.data());
+         if ( (matches != expected) || (tree.knnSearch(query, k, indices.data(), dists.data()) != found) ||
+              (! std::equal(indices.begin(), indices.begin() + found, expected_i.begin())) )
+            mismatches++;
+      }
+      if (mismatches > 0)
+      {
+         std::cerr << "   FAIL: " << mismatches << " of " << queries.size() << " searches differ from the serial build"
+                   << " (tree " << t << ")" << std::endl;
+         is_ok = false;
+      }
+   }
+   if (is_ok)
+      std::cout << "   vind and " << queries.size() << " radius/knn searches match the serial build" << std::endl;
+   return is_ok;
+}
+
+// Same hit, or a different hit at the same distance up to rounding
+static bool is_same_hit(size_t hit, float dist, size_t expected, float expected_dist)
+{
+   return ( (hit == expected) || (std::fabs(dist - expected_dist) <= 1e-5f*expected_dist) );
+}
+
+static bool bench_raypick(const PointCloudFlannSource<float>& points, size_t query_count)
+//---------------------------------------------------------------------------------------
+{
+   const size_t n = points.kdtree_get_point_count(), ray_count = std::max(query_count / 20, size_t(1));
+   std::cout << "ray pick (" << n << " points, " << ray_count << " rays, " << ray_pick_soa_kernel() << ")" << std::endl;
+   // Rays from near the scan position through points of the cloud so most hit
+   const std::vector<Real3<float>> targets = query_points(points, ray_count);
+   std::mt19937 rng(3);
+   std::uniform_real_distribution<float> offset(-0.5f, 0.5f);
+   std::vector<glm::vec3> origins, rays;
+   for (const Real3<float>& target : targets)
+   {
+      origins.emplace_back(offset(rng), offset(rng), offset(rng));
+      rays.push_back(glm::normalize(glm::vec3(target.x, target.y, target.z) - origins.back()));
+   }
+   // Every third point removed
+   std::vector<uint64_t> removed((n + 63) / 64, 0);
+   for (size_t i=0; i<n; i+=3)
+      removed[i >> 6] |= uint64_t(1) << (i & 63);
+   auto is_removed = [&removed](size_t i) { return ((removed[i >> 6] >> (i & 63)) & 1) != 0; };
+
+   const float radius2 = 0.0001f;
+   bool is_ok = true;
+   for (const bool is_masked : { false, true })
+   {
+      std::vector<size_t> expected(ray_count), hits(ray_count);
+      std::vector<float> expected_dist(ray_count), dists(ray_count);
+      bench_clock::time_point start = bench_clock::now();
+      for (size_t r=0; r<ray_count; r++)
+      {
+         if (is_masked)
+            expected[r] = ray_pick_brute_force_if(points, origins[r], rays[r], radius2, is_removed, expected_dist[r]);
+         else
+            expected[r] = ray_pick_brute_force(points, origins[r], rays[r], radius2, size_t(-1), expected_dist[r]);
+      }
+      const double scalar_ms = elapsed_ms(start);
+      start = bench_clock::now();
+      for (size_t r=0; r<ray_count; r++)
+      {
+         const float O[3] = { origins[r].x, origins[r].y, origins[r].z }, ray[3] = { rays[r].x, rays[r].y, rays[r].z };
+         hits[r] = ray_pick_soa(points.coords[0], points.coords[1], points.coords[2], n, O, ray, radius2, size_t(-1),
+                                (is_masked) ? removed.data() : nullptr, dists[r]);
+      }
+      const double soa_ms = elapsed_ms(start);
+      size_t hit_count = 0, mismatches = 0;
+      for (size_t r=0; r<ray_count; r++)
+      {
+         if (expected[r] < n)
+            hit_count++;
+         if (! is_same_hit(hits[r], dists[r], expected[r], expected_dist[r]))
+            mismatches++;
+      }
+      std::cout << "   " << ((is_masked) ? "masked:   " : "unmasked: ") << "scalar " << scalar_ms / ray_count
+                << " ms/ray, " << ray_pick_soa_kernel() << " " << soa_ms / ray_count << " ms/ray (x"
+                << scalar_ms / soa_ms << "), " << hit_count << " hits" << std::endl;
+      if (mismatches > 0)
+      {
+         std::cerr << "   FAIL: " << mismatches << " of " << ray_count << " ray_pick_soa "
+                   << ((is_masked) ? "masked " : "") << "picks differ from the scalar loop" << std::endl;
+         is_ok = false;
+      }
+   }
+   return is_ok;
+}
+
+static bool bench_morton(const PointCloudFlannSource<float>& points, size_t query_count)
+//--------------------------------------------------------------------------------------
+{
+   const size_t n = points.kdtree_get_point_count();
+   const unsigned threads = std::max(std::thread::hardware_concurrency(), 1u);
+   std::cout << "Morton order (" << n << " points, " << query_count << " radius searches)" << std::endl;
+   bench_clock::time_point start = bench_clock::now();
+   const std::vector<uint64_t> order = morton_order(n, [&points](size_t i) { return points.get(i); }, threads);
+   std::cout << "   morton_order: " << elapsed_ms(start) << " ms (" << threads << " threads)" << std::endl;
+   std::vector<bool> is_seen(n, false);
+   for (uint64_t i : order)
+   {
+      if ( (i >= n) || (is_seen[i]) ) break;
+      is_seen[i] = true;
+   }
+   if ( (order.size() != n) || (std::find(is_seen.begin(), is_seen.end(), false) != is_seen.end()) )
+   {
+      std::cerr << "   FAIL: morton_order is not a permutation of the points" << std::endl;
+      return false;
+   }
+   PointCloudFlannSource<float> sorted;
+   sorted.resize(n);
+   for (size_t k=0; k<n; k++)
+   {
+      const Real3<float> p = points.get(order[k]);
+      sorted.set(k, p.x, p.y, p.z);
+   }
+
+   const std::vector<Real3<float>> queries = query_points(points, query_count);
+   const float radius2 = 0.0025f;
+   std::vector<std::vector<size_t>> found[2]; // PLY indices of the radius search matches in each order
+   CacheMisses misses;
+   for (int is_morton=0; is_morton<2; is_morton++)
+   {
+      const PointCloudFlannSource<float>& cloud = (is_morton) ? sorted : points;
+      start = bench_clock::now();
+      kd_tree_t tree(3, cloud, nanoflann::KDTreeSingleIndexAdaptorParams(10, threads));
+      tree.buildIndex();
+      const double build_ms = elapsed_ms(start);
+
+      nanoflann::SearchParams params;
+      params.sorted = false;
+      std::vector<std::pair<size_t, float>> matches;
+      size_t match_count = 0;
+      misses.start();
+      start = bench_clock::now();
+      for (const Real3<float>& q : queries)
+      {
+         const float query[3] = { q.x, q.y, q.z };
+         match_count += tree.radiusSearch(query, radius2, matches, params);
+         found[is_morton].emplace_back();
+         for (const std::pair<size_t, float>& match : matches)
+            found[is_morton].back().push_back(match.first);
+      }
+      const double radius_ms = elapsed_ms(start);
+      const long long radius_misses = misses.stop();
+      if (is_morton)
+      {
+         for (std::vector<size_t>& indices : found[is_morton])
+            for (size_t& i : indices)
+               i = order[i];
+      }
+
+      const size_t k = 9;
+      std::vector<size_t> indices(k);
+      std::vector<float> dists(k);
+      misses.start();
+      start = bench_clock::now();
+      for (size_t i=0; i<n; i+=4)
+      {
+         const float query[3] = { cloud.coords[0][i], cloud.coords[1][i], cloud.coords[2][i] };
+         tree.knnSearch(query, k, indices.data(), dists.data());
+      }
+      const double knn_ms = elapsed_ms(start);
+      const long long knn_misses = misses.stop();
+
+      const size_t searches = std::max(queries.size(), size_t(1));
+      std::cout << "   " << ((is_morton) ? "Morton order: " : "PLY order:    ") << "build " << build_ms << " ms, radius "
+                << 1000*radius_ms / searches << " us/search (" << match_count / searches << " points, "
+                << misses_text(radius_misses) << " cache misses), knn pass " << knn_ms << " ms ("
+                << misses_text(knn_misses) << " cache misses)" << std::endl;
+   }
+
+   size_t mismatches = 0;
+   for (size_t q=0; q<queries.size(); q++)
+   {
+      std::sort(found[0][q].begin(), found[0][q].end());
+      std::sort(found[1][q].begin(), found[1][q].end());
+      if (found[0][q] != found[1][q])
+         mismatches++;
+   }
+   if (mismatches > 0)
+   {
+      std::cerr << "   FAIL: " << mismatches << " of " << queries.size() << " radius searches differ between PLY and "
+                << "Morton order" << std::endl;
+      return false;
+   }
+   return true;
+}
+
+int main(int argc, char** argv)
+//-----------------------------
+{
+   size_t n = 5000000, query_count = 2000;
+   std::vector<std::string> sections;
+   for (int i=1; i<argc; i++)
+   {
+      const std::string arg = argv[i];
+      if ( ( (arg == "-n") || (arg == "-q") ) && (i + 1 < argc) )
+      {
+         const size_t v = std::strtoull(argv[++i], nullptr, 10);
+         if (arg == "-n") n = v; else query_count = v;
+      }
+      else if ( (arg == "kdtree") || (arg == "raypick") || (arg == "morton") )
+         sections.push_back(arg);
+      else
+      {
+         std::cerr << "Usage: " << argv[0] << " [-n <points>] [-q <queries>] [kdtree] [raypick] [morton]" << std::endl;
+         return 2;
+      }
+   }
+   if (n == 0)
+   {
+      std::cerr << "-n must be positive" << std::endl;
+      return 2;
+   }
+   auto is_run = [&sections](const char* section)
+   {
+      return ( (sections.empty()) || (std::find(sections.begin(), sections.end(), section) != sections.end()) );
+   };
+
+   PointCloudFlannSource<float> points;
+   room_scan(n, points);
+   bool is_ok = true;
+   if (is_run("kdtree"))
+      is_ok = bench_kdtree(points, query_count) && is_ok;
+   if (is_run("raypick"))
+      is_ok = bench_raypick(points, query_count) && is_ok;
+   if (is_run("morton"))
+      is_ok = bench_morton(points, query_count) && is_ok;
+   return (is_ok) ? 0 : 1;
+}
@@ -0,0 +1,32 @@
+#version {{ver}} core
+// Packed (16 byte) vertex format (see PackedVertex.h), vFlags is 0 for the selected point.
+uniform mat4 MV;
+uniform mat4 P;
+uniform vec3 eye;
+uniform float pointSize;
+
+layout(location = 0) in vec3 vPosition;
+layout(location = 1) in vec4 vColor;
+layout(location = 2) in float vFlags;
+smooth out vec4 colour;
+out float selected;
+
+const float a = 0.7, b = 0.5, c = 0;
+void main()
+{
+   vec3 pos = vPosition;
+   float d = 0;
+   if (vFlags == 0)
+   {
+      colour = vec4(1, 1, 0, 1);
+      selected = 0;
+   }
+   else
+   {
+      d = distance(eye, pos);
+      colour = vec4(vColor.rgb, 1);
+      selected = 1;
+   }
+   gl_PointSize = (1/(a + b*d + c*d*d)) * pointSize;
+   gl_Position = (P * MV) * vec4(pos, 1.0);
+}
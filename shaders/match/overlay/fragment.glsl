@@ -0,0 +1,50 @@
+#version {{ver}} core
+in vec2 pixel;
+flat in vec4 shape;
+flat in int state;
+
+uniform float uScale;
+
+layout(location = 0) out vec4 FragColor;
+
+// Colours of plot_circles and plot_rectangles (util.cc), innermost first
+const vec3 colors[5] = { vec3(0, 0, 0), vec3(1, 1, 1), vec3(0, 0, 1), vec3(1, 1, 0), vec3(1, 0, 0) };
+
+void main()
+{
+   int ring = -1;
+   if (state == 1)
+   {
+      // One (display) pixel wide rectangles from (x, y) to (x + width + k, y + height + k), k = 0..4 display pixels
+      vec2 p = (pixel - shape.xy)*uScale;
+      for (int k=0; k<5; k++)
+      {
+         vec2 size = shape.zw*uScale + float(k);
+         bool is_inside = all(greaterThanEqual(p, vec2(-0.5))) && all(lessThanEqual(p, size + 0.5));
+         bool is_edge = (abs(p.x) <= 0.5) || (abs(p.y) <= 0.5) || (abs(p.x - size.x) <= 0.5) ||
+                        (abs(p.y - size.y) <= 0.5);
+         if (is_inside && is_edge) ring = k;
+      }
+   }
+   else
+   {
+      // Rings of radius 2 to 6 display pixels round the keypoint and for oriented keypoints a tick out to size/2 along
+      // the angle
+      float d = distance(pixel, shape.xy)*uScale;
+      for (int k=0; k<5; k++)
+      {
+         if (abs(d - float(2 + k)) <= 0.5) ring = k;
+      }
+      if ( (ring < 0) && (shape.w >= 0.0) && (shape.z > 0.0) )
+      {
+         float a = radians(shape.w);
+         vec2 dir = vec2(cos(a), sin(a));
+         vec2 v = (pixel - shape.xy)*uScale;
+         float along = dot(v, dir);
+         if ( (along >= 6.0) && (along <= shape.z*0.5*uScale) && (abs(dot(v, vec2(-dir.y, dir.x))) <= 0.5) )
+            ring = 4;
+      }
+   }
+   if (ring < 0) discard;
+   FragColor = vec4(colors[ring], 1.0);
+}
@@ -0,0 +1,36 @@
+#version {{ver}} core
+// Keypoint and selection overlay drawn over the image, one instance per shape (see MatchWin::render_overlay). Shapes
+// are in image pixels (y down), the image being shown at uScale display pixels per image pixel, and each instance
+// covers its shape with a quad.
+layout(location = 0) in vec4 vShape; // SELECTED: keypoint x, y, size, angle (-1 if none); RECTANGLE: x, y, width, height
+layout(location = 1) in float vState; // 0 SELECTED, 1 RECTANGLE
+
+uniform vec2 uImageSize;
+uniform float uScale;
+
+out vec2 pixel;
+flat out vec4 shape;
+flat out int state;
+
+const vec2 corners[4] = { vec2(0, 0), vec2(0, 1), vec2(1, 0), vec2(1, 1) };
+
+void main()
+{
+   shape = vShape;
+   state = int(vState + 0.5);
+   vec2 lo, hi;
+   if (state == 1)
+   {
+      lo = vShape.xy - 1.0/uScale;
+      hi = vShape.xy + vShape.zw + 5.0/uScale;
+   }
+   else
+   {
+      float r = max(7.0/uScale, vShape.z*0.5 + 1.0/uScale);
+      lo = vShape.xy - r;
+      hi = vShape.xy + r;
+   }
+   pixel = mix(lo, hi, corners[gl_VertexID]);
+   vec2 ndc = (pixel + 0.5) / uImageSize * 2.0 - 1.0;
+   gl_Position = vec4(ndc.x, -ndc.y, 0.0, 1.0);
+}
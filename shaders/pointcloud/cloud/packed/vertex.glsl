@@ -0,0 +1,43 @@
+#version {{ver}} core
+// Packed (16 byte float position) and quantized (12 byte int16 position) vertex formats (see PackedVertex.h).
+// For the packed format quantOffset = 0 and quantScale = 1 with quantBias = 0.
+uniform mat4 MV;
+uniform mat4 P;
+uniform float pointSize;
+uniform vec3 quantOffset;
+uniform vec3 quantScale;
+uniform float quantBias;
+
+layout(location = 0) in vec3 vPosition;
+layout(location = 1) in vec4 vColor;
+layout(location = 2) in float vFlags;
+smooth out vec4 colour;
+
+void main()
+{
+   vec3 pos = quantOffset + (vPosition + vec3(quantBias)) * quantScale;
+   if (vFlags == 3) // removed point, place outside the clip volume
+   {
+      gl_Position = vec4(2, 2, 2, 1);
+      colour = vec4(0, 0, 0, 0);
+      gl_PointSize = 0;
+      return;
+   }
+   if (vFlags == 1)
+   {
+      colour = vec4(1, 1, 1, 1);
+      gl_PointSize = pointSize;
+   }
+   else if (vFlags == 2)
+   {
+      colour = vec4(1, 1, 0, 1);
+      gl_PointSize = pointSize + 3;
+   }
+   else
+   {
+      colour = vec4(vColor.rgb, 1);
+      gl_PointSize = pointSize;
+   }
+
+   gl_Position = (P * MV) * vec4(pos, 1.0);
+}
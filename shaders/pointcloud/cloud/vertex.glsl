@@ -13,6 +13,13 @@ smooth out vec4 colour;
 void main()
 {
    vec3 pos = vPosition.xyz;
+   if (vPosition.w == 3) // removed point, place outside the clip volume
+   {
+      gl_Position = vec4(2, 2, 2, 1);
+      colour = vec4(0, 0, 0, 0);
+      gl_PointSize = 0;
+      return;
+   }
    if (vPosition.w == 0)
    {
       colour = vColor;
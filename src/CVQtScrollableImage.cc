@@ -1,28 +1,93 @@
 #include <iostream>
+#include <cmath>
 
 #include "CVQtScrollableImage.h"
 
 #include <QScrollBar>
 #include <QMouseEvent>
+#include <QPainter>
+#include <QPaintEvent>
+#include <QWheelEvent>
 
-CVQtScrollableImage::CVQtScrollableImage(QWidget *parent) : QWidget(parent), imageLabel(this), scrollArea(this)
-//-----------------------------------------------------------------------------------------------------
+void TiledImageView::set_pyramid(std::shared_ptr<ImagePyramid> image_pyramid)
+//---------------------------------------------------------------------------
+{
+   pyramid = image_pyramid;
+   set_zoom(zoom);
+}
+
+void TiledImageView::set_zoom(double zoom_)
+//-----------------------------------------
+{
+   zoom = zoom_;
+   if (pyramid)
+   {
+      const cv::Size size = pyramid->size();
+      setFixedSize(std::max(1, static_cast<int>(std::lround(size.width*zoom))),
+                   std::max(1, static_cast<int>(std::lround(size.height*zoom))));
+   }
+   update();
+}
+
+// Only the tiles under the exposed area are drawn, from the level nearest the zoom.
+void TiledImageView::paintEvent(QPaintEvent *event)
+//-------------------------------------------------
+{
+   QPainter painter(this);
+   painter.fillRect(event->rect(), palette().color(QPalette::Dark));
+   if (! pyramid) return;
+   const int level = pyramid->level_for_scale(zoom);
+   const double scale = zoom*(1 << level); // display pixels per level pixel
+   if (scale != 1)
+      painter.setRenderHint(QPainter::SmoothPixmapTransform);
+   const QRect& area = event->rect();
+   const int x0 = static_cast<int>(std::floor(area.left() / scale)),
+             y0 = static_cast<int>(std::floor(area.top() / scale)),
+             x1 = static_cast<int>(std::ceil((area.right() + 1) / scale)),
+             y1 = static_cast<int>(std::ceil((area.bottom() + 1) / scale));
+   for (const ImagePyramid::Tile& tile : pyramid->tiles(level, cv::Rect(x0, y0, x1 - x0, y1 - y0)))
+   {
+      const cv::Mat& pixels = *tile.pixels;
+      QImage::Format format;
+      switch (pixels.channels())
+      {
+         case 1: format = QImage::Format_Grayscale8; break;
+         case 4: format = QImage::Format_RGBA8888; break;
+         default: format = QImage::Format_RGB888; break;
+      }
+      const QImage qimg(pixels.data, pixels.cols, pixels.rows, static_cast<int>(pixels.step), format);
+      painter.drawImage(QRectF(tile.rect.x*scale, tile.rect.y*scale, tile.rect.width*scale, tile.rect.height*scale),
+                        qimg);
+   }
+}
+
+void TiledImageView::wheelEvent(QWheelEvent *event)
+//-------------------------------------------------
+{
+   if ( ((event->modifiers() & Qt::ControlModifier) == 0) || (! on_zoom) )
+   {
+      event->ignore(); // scroll
+      return;
+   }
+   const int steps = event->angleDelta().y() / 120;
+   if (steps != 0)
+      on_zoom(steps, event->pos());
+   event->accept();
+}
+
+CVQtScrollableImage::CVQtScrollableImage(QWidget *parent) : QWidget(parent), view(this), scrollArea(this)
+//------------------------------------------------------------------------------------------------
 {
 //   setAttribute(Qt::WA_StaticContents);
    setSizePolicy(QSizePolicy::Maximum, QSizePolicy::Maximum);
 
-   QImage qimg(1024, 768, QImage::Format_RGB888);
-   qimg.fill(qRgba(0, 0, 0, 0));
-   imageLabel.setBackgroundRole(QPalette::Base);
-//   imageLabel.setSizePolicy(QSizePolicy::Maximum, QSizePolicy::Maximum);
-   QPixmap pixels = QPixmap::fromImage(qimg);
-   imageLabel.setPixmap(pixels);
-   imageLabel.adjustSize();
-   //imageLabel.setScaledContents(true);
+   view.setBackgroundRole(QPalette::Base);
+   view.setFixedSize(1024, 768);
+   view.set_zoom_callback([this](int steps, const QPoint& pos) { zoom(steps, pos); });
 
    scrollArea.setBackgroundRole(QPalette::Dark);
-   scrollArea.setWidget(&imageLabel);
-   scrollArea.setWidgetResizable(true);
+   scrollArea.setWidget(&view);
+   scrollArea.setWidgetResizable(false);
    scrollArea.setSizePolicy(QSizePolicy::Maximum, QSizePolicy::Maximum);
 //   scrollArea->setVisible(false);
    //  setCentralWidget(scrollArea.get());
@@ -35,21 +100,41 @@ void CVQtScrollableImage::set_image(cv::Mat& img)
    image = img;
    if (img.empty())
       return;
-   cv::cvtColor(image, image, CV_BGR2RGB);
-   QImage qimg(image.data, image.cols, image.rows, QImage::Format_RGB888);
+   // Tiles are converted to RGB for Qt as they are generated, leaving the (BGR) image as is
+   int conversion;
+   switch (image.channels())
+   {
+      case 3: conversion = cv::COLOR_BGR2RGB; break;
+      case 4: conversion = cv::COLOR_BGRA2RGBA; break;
+      default: conversion = -1; break;
+   }
+   view.set_pyramid(std::make_shared<ImagePyramid>(image, conversion));
    QSize sze = this->parentWidget()->size();
-   QPixmap pixels = QPixmap::fromImage(qimg);
-   imageLabel.setPixmap(pixels);
-   imageLabel.adjustSize();
    scrollArea.setVisible(true);
    scrollArea.setFixedSize(sze);
    scrollArea.setVerticalScrollBarPolicy(Qt::ScrollBarAlwaysOn);
    scrollArea.setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOn);
    updateGeometry();
-   std::cout << scrollArea.size().width() << "x" << scrollArea.size().height() << " "
-             << imageLabel.size().width() << "x" << imageLabel.size().height() << " "
-             << pixels.size().width() << "x" << pixels.size().height() << " "
-             << image.cols << "x" << image.rows << std::endl;
+}
+
+// Zooms by ZOOM_STEP per wheel step, down to fitting the image in the scroll area, keeping the image point under anchor
+// (view coordinates) in place.
+void CVQtScrollableImage::zoom(int steps, const QPoint& anchor)
+//-------------------------------------------------------------
+{
+   if (image.empty()) return;
+   const double old_zoom = view.get_zoom();
+   const QSize area = scrollArea.viewport()->size();
+   const double fit = std::min(1.0, std::min(static_cast<double>(area.width()) / image.cols,
+                                             static_cast<double>(area.height()) / image.rows));
+   const double new_zoom = std::max(fit, std::min(MAX_ZOOM, old_zoom*std::pow(ZOOM_STEP, steps)));
+   if (new_zoom == old_zoom) return;
+   QScrollBar* hbar = scrollArea.horizontalScrollBar();
+   QScrollBar* vbar = scrollArea.verticalScrollBar();
+   const QPoint in_viewport = anchor - QPoint(hbar->value(), vbar->value());
+   view.set_zoom(new_zoom);
+   hbar->setValue(static_cast<int>(std::lround(anchor.x()*new_zoom/old_zoom)) - in_viewport.x());
+   vbar->setValue(static_cast<int>(std::lround(anchor.y()*new_zoom/old_zoom)) - in_viewport.y());
 }
 
 void CVQtScrollableImage::mousePressEvent(QMouseEvent *event)
@@ -80,13 +165,17 @@ void CVQtScrollableImage::mouseReleaseEvent(QMouseEvent *event)
    int x = hbar->value();
    QScrollBar* vbar = scrollArea.verticalScrollBar();
    int y = vbar->value();
-   if ( (on_roi_selection) && (drag_rect.width() > 2) && (drag_rect.height() > 2) )
+   if ( (on_roi_selection) && (! image.empty()) && (drag_rect.width() > 2) && (drag_rect.height() > 2) )
    {
+      // The drag is in zoomed view pixels
+      const double zoom = view.get_zoom();
       cv::Rect roi;
-      roi.x = x + drag_rect.left();
-      roi.y = y + drag_rect.top();
-      roi.width = drag_rect.width();
-      roi.height = drag_rect.height();
+      roi.x = static_cast<int>((x + drag_rect.left()) / zoom);
+      roi.y = static_cast<int>((y + drag_rect.top()) / zoom);
+      roi.width = static_cast<int>(std::lround(drag_rect.width() / zoom));
+      roi.height = static_cast<int>(std::lround(drag_rect.height() / zoom));
+      roi &= cv::Rect(0, 0, image.cols, image.rows);
+      if (roi.area() <= 0) return;
       cv::Mat m(image, roi);
       bool is_shift = static_cast<bool>(event->modifiers() & Qt::ShiftModifier);
       bool is_ctrl  = static_cast<bool>(event->modifiers() & Qt::ControlModifier);
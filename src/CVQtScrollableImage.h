@@ -2,6 +2,7 @@
 #define _CVQTSCROLLABLEIMAGE_H_
 
 #include <memory>
+#include <functional>
 
 #include <opencv2/core/core.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
@@ -11,6 +12,31 @@
 #include <QScrollArea>
 #include <QtWidgets/QRubberBand>
 
+#include "ImagePyramid.h"
+
+// Draws the visible tiles of an ImagePyramid at the current zoom (the widget is the size of the zoomed image)
+class TiledImageView : public QWidget
+//===================================
+{
+public:
+   explicit TiledImageView(QWidget* parent = nullptr) : QWidget(parent) {}
+
+   void set_pyramid(std::shared_ptr<ImagePyramid> image_pyramid);
+   void set_zoom(double zoom_);
+   double get_zoom() const { return zoom; }
+   // Called with the number of wheel steps and position for Ctrl+wheel
+   void set_zoom_callback(std::function<void(int, const QPoint&)> callback) { on_zoom = callback; }
+
+protected:
+   void paintEvent(QPaintEvent *event) override;
+   void wheelEvent(QWheelEvent *event) override;
+
+private:
+   std::shared_ptr<ImagePyramid> pyramid;
+   double zoom = 1;
+   std::function<void(int, const QPoint&)> on_zoom;
+};
+
 class CVQtScrollableImage : public QWidget
 //====================================
 {
@@ -23,11 +49,12 @@ public:
    ~CVQtScrollableImage() override
    //-----------------------------
    {
-      scrollArea.setWidget(nullptr);
+      scrollArea.takeWidget(); // view is a member, not owned by the scroll area
       if (! image.empty())
          image.release();
    }
 
+   // img is shared (not copied or modified) and displayed through a tiled pyramid; Ctrl+wheel zooms.
    void set_image(cv::Mat& img);
    const cv::Mat& get_image() const { return image; }
    void set_roi_callback(std::function<void(cv::Mat&, cv::Rect&, bool, bool, bool)>& callback) { on_roi_selection = callback; }
@@ -42,13 +69,17 @@ protected:
 //   void  keyPressEvent(QKeyEvent *event) override;
 
 private:
-   QLabel imageLabel;
+   static constexpr double ZOOM_STEP = 1.25, MAX_ZOOM = 8;
+
+   TiledImageView view;
    QScrollArea scrollArea;
    cv::Mat image;
    QPoint drag_start;
    QRect drag_rect;
    std::unique_ptr<QRubberBand> drag_show;
    std::function<void(cv::Mat&, cv::Rect&, bool, bool, bool)> on_roi_selection;
+
+   void zoom(int steps, const QPoint& anchor);
 };
 
 
@@ -0,0 +1,135 @@
+#include "ImagePyramid.h"
+
+#include <cmath>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+ImagePyramid::ImagePyramid(const cv::Mat& image, int conversion, int tile_size, size_t cache_bytes, unsigned threads) :
+   source(image), conversion(conversion), tile(std::max(tile_size, 16)), max_bytes(cache_bytes),
+   threads((threads == 0) ? std::max(std::thread::hardware_concurrency(), 1u) : threads)
+//--------------------------------------------------------------------------------------
+{
+   if (source.empty()) return;
+   // Halve until the whole level fits in one tile
+   int w = source.cols, h = source.rows;
+   sizes.emplace_back(w, h);
+   while ( (w > tile) || (h > tile) )
+   {
+      w = (w + 1) / 2;
+      h = (h + 1) / 2;
+      sizes.emplace_back(w, h);
+   }
+}
+
+int ImagePyramid::level_for_scale(double scale) const
+//---------------------------------------------------
+{
+   if ( (scale >= 1) || (sizes.empty()) ) return 0;
+   const int level = static_cast<int>(std::floor(std::log2(1.0 / scale)));
+   return std::min(level, levels() - 1);
+}
+
+cv::Rect ImagePyramid::tile_rect(int level, int tx, int ty) const
+//---------------------------------------------------------------
+{
+   const cv::Size& size = sizes[level];
+   return cv::Rect(tx*tile, ty*tile, tile, tile) & cv::Rect(0, 0, size.width, size.height);
+}
+
+// Area averages the source pixels covered by rect of level straight into the tile, so generating a tile never needs
+// the levels in between.
+cv::Mat ImagePyramid::generate(int level, const cv::Rect& rect) const
+//-------------------------------------------------------------------
+{
+   cv::Mat pixels;
+   if (level == 0)
+   {
+      if (conversion >= 0)
+         cv::cvtColor(source(rect), pixels, conversion);
+      else
+         pixels = source(rect).clone();
+      return pixels;
+   }
+   const int scale = 1 << level;
+   const cv::Rect from = cv::Rect(rect.x*scale, rect.y*scale, rect.width*scale, rect.height*scale) &
+                         cv::Rect(0, 0, source.cols, source.rows);
+   cv::resize(source(from), pixels, rect.size(), 0, 0, cv::INTER_AREA);
+   if (conversion >= 0)
+      cv::cvtColor(pixels, pixels, conversion);
+   return pixels;
+}
+
+std::vector<ImagePyramid::Tile> ImagePyramid::tiles(int level, const cv::Rect& rect)
+//----------------------------------------------------------------------------------
+{
+   std::vector<Tile> result;
+   if ( (level < 0) || (level >= levels()) ) return result;
+   const cv::Size& size = sizes[level];
+   const cv::Rect area = rect & cv::Rect(0, 0, size.width, size.height);
+   if (area.area() <= 0) return result;
+   const int tx0 = area.x / tile, ty0 = area.y / tile,
+             tx1 = (area.x + area.width - 1) / tile, ty1 = (area.y + area.height - 1) / tile;
+   std::vector<size_t> missing;
+   for (int ty=ty0; ty<=ty1; ty++)
+   {
+      for (int tx=tx0; tx<=tx1; tx++)
+      {
+         const uint64_t k = key(level, tx, ty);
+         auto it = cache.find(k);
+         if (it != cache.end())
+         {
+            lru.splice(lru.begin(), lru, it->second.second);
+            result.push_back(Tile{tile_rect(level, tx, ty), it->second.first});
+         }
+         else
+         {
+            missing.push_back(result.size());
+            result.push_back(Tile{tile_rect(level, tx, ty), nullptr});
+         }
+      }
+   }
+   if (missing.empty()) return result;
+
+   std::vector<cv::Mat> generated(missing.size());
+   std::atomic<size_t> next{0};
+   auto worker = [&]()
+   {
+      for (size_t i = next.fetch_add(1); i < missing.size(); i = next.fetch_add(1))
+         generated[i] = generate(level, result[missing[i]].rect);
+   };
+   const unsigned n = static_cast<unsigned>(std::min<size_t>(threads, missing.size()));
+   std::vector<std::thread> workers;
+   for (unsigned t=1; t<n; t++)
+      workers.emplace_back(worker);
+   worker();
+   for (std::thread& t : workers)
+      t.join();
+
+   for (size_t i=0; i<missing.size(); i++)
+   {
+      Tile& t = result[missing[i]];
+      t.pixels = std::make_shared<const cv::Mat>(std::move(generated[i]));
+      const uint64_t k = key(level, t.rect.x / tile, t.rect.y / tile);
+      lru.push_front(k);
+      cache.emplace(k, std::make_pair(t.pixels, lru.begin()));
+      bytes += t.pixels->total()*t.pixels->elemSize();
+   }
+   evict();
+   return result;
+}
+
+// Drops least recently used tiles until the cache fits in max_bytes (tiles still held by callers stay valid)
+void ImagePyramid::evict()
+//------------------------
+{
+   while ( (bytes > max_bytes) && (! lru.empty()) )
+   {
+      auto it = cache.find(lru.back());
+      bytes -= it->second.first->total()*it->second.first->elemSize();
+      cache.erase(it);
+      lru.pop_back();
+   }
+}
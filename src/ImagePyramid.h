@@ -0,0 +1,64 @@
+#ifndef _IMAGEPYRAMID_H_
+#define _IMAGEPYRAMID_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+/*
+ * Tiled, mip-mapped view of a (possibly 100MP+) image for display. Level l is the image scaled by 1/2^l and is split
+ * into tile_size square tiles which are only generated when first requested, straight from the source image (area
+ * averaged), in parallel across the tiles of a request. Generated tiles are kept in a least recently used cache of at
+ * most cache_bytes, so display memory stays bounded whatever the image size. The source image is shared, not copied.
+ * Tiles are optionally colour converted (cv::cvtColor code conversion, eg cv::COLOR_BGR2RGB for Qt) when generated.
+ * Not thread safe, intended to be used from one (GUI) thread.
+ */
+class ImagePyramid
+//================
+{
+public:
+   struct Tile
+   {
+      cv::Rect rect; // in level pixels
+      std::shared_ptr<const cv::Mat> pixels;
+   };
+
+   ImagePyramid(const cv::Mat& image, int conversion =-1, int tile_size =256, size_t cache_bytes =256*1024*1024,
+                unsigned threads =0);
+
+   int levels() const { return static_cast<int>(sizes.size()); }
+   cv::Size size(int level =0) const { return sizes[level]; }
+   int tile_size() const { return tile; }
+
+   // Coarsest level with at least scale (display pixels per image pixel) resolution
+   int level_for_scale(double scale) const;
+
+   // Tiles of level intersecting rect (level pixels), generating missing tiles
+   std::vector<Tile> tiles(int level, const cv::Rect& rect);
+
+   size_t cached_bytes() const { return bytes; }
+
+private:
+   cv::Mat source;
+   int conversion, tile;
+   size_t max_bytes, bytes = 0;
+   unsigned threads;
+   std::vector<cv::Size> sizes;
+   // Most recently used first
+   std::list<uint64_t> lru;
+   std::unordered_map<uint64_t, std::pair<std::shared_ptr<const cv::Mat>, std::list<uint64_t>::iterator>> cache;
+
+   static uint64_t key(int level, int tx, int ty)
+   {
+      return (static_cast<uint64_t>(level) << 48) | (static_cast<uint64_t>(ty) << 24) | static_cast<uint64_t>(tx);
+   }
+   cv::Rect tile_rect(int level, int tx, int ty) const;
+   cv::Mat generate(int level, const cv::Rect& rect) const;
+   void evict();
+};
+#endif //_IMAGEPYRAMID_H_
@@ -60,6 +60,16 @@ ImageWindow::ImageWindow(MatchWin* matchWindow, QWidget *parent) : QMainWindow(p
    file_menu->addAction(exit_action);
 }
 
+ImageWindow::~ImageWindow()
+//-------------------------
+{
+   if (detect_thread.joinable())
+   {
+      is_detect_cancelled = true;
+      detect_thread.join();
+   }
+}
+
 void ImageWindow::open()
 //----------------------
 {
@@ -75,7 +85,7 @@ void ImageWindow::open()
 void ImageWindow::on_region_selected(cv::Mat& roi, cv::Rect& roirect, bool is_shift, bool is_ctrl, bool is_alt)
 //-------------------------------------------------------------------------------------------------------------
 {
-   region_features.clear();
+   std::vector<features_t> region_features;
    for (size_t i=0; i<current_keypts.size(); i++)
    {
       cv::KeyPoint kp = current_keypts[i];
@@ -92,7 +102,7 @@ void ImageWindow::on_region_selected(cv::Mat& roi, cv::Rect& roirect, bool is_sh
    const cv::Mat& image = image_holder->get_image();
    cv::Mat img(roirect.size(), image.type());
    image(roirect).copyTo(img);
-   match_window->update_image(img, roirect, &region_features, false);
+   match_window->update_image(img, roirect, std::move(region_features), true);
    match_window->request_focus();
 }
 
@@ -355,36 +365,95 @@ QString listItem(const QListWidget *list)
 void ImageWindow::on_detect()
 //---------------------------
 {
+   if (detect_thread.joinable()) return; // still detecting
    std::string s = feature_detectors.checkedButton()->text().toStdString();
-   cv::Ptr<cv::Feature2D> detector;
-   if (! create_detector(s, detector))
+   // One detector per worker thread, create_detector reads the controls so can only run on the GUI thread
+   std::vector<cv::Ptr<cv::Feature2D>> detectors(std::max(std::thread::hardware_concurrency(), 1u));
+   for (cv::Ptr<cv::Feature2D>& detector : detectors)
    {
-      std::stringstream errs;
-      errs << "Could not create an OpenCV feature detector of type " << s;
-      msg(errs);
-      return;
+      if (! create_detector(s, detector))
+      {
+         std::stringstream errs;
+         errs << "Could not create an OpenCV feature detector of type " << s;
+         msg(errs);
+         return;
+      }
    }
 
    int n;
    if (! valInt(editBest, n, "Invalid top n"))
       n = -1;
+   const bool is_remove_duplicates = chkDelDups->isChecked();
    current_keypts.clear();
    current_descriptors.release();
-   if ( (chkDelDups->isChecked()) || (n > 0) )
+   detect_image = pre_detect_image;
+   is_detect_cancelled = false;
+   detect_progress = new QProgressDialog("Detecting features", "Cancel", 0, 100, this);
+   detect_progress->setWindowModality(Qt::WindowModal);
+   detect_progress->setMinimumDuration(500);
+   connect(detect_progress, &QProgressDialog::canceled, this, [this]() { is_detect_cancelled = true; });
+   detectButton->setEnabled(false);
+
+   TiledDetector tiled(std::move(detectors), detector_info);
+   detect_thread = std::thread([this, tiled = std::move(tiled), n, is_remove_duplicates]()
    {
-      detector->detect(pre_detect_image, current_keypts);
-      if (chkDelDups->isChecked())
-         cv::KeyPointsFilter::removeDuplicated(current_keypts);
-      if (n > 0)
-         cv::KeyPointsFilter::retainBest(current_keypts, n);
-      if (! current_keypts.empty())
-         detector->compute(pre_detect_image, current_keypts, current_descriptors);
+      try
+      {
+         is_detected = tiled.detect(detect_image, detected_keypts, detected_descriptors, is_remove_duplicates, n,
+                                    is_detect_cancelled, [this](int done, int total)
+                                    {
+                                       QMetaObject::invokeMethod(this, "on_detect_progress", Qt::QueuedConnection,
+                                                                 Q_ARG(int, done), Q_ARG(int, total));
+                                    });
+      }
+      catch (std::exception& e)
+      {
+         is_detected = false;
+         detect_error = e.what();
+      }
+      QMetaObject::invokeMethod(this, "on_detected", Qt::QueuedConnection);
+   });
+}
+
+void ImageWindow::on_detect_progress(int done, int total)
+//-------------------------------------------------------
+{
+   if (detect_progress == nullptr) return;
+   detect_progress->setMaximum(total);
+   detect_progress->setValue(done);
+}
+
+void ImageWindow::on_detected()
+//-----------------------------
+{
+   detect_thread.join();
+   detectButton->setEnabled(true);
+   if (detect_progress != nullptr)
+   {
+      detect_progress->disconnect(this);
+      detect_progress->close();
+      detect_progress->deleteLater();
+      detect_progress = nullptr;
+   }
+   cv::Mat image = detect_image;
+   detect_image.release();
+   if (! detect_error.empty())
+   {
+      std::stringstream errs;
+      errs << "Feature detection failed: " << detect_error;
+      detect_error.clear();
+      msg(errs);
+      return;
    }
-   else
-      detector->detectAndCompute(pre_detect_image, cv::noArray(), current_keypts, current_descriptors);
+   // Cancelled or a different image loaded while detecting
+   if ( (! is_detected) || (image.data != pre_detect_image.data) ) return;
+   current_keypts = std::move(detected_keypts);
+   current_descriptors = detected_descriptors;
+   detected_keypts.clear();
+   detected_descriptors.release();
 
    cv::Mat img;
-   cv::drawKeypoints(pre_detect_image, current_keypts, img, cv::Scalar(0, 255, 255),
+   cv::drawKeypoints(image, current_keypts, img, cv::Scalar(0, 255, 255),
                      (chkRichKps->isChecked()) ? cv::DrawMatchesFlags::DRAW_RICH_KEYPOINTS : 0);
    image_holder->set_image(img);
    tabs.setCurrentIndex(0);
@@ -499,7 +568,7 @@ bool ImageWindow::load(std::string imagepath, bool isColor)
       std::cerr << "Error reading image from " << imagepath << std::endl;
       return false;
    }
-   img.copyTo(pre_detect_image);
+   pre_detect_image = img; // shared, neither is modified (the image view converts tiles as they are generated)
    image_holder->set_image(img);
    return true;
 }
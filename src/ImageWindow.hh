@@ -8,6 +8,8 @@
 #include <utility>
 #include <limits>
 #include <exception>
+#include <thread>
+#include <atomic>
 #ifdef FILESYSTEM_EXPERIMENTAL
 #include <experimental/filesystem>
 namespace filesystem = std::experimental::filesystem;
@@ -44,10 +46,12 @@ namespace filesystem = std::filesystem;
 #include <QPushButton>
 #include <QFileDialog>
 #include <QMessageBox>
+#include <QProgressDialog>
 
 #include "main.hh"
 #include "MatchWin.h"
 #include "CVQtScrollableImage.h"
+#include "TiledDetector.h"
 #include "types.h"
 
 //class MatchWin;
@@ -59,7 +63,7 @@ Q_OBJECT
 
 public:
    ImageWindow(MatchWin* matchWindow, QWidget* parent = nullptr);
-   virtual ~ImageWindow() {  }
+   virtual ~ImageWindow();
 
    void setApplication(QApplication *a) { app = a; }
    bool load(std::string imagefile, bool isColor=true);
@@ -93,6 +97,8 @@ public slots:
 
 private slots:
    void on_detect();
+   void on_detect_progress(int done, int total);
+   void on_detected();
 
 private:
    MatchWin* match_window;
@@ -120,9 +126,17 @@ private:
    cv::Mat pre_detect_image;
    std::vector<cv::KeyPoint> current_keypts;
    cv::Mat current_descriptors;
-   std::vector<features_t> region_features;
    DetectorInfo detector_info;
 
+   // Detection runs on detect_thread (see on_detect), the detected_ members are only read after it is joined
+   std::thread detect_thread;
+   std::atomic_bool is_detect_cancelled{false};
+   QProgressDialog* detect_progress = nullptr;
+   cv::Mat detect_image, detected_descriptors;
+   std::vector<cv::KeyPoint> detected_keypts;
+   bool is_detected = false;
+   std::string detect_error;
+
    void on_region_selected(cv::Mat& roi, cv::Rect& roirect, bool is_shift, bool is_ctrl, bool is_alt);
 
    void setup_features_control(QLayout *layout);
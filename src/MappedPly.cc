@@ -0,0 +1,206 @@
+#include "MappedPly.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <iostream>
+
+bool MappedPly::open(const std::string& path, std::stringstream* errs)
+//--------------------------------------------------------------------
+{
+   close();
+   fd = ::open(path.c_str(), O_RDONLY);
+   if (fd < 0)
+   {
+      if (errs) *errs << "MappedPly::open: Could not open " << path << ": " << strerror(errno);
+      return false;
+   }
+   struct stat st;
+   if ( (fstat(fd, &st) != 0) || (st.st_size <= 0) )
+   {
+      if (errs) *errs << "MappedPly::open: Could not stat " << path;
+      close();
+      return false;
+   }
+   data_size = static_cast<size_t>(st.st_size);
+   void* p = mmap(nullptr, data_size, PROT_READ, MAP_PRIVATE, fd, 0);
+   if (p == MAP_FAILED)
+   {
+      if (errs) *errs << "MappedPly::open: mmap of " << path << " failed: " << strerror(errno);
+      data = nullptr;
+      close();
+      return false;
+   }
+   data = static_cast<uint8_t*>(p);
+
+   const char* start = reinterpret_cast<const char*>(data);
+   const char* end = start + data_size;
+   static const char END_HEADER[] = "end_header";
+   const char* pch = start;
+   const char* header_end = nullptr;
+   while (pch < end)
+   {
+      const char* eol = static_cast<const char*>(memchr(pch, '\n', end - pch));
+      if (eol == nullptr) break;
+      if ( (static_cast<size_t>(eol - pch) >= sizeof(END_HEADER) - 1) &&
+           (strncmp(pch, END_HEADER, sizeof(END_HEADER) - 1) == 0) )
+      {
+         header_end = eol + 1;
+         break;
+      }
+      pch = eol + 1;
+   }
+   if (header_end == nullptr)
+   {
+      if (errs) *errs << "MappedPly::open: No end_header in " << path;
+      close();
+      return false;
+   }
+
+   std::string header(start, header_end);
+   std::istringstream format_stream(header);
+   std::string line;
+   while (std::getline(format_stream, line))
+   {
+      std::istringstream ls(line);
+      std::string token, format;
+      ls >> token;
+      if (token == "format")
+      {
+         ls >> format;
+         is_binary_format = (format == "binary_little_endian") || (format == "binary_big_endian");
+         is_big_endian_format = (format == "binary_big_endian");
+         break;
+      }
+   }
+   std::istringstream header_stream(header);
+   tinyply::PlyFile file;
+   try
+   {
+      if (! file.parse_header(header_stream))
+      {
+         if (errs) *errs << "MappedPly::open: Could not parse header of " << path;
+         close();
+         return false;
+      }
+   }
+   catch (const std::exception& e)
+   {
+      if (errs) *errs << "MappedPly::open: Exception " << e.what() << " parsing header of " << path;
+      close();
+      return false;
+   }
+   ply_elements = file.get_elements();
+   locate_vertices(static_cast<size_t>(header_end - start), errs);
+   return true;
+}
+
+bool MappedPly::locate_vertices(size_t body_offset, std::stringstream* errs)
+//------------------------------------------------------------------------
+{
+   vertex_base = nullptr;
+   count = stride = 0;
+   properties.clear();
+   if (! is_binary_format) return false;
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+   const bool is_host_big_endian = true;
+#else
+   const bool is_host_big_endian = false;
+#endif
+   if (is_big_endian_format != is_host_big_endian)
+   {
+      if (errs) *errs << "MappedPly: PLY byte order differs from host, zero copy view not available";
+      return false;
+   }
+
+   size_t offset = body_offset;
+   for (const tinyply::PlyElement& element : ply_elements)
+   {
+      size_t element_stride = 0;
+      bool is_fixed = true;
+      for (const tinyply::PlyProperty& prop : element.properties)
+      {
+         if (prop.isList) { is_fixed = false; break; }
+         element_stride += tinyply::PropertyTable[prop.propertyType].stride;
+      }
+      if (element.name == "vertex")
+      {
+         if (! is_fixed)
+         {
+            if (errs) *errs << "MappedPly: vertex element contains list properties";
+            return false;
+         }
+         size_t property_offset = 0;
+         for (const tinyply::PlyProperty& prop : element.properties)
+         {
+            Property p;
+            p.name = prop.name;
+            p.type = prop.propertyType;
+            p.offset = property_offset;
+            properties.push_back(p);
+            property_offset += tinyply::PropertyTable[prop.propertyType].stride;
+         }
+         if ( (element_stride == 0) || (offset + element.size*element_stride > data_size) )
+         {
+            if (errs) *errs << "MappedPly: vertex element extends beyond end of file (truncated PLY ?)";
+            properties.clear();
+            return false;
+         }
+         count = element.size;
+         stride = element_stride;
+         vertex_base = data + offset;
+         return true;
+      }
+      if (! is_fixed)
+      {
+         if (errs) *errs << "MappedPly: variable length element " << element.name << " precedes vertex element";
+         return false;
+      }
+      offset += element.size*element_stride;
+   }
+   if (errs) *errs << "MappedPly: No vertex element";
+   return false;
+}
+
+const MappedPly::Property* MappedPly::property(const std::string& name) const
+//---------------------------------------------------------------------------
+{
+   for (const Property& p : properties)
+      if (p.name == name)
+         return &p;
+   return nullptr;
+}
+
+void MappedPly::advise_sequential() const
+//---------------------------------------
+{
+   if (data != nullptr)
+      madvise(data, data_size, MADV_SEQUENTIAL);
+}
+
+void MappedPly::advise_random() const
+//-----------------------------------
+{
+   if (data != nullptr)
+      madvise(data, data_size, MADV_RANDOM);
+}
+
+void MappedPly::close()
+//---------------------
+{
+   if (data != nullptr)
+      munmap(data, data_size);
+   data = nullptr;
+   data_size = 0;
+   if (fd >= 0)
+      ::close(fd);
+   fd = -1;
+   vertex_base = nullptr;
+   count = stride = 0;
+   properties.clear();
+   ply_elements.clear();
+   is_binary_format = is_big_endian_format = false;
+}
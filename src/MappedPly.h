@@ -0,0 +1,76 @@
+#ifndef _MAPPEDPLY_H_
+#define _MAPPEDPLY_H_
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <sstream>
+
+#include "tinyply.h"
+
+/*
+ * Read only memory mapping of a binary PLY file. The header is parsed once (using tinyply) and the vertex element is
+ * then exposed in place as a strided record view so that consumers (the kd-tree adaptor, VBO upload) can read the
+ * property values directly from the page cache without intermediate tinyply::Buffer copies.
+ * Only fixed size elements may precede the vertex element and the byte order must match the host (binary_little_endian
+ * on x86), otherwise is_zero_copy() returns false and the caller should fall back to tinyply::PlyFile::read.
+ */
+class MappedPly
+//=============
+{
+public:
+   struct Property
+   {
+      std::string name;
+      tinyply::Type type = tinyply::Type::INVALID;
+      size_t offset = 0; // byte offset within a vertex record
+   };
+
+   MappedPly() = default;
+   MappedPly(const MappedPly&) = delete;
+   MappedPly& operator=(const MappedPly&) = delete;
+   ~MappedPly() { close(); }
+
+   bool open(const std::string& path, std::stringstream* errs =nullptr);
+   void close();
+
+   bool good() const { return (data != nullptr); }
+   bool is_binary() const { return is_binary_format; }
+   bool is_big_endian() const { return is_big_endian_format; }
+   bool is_zero_copy() const { return (vertex_base != nullptr); }
+
+   const std::vector<tinyply::PlyElement>& elements() const { return ply_elements; }
+   const std::vector<Property>& vertex_properties() const { return properties; }
+   const Property* property(const std::string& name) const;
+
+   size_t vertex_count() const { return count; }
+   size_t vertex_stride() const { return stride; }
+   const uint8_t* vertex_data() const { return vertex_base; }
+   const uint8_t* vertex(size_t i) const { return vertex_base + i*stride; }
+
+   // Hint the kernel about the expected access pattern of the vertex block (see madvise(2)).
+   void advise_sequential() const;
+   void advise_random() const;
+
+   template <typename T>
+   inline T get(size_t i, size_t offset) const
+   {
+      T v;
+      std::memcpy(&v, vertex_base + i*stride + offset, sizeof(T)); // records need not be aligned
+      return v;
+   }
+
+private:
+   int fd = -1;
+   uint8_t* data = nullptr;
+   size_t data_size = 0;
+   bool is_binary_format = false, is_big_endian_format = false;
+   std::vector<tinyply::PlyElement> ply_elements;
+   std::vector<Property> properties;
+   const uint8_t* vertex_base = nullptr;
+   size_t count = 0, stride = 0;
+
+   bool locate_vertices(size_t body_offset, std::stringstream* errs);
+};
+#endif //_MAPPEDPLY_H_
@@ -64,6 +64,12 @@ MatchWin::MatchWin(const std::string &title, int w, int h, const std::string &sh
       is_good = false;
       return;
    }
+   if (! filesystem::is_directory(dir / filesystem::path("overlay")))
+   {
+      std::cerr << "MatchWin::MatchWin: Shader directory " << shader_dir << "/overlay not found" << std::endl;
+      is_good = false;
+      return;
+   }
    shader_directory = dir;
    is_good = load_font(caption_writer, "large", "fonts/Inconsolata-Regular.ttf", 22, false, "0123456789,.()");
    if (! is_good)
@@ -78,7 +84,12 @@ void MatchWin::on_initialize(const GLFWwindow *win)
    is_good = init_shader(shader_directory / filesystem::path("image"), image_unit);
    if (! is_good)
       return;
-   is_good = init_shader(shader_directory / filesystem::path("cloud"), pointcloud_unit);
+   is_good = init_shader(shader_directory / filesystem::path("cloud"), pointcloud_unit,
+                         (vertex_format != VertexFormat::FLOAT32) ? vertex_shader_subdir(vertex_format) : nullptr);
+   if (! is_good)
+      return;
+   is_good = ( (init_shader(shader_directory / filesystem::path("overlay"), overlay_unit)) &&
+               (setup_overlay_render()) );
    if (! is_good)
       return;
 
@@ -94,6 +105,7 @@ void MatchWin::on_initialize(const GLFWwindow *win)
       std::cerr << "MatchWin::on_initialize: Error initializing OpenGLText captions: " << err << ": " << errs.str() << std::endl;
       is_good = false;
    }
+   glGetIntegerv(GL_MAX_RECTANGLE_TEXTURE_SIZE, &max_texture_size);
    if (! status_info.initialize(glsl_ver))
       std::cerr << "MatchWin::on_initialize: Error initializing Status Info: " << err << ": " << errs.str() << std::endl;
 
@@ -131,6 +143,8 @@ bool MatchWin::on_render()
    SourceLocation& source_location = SourceLocation::instance();
    source_location.push("MatchWin", "on_render()", __LINE__, "", __FILE__);
 #endif
+   if (take_frame())
+      is_image_update.store(true);
    if (is_image_update.load())
    {
       if (setup_image_texture())
@@ -154,6 +168,7 @@ bool MatchWin::on_render()
       glViewport(0, 0, image_width, image_height);
       glDisable(GL_BLEND);
       render_image();
+      render_overlay();
    }
    glEnable(GL_DEPTH_TEST);
 
@@ -173,13 +188,19 @@ bool MatchWin::on_render()
 #endif
          cartesian();
          glBindBuffer(GL_ARRAY_BUFFER, pointcloud_unit.GLuint_get("VBO_VERTICES"));
-         GLfloat *vertices = static_cast<GLfloat *>(glMapBuffer(GL_ARRAY_BUFFER, GL_WRITE_ONLY));
+         uint8_t *vertices = static_cast<uint8_t *>(glMapBuffer(GL_ARRAY_BUFFER, GL_WRITE_ONLY));
          if (vertices != nullptr)
          {
+            const size_t vsize = vertex_size(vertex_format);
+            const bool is_float = (vertex_format == VertexFormat::FLOAT32);
             if (last_selected_index < cloud_count)
-               vertices[last_selected_index * 8 + 3] = points[last_selected_index].second;
+            {
+               const float distance = points[last_selected_index].second;
+               set_vertex_flags(vertex_format, vertices + last_selected_index*vsize,
+                                (is_float) ? distance : ((distance == 0) ? 0 : 1));
+            }
             if (selected_index < cloud_count)
-               vertices[selected_index * 8 + 3] = 0;
+               set_vertex_flags(vertex_format, vertices + selected_index*vsize, 0);
             glUnmapBuffer(GL_ARRAY_BUFFER);
          }
          glBindBuffer(GL_ARRAY_BUFFER, 0);
@@ -278,6 +299,8 @@ bool MatchWin::on_render()
 #if !defined(NDEBUG)
    source_location.pop();
 #endif
+   if (status_info.must_render())
+      invalidate(); // keep rendering while the status message fades out
    return true;
 }
 
@@ -299,10 +322,12 @@ void MatchWin::onCursorUpdate(double xpos, double ypos)
       int topy = window_height - image_height;
       dragY -= topy;
       ypos -= topy;
-      drag_image_rect = cv::Rect((int) std::min(dragX, xpos), (int) std::min(dragY, ypos),
-                                 (int) fabs(dragX - xpos), (int) fabs(dragY - ypos));
-      std::cout << "Drag rect " << drag_image_rect << std::endl;
-      is_image_update.store(true);
+      // In image pixels (the image may be shown at a coarser level, see take_frame)
+      drag_image_rect = cv::Rect((int) (std::min(dragX, xpos) / image_scale),
+                                 (int) (std::min(dragY, ypos) / image_scale),
+                                 (int) (fabs(dragX - xpos) / image_scale), (int) (fabs(dragY - ypos) / image_scale));
+//      std::cout << "Drag rect " << drag_image_rect << std::endl;
+      is_overlay_update = true;
    }
 
    in_cloud = in_image = in_control = false;
@@ -327,6 +352,7 @@ void MatchWin::on_mouse_click(int button, int action, int mods)
    }
    else if (last_button == GLFW_MOUSE_BUTTON_LEFT)
    {
+      is_overlay_update = true; // drag rectangle started or ended
       if (in_cloud)
       {
          if (last_button_action == GLFW_PRESS)
@@ -334,11 +360,7 @@ void MatchWin::on_mouse_click(int button, int action, int mods)
             is_dragging = is_dragging_cloud = true;
             is_dragging_image = false; drag_image_rect.width = drag_image_rect.height = 0;
             drag_start_cloud = cursor_pos;
-            if (rotating_cursor == nullptr)
-            {
-               rotating_cursor = glfwCreateStandardCursor(GLFW_HAND_CURSOR);
-               glfwSetCursor(GLFW_win(), rotating_cursor);
-            }
+            request_cursor(GLFW_HAND_CURSOR);
          }
          else if (last_button_action == GLFW_RELEASE)
          {
@@ -349,12 +371,7 @@ void MatchWin::on_mouse_click(int button, int action, int mods)
                return;
             }
             is_dragging = is_dragging_cloud = false;
-            if (rotating_cursor != nullptr)
-            {
-               glfwDestroyCursor(rotating_cursor);
-               rotating_cursor = nullptr;
-               glfwSetInputMode(GLFW_win(), GLFW_CURSOR, GLFW_CURSOR_NORMAL);
-            }
+            request_cursor(0);
          }
       }
       else if (in_image)
@@ -369,12 +386,7 @@ void MatchWin::on_mouse_click(int button, int action, int mods)
             if (is_dragging_cloud)
             {
                is_dragging = is_dragging_cloud = false;
-               if (rotating_cursor != nullptr)
-               {
-                  glfwDestroyCursor(rotating_cursor);
-                  rotating_cursor = nullptr;
-                  glfwSetInputMode(GLFW_win(), GLFW_CURSOR, GLFW_CURSOR_NORMAL);
-               }
+               request_cursor(0);
                return;
             }
             is_dragging = is_dragging_image = false;
@@ -398,17 +410,26 @@ void MatchWin::cloud_rotation_update(double xpos, double ypos)
    cartesian();
 }
 
-bool MatchWin::init_shader(const filesystem::path& dir, oglutil::OGLProgramUnit& unit)
-//----------------------------------------------------------------------------------------
+// Loads the shaders in dir, replacing the vertex shader with the one in dir/vertex_subdir if not null
+bool MatchWin::init_shader(const filesystem::path& dir, oglutil::OGLProgramUnit& unit, const char* vertex_subdir)
+//--------------------------------------------------------------------------------------------------------------
 {
    GLenum err;
    std::stringstream errs;
-   std::string vertex_glsl, fragment_glsl;
+   std::string vertex_glsl, fragment_glsl, unused;
    if (!oglutil::load_shaders(dir.string(), vertex_glsl, fragment_glsl))
    {
       std::cerr << "MatchWin::init_shader - Error loading point cloud match shaders from " << dir.string() << std::endl;
       return false;
    }
+   if ( (vertex_subdir != nullptr) &&
+        ( (! oglutil::load_shaders((dir / filesystem::path(vertex_subdir)).string(), vertex_glsl, unused)) ||
+          (vertex_glsl.empty()) ) )
+   {
+      std::cerr << "MatchWin::init_shader - Error loading vertex shader from " << (dir / vertex_subdir).string()
+                << std::endl;
+      return false;
+   }
    unit.program = oglutil::compile_link_shader(replace_ver(vertex_glsl.c_str(), glsl_ver),
                                                replace_ver(fragment_glsl.c_str(), glsl_ver),
                                                unit.vertex_shader,
@@ -467,46 +488,6 @@ bool MatchWin::setup_image_render()
    return true;
 }
 
-inline bool create_image_tex(GLuint image_texture, GLsizei width, GLsizei height, const void *data, GLenum format,
-                             GLint internalFormat = GL_RGB, GLint unpack = - 1, GLint rowlen = - 1)
-//-----------------------------------------------------------------------------------
-{
-   GLenum  err;
-   std::stringstream errs;
-   bool ret = true;
-   oglutil::clearGLErrors();
-   glActiveTexture(GL_TEXTURE0);
-   glBindTexture(GL_TEXTURE_RECTANGLE, image_texture);
-   glTexParameteri(GL_TEXTURE_RECTANGLE, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-   glTexParameteri(GL_TEXTURE_RECTANGLE, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-   glTexParameteri(GL_TEXTURE_RECTANGLE, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-   glTexParameteri(GL_TEXTURE_RECTANGLE, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-   if (unpack > 0)
-      glPixelStorei(GL_UNPACK_ALIGNMENT, unpack);
-   if (rowlen >= 0)
-      glPixelStorei(GL_UNPACK_ROW_LENGTH, rowlen);
-
-   glTexImage2D(GL_TEXTURE_RECTANGLE,         // Type of texture
-                0,                   // Pyramid level (for mip-mapping) - 0 is the top level
-                internalFormat,      // Internal colour format to convert to
-                width, height,
-                0,                   // Border width in pixels (can either be 1 or 0)
-                format,
-                GL_UNSIGNED_BYTE,    // Image data type
-                data);
-   if (! oglutil::isGLOk(err, &errs))
-   {
-      std::cerr << "MatchWin::setup_image_texture: " << err << " - " << errs.str().c_str() << std::endl;
-      ret = false;
-   }
-   glBindTexture(GL_TEXTURE_RECTANGLE, 0);
-   if (unpack > 0)
-      glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
-   if (rowlen > 0)
-      glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
-   return ret;
-}
-
 #ifdef HAVE_SOIL2
 inline void saveTex(GLuint image_texture, GLsizei width, GLsizei  height, int channels, const char* name,
                     GLint pack =-1, GLint rowlen =-1)
@@ -541,13 +522,7 @@ inline void saveTex(GLuint image_texture, GLsizei width, GLsizei  height, int ch
 bool MatchWin::setup_image_texture()
 //----------------------------------
 {
-   if (image_texture != 0)
-   {
-      glDeleteTextures(1, &image_texture);
-      image_texture = 0;
-   }
-
-   if ( (image.data == nullptr) || (image.cols == 0) || (image.rows == 0) )
+   if ( (shown_image.data == nullptr) || (shown_image.cols == 0) || (shown_image.rows == 0) )
    {
       std::cerr << "MatchWin::setup_image_texture: Invalid image " << std::endl;
       return false;
@@ -555,110 +530,101 @@ bool MatchWin::setup_image_texture()
 #if !defined(NDEBUG)
    SourceLocation& source_location = SourceLocation::instance();
    source_location.push("MatchWin", "setup_image_texture()", __LINE__, "", __FILE__);
-#endif
-   cv::Mat display_image = cv::Mat(image.rows, image.cols, image.type());
-   image.copyTo(display_image);
-   if (selected_features)
-   {
-      for (features_t* feature : *selected_features)
-      {
-         cv::KeyPoint &kp = feature->keypoint;
-         plot_circles(display_image, kp.pt.x, kp.pt.y);
-      }
-   }
-   std::cout << "Drag rect " << is_dragging_image << " " << drag_image_rect.width << "x" << drag_image_rect.height << std::endl;
-   if ( (is_dragging_image) && (drag_image_rect.width >= 5) && (drag_image_rect.height >= 5) )
-   {
-      plot_rectangles(display_image, drag_image_rect.x, drag_image_rect.y, drag_image_rect.width,
-                      drag_image_rect.height);
-      cv::Mat _img;
-      cv::cvtColor(display_image, _img, CV_BGR2RGB);
-      cv::imwrite("displayimage2.png", _img);
-   }
-
-   glGenTextures(1, &image_texture);
-   image_width = display_image.cols; image_height = display_image.rows; image_channels = display_image.channels();
-   GLint align = (display_image.step & 3) ? 1 : 4;
-   GLint rowlen = static_cast<GLint>(display_image.step / display_image.elemSize());
-   std::cout << "Type " << cvtype(display_image) << " step = " << display_image.step << " "
-             <<  display_image.step[0] << " (" << (display_image.step & 3) << ") " << " align " << align
-             << " " << display_image.elemSize() << " row len " << rowlen << " " << display_image.isContinuous() << " " << display_image.isSubmatrix() << std::endl;
-#if !defined(NDEBUG)
-   source_location.update(__LINE__, "Uploading image texture");
 #endif
    GLenum  format, internal_format;
-   switch (image_channels)
+   switch (shown_image.channels())
    {
       case 3: internal_format = GL_RGB8; format = (is_BGR) ? GL_BGR : GL_RGB; break;
       case 4: internal_format = GL_RGBA8; format = (is_BGR) ? GL_BGRA : GL_RGBA; break;
       case 1: internal_format = GL_R8; format = GL_RED; break;
       default: internal_format = GL_RGB; format = (is_BGR) ? GL_BGR : GL_RGB; break;
    }
-   create_image_tex(image_texture, image_width, image_height, display_image.data, format, internal_format, align,
-                    rowlen);
-   #if !defined(NDEBUG)
+   // The image is copied straight into the mapped pixel buffer the texture is streamed from. Selections and the drag
+   // rectangle are drawn over it by render_overlay so the texture is only uploaded for a new image.
+   unsigned char* pixels = image_stream.begin_upload(shown_image.cols, shown_image.rows, shown_image.channels(), format,
+                                                     internal_format);
+   if (pixels == nullptr)
+   {
+#if !defined(NDEBUG)
       source_location.pop();
-   #endif
-//      saveTex(image_texture, image_width, image_height, image_channels, "texture.png", align, rowlen);
+#endif
+      return false;
+   }
+   cv::Mat display_image(shown_image.rows, shown_image.cols, shown_image.type(), pixels, image_stream.stride());
+   shown_image.copyTo(display_image);
+#if !defined(NDEBUG)
+   source_location.update(__LINE__, "Uploading image texture");
+#endif
+   const bool is_uploaded = image_stream.end_upload();
+   image_texture = image_stream.texture();
+   image_width = shown_image.cols; image_height = shown_image.rows; image_channels = shown_image.channels();
+#if !defined(NDEBUG)
+   source_location.pop();
+#endif
+//      saveTex(image_texture, image_width, image_height, image_channels, "texture.png");
+   return is_uploaded;
+}
 
-   return (glIsTexture(image_texture));
+void MatchWin::update_image(cv::Mat img, const cv::Rect& rect, std::vector<features_t> features, bool isBGR)
+//----------------------------------------------------------------------------------------------------------
+{
+   std::atomic_store(&pending_frame, std::make_shared<ImageFrame>(std::move(img), rect, std::move(features), isBGR));
+   invalidate();
+}
+
+// Switches to the frame last published by update_image, if any (render thread). The selected features belong to the
+// previous frame so are dropped; saved matches keep their frame alive in matched_frames.
+bool MatchWin::take_frame()
+//-------------------------
+{
+   std::shared_ptr<ImageFrame> next = std::atomic_exchange(&pending_frame, std::shared_ptr<ImageFrame>());
+   if (! next) return false;
+   frame = std::move(next);
+   image = frame->image; image_rect = frame->rect; is_BGR = frame->is_BGR;
+   match_features = &frame->features;
+   // Regions larger than the image area or the texture size limit are shown at the (mip) level 1/2^level that fits
+   const int max_width = std::min(max_texture_size, (window_width > 0) ? window_width*3/4 : max_texture_size),
+             max_height = std::min(max_texture_size, (window_height > 0) ? window_height : max_texture_size);
+   int level = 0;
+   while ( ((image.cols >> level) > max_width) || ((image.rows >> level) > max_height) )
+      level++;
+   image_scale = 1.0f / static_cast<float>(1 << level);
+   if (level == 0)
+      shown_image = image;
+   else
+      cv::resize(image, shown_image, cv::Size(std::max(image.cols >> level, 1), std::max(image.rows >> level, 1)), 0,
+                 0, cv::INTER_AREA);
+   selected_features.reset();
+   is_overlay_update = true;
+   return true;
 }
 
 #ifdef HAVE_SOIL2
 void MatchWin::update_image(const char *imgfile, cv::Rect &rect)
 //--------------------------------------------------------------
 {
-   unsigned char *imgdata = nullptr;
    if (imgfile != nullptr)
    {
-      imgdata = SOIL_load_image(imgfile, &image_width, &image_height, &image_channels, SOIL_LOAD_AUTO);
+      int width, height, channels;
+      unsigned char *imgdata = SOIL_load_image(imgfile, &width, &height, &channels, SOIL_LOAD_AUTO);
       if (imgdata == nullptr)
       {
          std::cerr << "Error loading " << imgfile << std::endl;
          return;
       }
-      if (image_texture != 0)
-      {
-         glDeleteTextures(1, &image_texture);
-         image_texture = 0;
-      }
-      image_texture = SOIL_create_OGL_texture(static_cast<const unsigned char *const>(imgdata),
-                                              &image_width, &image_height, image_channels, 0,
-                                              SOIL_FLAG_TEXTURE_RECTANGLE);
+      update_image(imgdata, width, height, channels, rect);
       SOIL_free_image_data(imgdata);
-      if (image_texture == 0)
-      {
-         std::cerr << "Error creating texture from " << imgfile << std::endl;
-         return;
-      }
-      image = cv::Mat(image_height, image_width,
-                      (image_channels == 3) ? CV_8UC3 : ((image_channels == 4) ? CV_8UC3 : CV_8UC1), imgdata);
-      is_image_update.store(true);
    }
 }
 
+// The pixels are copied, the texture being created from them on the render thread (see setup_image_texture)
 void MatchWin::update_image(void *imgdata, int width, int height, int channels, cv::Rect &rect)
 //----------------------------------------------------------------------------------------------
 {
    if (imgdata != nullptr)
    {
-      if (image_texture != 0)
-      {
-         glDeleteTextures(1, &image_texture);
-         image_texture = 0;
-      }
-      image_width = width; image_height = height; image_channels = channels;
-      image_texture = SOIL_create_OGL_texture(static_cast<const unsigned char *const>(imgdata),
-                                              &image_width, &image_height, image_channels, 0,
-                                              SOIL_FLAG_TEXTURE_RECTANGLE);
-      if (image_texture == 0)
-      {
-         std::cerr << "Error creating texture from pointer" << std::endl;
-         return;
-      }
-      image = cv::Mat(image_height, image_width,
-                      (image_channels == 3) ? CV_8UC3 : ((image_channels == 4) ? CV_8UC3 : CV_8UC1), imgdata);
-      is_image_update.store(true);
+      const int type = (channels == 3) ? CV_8UC3 : ((channels == 4) ? CV_8UC4 : CV_8UC1);
+      update_image(cv::Mat(height, width, type, imgdata).clone(), rect, std::vector<features_t>(), false);
    }
 }
 #endif
@@ -681,6 +647,83 @@ void MatchWin::render_image()
       std::cerr << "MatchWin::on_render: " << err << " - " << errs.str().c_str() << " " << std::endl;
 }
 
+bool MatchWin::setup_overlay_render()
+//-----------------------------------
+{
+   GLenum err;
+   std::stringstream errs;
+   glGenBuffers(1, &overlay_unit.GLuint_ref("VBO"));
+   glGenVertexArrays(1, &overlay_unit.GLuint_ref("VAO"));
+   glBindVertexArray(overlay_unit.GLuint_get("VAO"));
+   glBindBuffer(GL_ARRAY_BUFFER, overlay_unit.GLuint_get("VBO"));
+   glEnableVertexAttribArray(0);
+   glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(OverlayInstance), 0);
+   glVertexAttribDivisor(0, 1);
+   glEnableVertexAttribArray(1);
+   glVertexAttribPointer(1, 1, GL_FLOAT, GL_FALSE, sizeof(OverlayInstance),
+                         reinterpret_cast<const void *>(offsetof(OverlayInstance, state)));
+   glVertexAttribDivisor(1, 1);
+   glBindVertexArray(0);
+   glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+   errs.str("OpenGL Initialization msg: ");
+   if (! oglutil::isGLOk(err, &errs))
+   {
+      std::cerr << "MatchWin::setup_overlay_render: " << err << " - " << errs.str().c_str() <<  std::endl;
+      return false;
+   }
+   return true;
+}
+
+// Rebuilds the overlay instance buffer from the selected features and the drag rectangle (a few hundred bytes)
+void MatchWin::update_overlay()
+//-----------------------------
+{
+   std::vector<OverlayInstance> instances;
+   if (selected_features)
+   {
+      for (features_t* feature : *selected_features)
+      {
+         const cv::KeyPoint& kp = feature->keypoint;
+         instances.push_back(OverlayInstance{kp.pt.x, kp.pt.y, kp.size, kp.angle,
+                                             static_cast<GLfloat>(OverlayInstance::SELECTED)});
+      }
+   }
+   if ( (is_dragging_image) && (drag_image_rect.width >= 5) && (drag_image_rect.height >= 5) )
+      instances.push_back(OverlayInstance{static_cast<GLfloat>(drag_image_rect.x),
+                                          static_cast<GLfloat>(drag_image_rect.y),
+                                          static_cast<GLfloat>(drag_image_rect.width),
+                                          static_cast<GLfloat>(drag_image_rect.height),
+                                          static_cast<GLfloat>(OverlayInstance::RECTANGLE)});
+   glBindBuffer(GL_ARRAY_BUFFER, overlay_unit.GLuint_get("VBO"));
+   glBufferData(GL_ARRAY_BUFFER, instances.size()*sizeof(OverlayInstance), instances.data(), GL_DYNAMIC_DRAW);
+   glBindBuffer(GL_ARRAY_BUFFER, 0);
+   overlay_count = static_cast<GLsizei>(instances.size());
+}
+
+// Draws the selected keypoints and drag rectangle as instanced quads over the image (in the image viewport)
+void MatchWin::render_overlay()
+//-----------------------------
+{
+   GLenum err;
+   std::stringstream errs;
+   if (is_overlay_update)
+   {
+      update_overlay();
+      is_overlay_update = false;
+   }
+   if (overlay_count == 0) return;
+   glUseProgram(overlay_unit.program);
+   glUniform2f(overlay_unit.uniform("uImageSize"), image_width / image_scale, image_height / image_scale);
+   glUniform1f(overlay_unit.uniform("uScale"), image_scale);
+   glDisable(GL_DEPTH_TEST);
+   glBindVertexArray(overlay_unit.GLuint_get("VAO"));
+   glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, overlay_count);
+   glBindVertexArray(0);
+   if (! oglutil::isGLOk(err, &errs))
+      std::cerr << "MatchWin::render_overlay: " << err << " - " << errs.str().c_str() << " " << std::endl;
+}
+
 inline void _push_vertex(GLfloat*& vertices, GLfloat x, GLfloat y, GLfloat z, GLfloat w,
                          GLfloat r, GLfloat g, GLfloat b, GLfloat a)
 //--------------------------------------------------------------------------------------
@@ -693,6 +736,7 @@ void MatchWin::update_points(PointCloudWin* pointSource)
 //------------------------------------------------------
 {
    initialised_pc = false;
+   invalidate();
    if (points.size() == 0)
    {
       cloud_count = 0;
@@ -755,6 +799,8 @@ void MatchWin::update_points(PointCloudWin* pointSource)
 #ifndef NDEBUG
    GLfloat *vertices_ptr_end = &vertices_ptr[buffer_size];
 #endif
+   display_points.clear();
+   display_points.reserve(n);
    for (size_t i=0; i<n; i++)
    {
       GLfloat x, y, z, red =1.0f, green =0, blue =0, alpha =1.0f;
@@ -778,7 +824,7 @@ void MatchWin::update_points(PointCloudWin* pointSource)
       if (i < colors.size())
          std::tie(red, green, blue, alpha) = colors[i];
       _push_vertex(vertices_ptr, x, y, z, distance, red, green, blue, alpha);
-      display_points.emplace_back(x, y, z);
+      display_points.push_back(x, y, z);
 //      std::cout << std::fixed << std::setprecision(4) << x << "," << y << "," << z << std::endl;
    }
    assert(vertices_ptr == vertices_ptr_end);
@@ -820,12 +866,10 @@ bool MatchWin::init_pointcloud_buffer()
       std::cerr << "MatchWin::init_pointcloud_buffer: " << "Error generating VAO\n";
    glGenBuffers(1, &pointcloud_unit.GLuint_ref("VBO_VERTICES"));
    glBindBuffer(GL_ARRAY_BUFFER, pointcloud_unit.GLuint_get("VBO_VERTICES"));
-   glBufferData(GL_ARRAY_BUFFER, cloud_count*8*sizeof(GLfloat), gl_vertices.get(), GL_DYNAMIC_DRAW);
-   glEnableVertexAttribArray(0);
-   glEnableVertexAttribArray (1);
-   GLsizei stride = sizeof(GLfloat) * (4 + 4);
-   glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, stride, 0);
-   glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<const void *>(4 * sizeof (GLfloat)));
+   std::vector<uint8_t> vertices(cloud_count*vertex_size(vertex_format));
+   convert_vertices(vertex_format, gl_vertices.get(), cloud_count, vertices.data(), nullptr, true);
+   glBufferData(GL_ARRAY_BUFFER, vertices.size(), vertices.data(), GL_DYNAMIC_DRAW);
+   set_vertex_attributes(vertex_format);
    glBindVertexArray(0);
    glBindBuffer(GL_ARRAY_BUFFER, 0);
 
@@ -884,40 +928,19 @@ void MatchWin::choose_3dpt()
 
    glm::vec3 O = location;
    float search_radius = 0.5f;
-   size_t hit = std::numeric_limits<size_t>::max();
-   float dist = std::numeric_limits<float>::max();
-   for (size_t i=0; i<cloud_count; i++)
-   {
-      if (i == selected_index) continue;
-      Real3<float> p = display_points[i];
-      glm::vec3 C(p.x, p.y, p.z);
-      glm::vec3 OC = O - C;
-      float b = glm::dot(ray, OC);
-      float c = glm::dot(OC, OC) - search_radius;
-      float disc2 = b*b - c;
-      if (disc2 >= 0)
-      {
-         float d = glm::distance(O, C);
-         if (d < dist)
-         {
-            hit = i;
-            dist = d;
-
-            Real3<float> pp = display_points[hit];
-//            std::cout << "hit " << pp.x << ", " << pp.y << ", " << pp.z << " " << d << std::endl;
-         }
-      }
-//      else
-//         std::cout << "miss " << p.x << ", " << p.y << ", " << p.z << " " << glm::distance(O, C) << std::endl;
-   }
+   const float origin[3] = { O.x, O.y, O.z }, direction[3] = { ray.x, ray.y, ray.z };
+   float dist;
+   size_t hit = ray_pick_soa(display_points.x.data(), display_points.y.data(), display_points.z.data(),
+                             std::min(cloud_count, display_points.size()), origin, direction, search_radius,
+                             selected_index, dist);
    if ( (hit < cloud_count) && (hit != selected_index) )
    {
-      Real3<float> p = display_points[hit];
       last_selected_index = selected_index;
       selected_index = hit;
-      centroid = glm::vec3(p.x, p.y, p.z);
-      Real3<float> pp = points[hit].first;
-      point_source->on_match_select_change(pp.x, pp.y, pp.z);
+      centroid = glm::vec3(display_points.x[hit], display_points.y[hit], display_points.z[hit]);
+      const Real3<float> pp = points[hit].first;
+      PointCloudWin* source = point_source;
+      point_source->post([source, pp]() { source->on_match_select_change(pp.x, pp.y, pp.z); });
       std::stringstream ss;
       ss << std::fixed << std::setprecision(3) << points[hit].first.x << ", " << points[hit].first.y  << ", "
          << points[hit].first.z;
@@ -947,9 +970,10 @@ void MatchWin::choose_kp(double mousex, double mousey, int mods)
 {
    if ( (match_features == nullptr) || (match_features->empty()) ) return;
    int topy = window_height - image_height;
-   mousey = mousey - topy;
+   mousey = (mousey - topy) / image_scale;
+   mousex /= image_scale;
    std::vector<features_t*> clicked_features;
-   double dd = feature_radius*feature_radius;
+   double dd = feature_radius*feature_radius / (image_scale*image_scale);
    bool is_ctrl = ((mods & GLFW_MOD_CONTROL) == GLFW_MOD_CONTROL);
    bool is_shift = ((mods & GLFW_MOD_SHIFT) == GLFW_MOD_SHIFT);
    for (size_t i=0; i<match_features->size(); i++)
@@ -959,7 +983,7 @@ void MatchWin::choose_kp(double mousex, double mousey, int mods)
       double dx = (kp.pt.x - mousex);
       double dy = (kp.pt.y - mousey);
       double d = dx*dx + dy*dy;
-      std::cout << d << " " << dd << std::endl;
+//      std::cout << d << " " << dd << std::endl;
       if (d <= dd)
          clicked_features.push_back(&feature);
    }
@@ -1014,7 +1038,7 @@ void MatchWin::choose_kp(double mousex, double mousey, int mods)
                is_selected = true;
                selected_features->push_back(clicked_feature);
             }
-            is_image_update.store(true);
+            is_overlay_update = true;
             return;
          }
          for (features_t* clicked_feature : clicked_features)
@@ -1027,7 +1051,7 @@ void MatchWin::choose_kp(double mousex, double mousey, int mods)
             }
          }
       }
-      is_image_update.store(true);
+      is_overlay_update = true;
    }
 }
 
@@ -1040,8 +1064,8 @@ void MatchWin::image_drag_end(double mouseX, double mouseY, int mods)
    mouseY -= topy;
    double dragX = drag_start_image.first, dragY = drag_start_image.second;
    dragY -= topy;
-   cv::Rect R((int) std::min(dragX, mouseX), (int) std::min(dragY, mouseY),
-              (int) fabs(dragX - mouseX), (int) fabs(dragY - mouseY));
+   cv::Rect R((int) (std::min(dragX, mouseX) / image_scale), (int) (std::min(dragY, mouseY) / image_scale),
+              (int) (fabs(dragX - mouseX) / image_scale), (int) (fabs(dragY - mouseY) / image_scale));
    std::vector<features_t*> clicked_features;
    bool is_ctrl = ((mods & GLFW_MOD_CONTROL) == GLFW_MOD_CONTROL);
    bool is_shift = ((mods & GLFW_MOD_SHIFT) == GLFW_MOD_SHIFT);
@@ -1094,7 +1118,7 @@ void MatchWin::image_drag_end(double mouseX, double mouseY, int mods)
          }
       }
    }
-   is_image_update.store(true);
+   is_overlay_update = true;
 }
 
 void MatchWin::on_key_press(oglfiber::KeyPress& keyPress)
@@ -1110,8 +1134,9 @@ void MatchWin::on_key_press(oglfiber::KeyPress& keyPress)
             status_info.set_timeout(10000);
             status_info.set("Match saved (Ctrl-Backspace to undo)", glm::vec3(1.0, 1.0, 0.0), 15, 20);
             matched_features.emplace_back(points[selected_index].first, selected_features);
+            matched_frames.push_back(frame);
             selected_features.reset();
-            is_image_update.store(true);
+            is_overlay_update = true;
 
          }
          break;
@@ -1119,6 +1144,7 @@ void MatchWin::on_key_press(oglfiber::KeyPress& keyPress)
          if ( ((keyPress.modifiers & GLFW_MOD_CONTROL) == GLFW_MOD_CONTROL) && (matched_features.size() > 0) )
          {
             matched_features.pop_back();
+            matched_frames.pop_back();
             status_info.set_timeout(8000);
             status_info.set("Last match undone", glm::vec3(1.0, 1.0, 0.0), 15, 20);
          }
@@ -38,6 +38,8 @@ namespace filesystem = boost::filesystem;
 #include "PointCloudWin.h"
 //#include "ImageWindow.hh"
 #include "OpenGLText.h"
+#include "PackedVertex.h"
+#include "RayPickKernel.h"
 #include "MatchIO.h"
 #include "Status.h"
 #include "util.h"
@@ -65,6 +67,31 @@ private:
 
 class ImageWindow;
 
+/*
+ * An image region and the features detected in it, handed from the image window (Qt thread) to MatchWin. Frames are
+ * not modified by the publisher once passed to MatchWin::update_image; after the render thread takes a frame only it
+ * touches the frame (selecting features sets features_t::is_selected).
+ */
+struct ImageFrame
+{
+   cv::Mat image;
+   cv::Rect rect;
+   std::vector<features_t> features;
+   bool is_BGR = true;
+
+   ImageFrame(cv::Mat img, const cv::Rect& rect, std::vector<features_t> features, bool isBGR) :
+      image(std::move(img)), rect(rect), features(std::move(features)), is_BGR(isBGR) {}
+};
+
+// Shape drawn over the image by the overlay shader (shaders/match/overlay), in image pixels
+struct OverlayInstance
+{
+   enum State { SELECTED = 0, RECTANGLE = 1 };
+
+   GLfloat x, y, size, angle; // RECTANGLE: x, y, width, height
+   GLfloat state;
+};
+
 class MatchWin : public oglfiber::OGLFiberWindow
 //===============================================
 {
@@ -74,6 +101,12 @@ public:
             GLFWmonitor *mon =nullptr);
 
    void set_image_view(ImageWindow* imageWindow) { image_view = imageWindow; }
+   // Point VBO vertex format, must be set before the window is initialised. The few match points gain nothing from
+   // quantization so QUANTIZED uses PACKED.
+   void set_vertex_format(VertexFormat format)
+   {
+      vertex_format = (format == VertexFormat::QUANTIZED) ? VertexFormat::PACKED : format;
+   }
 
    void clear_points(float flipyz_) { points.clear(); flip_yz = flipyz_; }
    void add_point(Real3<float> &pt, float distance, std::tuple<float, float, float, float>* color = nullptr)
@@ -83,12 +116,12 @@ public:
          colors.push_back(*color);
    }
    void update_points(PointCloudWin* pointSource);
-   void update_image(cv::Mat img, cv::Rect& rect, std::vector<features_t>* features, bool isBGR =true)
-   {
-      image = img; image_rect = rect;  is_BGR = isBGR;
-      match_features = features;
-      is_image_update.store(true);
-   }
+   /*
+    * Shows img (a region rect of the source image with features detected in it). Safe from any thread and never waits
+    * for the render thread: the frame replaces any frame published but not yet rendered, so only the latest region of a
+    * fast drag is uploaded. The pixels of img must not be modified afterwards.
+    */
+   void update_image(cv::Mat img, const cv::Rect& rect, std::vector<features_t> features, bool isBGR =true);
 
 #ifdef HAVE_SOIL2
    void update_image(const char* imgfile, cv::Rect& rect);
@@ -127,17 +160,18 @@ private:
    int window_width =-1, window_height =-1, cloud_start=0, image_width =0, image_height =0;
    GLfloat image_depth = 0;
    float flip_yz =1.0f;
-   oglutil::OGLProgramUnit image_unit, pointcloud_unit;
+   oglutil::OGLProgramUnit image_unit, pointcloud_unit, overlay_unit;
    GLuint image_texture = 0;
+   oglutil::StreamingTexture image_stream{GL_TEXTURE_RECTANGLE};
    std::vector<std::pair<Real3<float>, float>> points;
-   std::vector<Real3<float>> display_points;
+   PointsSoA display_points; // normalised cloud coordinates for picking
    std::vector<std::tuple<float, float, float, float>> colors;
    size_t cloud_count = 0, selected_index =std::numeric_limits<size_t>::max(),
           last_selected_index =std::numeric_limits<size_t>::max();
    bool is_selection_change = false;
    std::unique_ptr<GLfloat[]> gl_vertices;
+   VertexFormat vertex_format = VertexFormat::PACKED;
    std::pair<double, double> cursor_pos, drag_start_cloud, drag_start_image;
-   GLFWcursor* rotating_cursor = nullptr;
    int last_button =0, last_button_action =0, last_button_mods =0;
    bool initialised_pc = false, updated_pc = false, in_cloud = false, in_image = false, in_control = false,
         is_dragging = false, is_dragging_cloud = false, is_dragging_image = false;
@@ -153,26 +187,37 @@ private:
    OpenGLText caption_writer;
    GLFWContext gl_context;
    PointCloudWin* point_source;
-   cv::Mat image;
+   cv::Mat image, shown_image; // region and the level of it shown (image unless larger than the image area)
+   float image_scale = 1; // of shown_image
+   GLint max_texture_size = 16384;
    cv::Rect drag_image_rect;
    cv::Rect image_rect;
    int image_channels = 0;
    bool is_BGR = false;
-   std::vector<features_t>* match_features;
+   // Latest published frame (swapped with std::atomic_exchange) and the frame being shown, owned by the render thread
+   std::shared_ptr<ImageFrame> pending_frame, frame;
+   std::vector<features_t>* match_features = nullptr; // features of frame
    std::shared_ptr<std::vector<features_t*>> selected_features;
    std::atomic_bool is_image_update{false};
+   bool is_overlay_update = true; // selection or drag rectangle changed (render thread)
+   GLsizei overlay_count = 0;
    std::vector<matched_t> matched_features;
+   std::vector<std::shared_ptr<ImageFrame>> matched_frames; // frame of each match, owning its features_2d
    std::string matched_filename;
    Status status_info;
    int status_height = 50;
 
-   bool init_shader(const filesystem::path& dir, oglutil::OGLProgramUnit& unit);
+   bool init_shader(const filesystem::path& dir, oglutil::OGLProgramUnit& unit, const char* vertex_subdir =nullptr);
    bool init_pointcloud_buffer();
    void cartesian();
    bool setup_image_render();
    bool setup_image_texture();
+   bool take_frame();
    void cloud_rotation_update(double xpos, double ypos);
    void render_image();
+   bool setup_overlay_render();
+   void update_overlay();
+   void render_overlay();
 
    void choose_3dpt();
 
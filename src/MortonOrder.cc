@@ -0,0 +1,85 @@
+#include "MortonOrder.h"
+
+namespace
+{
+   constexpr int RADIX_BITS = 12, RADIX_PASSES = 4; // 48 bit codes
+   constexpr size_t BUCKETS = size_t(1) << RADIX_BITS;
+
+   // Runs fn(t, begin, end) for threads contiguous slices of [0, n) concurrently
+   template <typename F>
+   void parallel_slices(size_t n, size_t threads, F fn)
+   //--------------------------------------------------
+   {
+      const size_t slice = (n + threads - 1) / threads;
+      std::vector<std::thread> workers;
+      for (size_t t=1; t<threads; t++)
+         workers.emplace_back(fn, t, std::min(n, t*slice), std::min(n, (t + 1)*slice));
+      fn(0, 0, std::min(n, slice));
+      for (std::thread& worker : workers)
+         worker.join();
+   }
+
+   // Index is uint32_t where possible, halving the memory traffic of the scatter passes
+   template <typename Index>
+   std::vector<uint64_t> radix_sort(const std::vector<uint64_t>& codes, size_t threads)
+   //----------------------------------------------------------------------------------
+   {
+      const size_t n = codes.size();
+      std::vector<uint64_t> keys(codes), keys_out(n);
+      std::vector<Index> index(n), index_out(n);
+      for (size_t i=0; i<n; i++)
+         index[i] = static_cast<Index>(i);
+      std::vector<size_t> counts(threads*BUCKETS);
+      for (int pass=0; pass<RADIX_PASSES; pass++)
+      {
+         const int shift = pass*RADIX_BITS;
+         std::fill(counts.begin(), counts.end(), 0);
+         parallel_slices(n, threads, [&](size_t t, size_t begin, size_t end)
+         {
+            size_t* count = counts.data() + t*BUCKETS;
+            for (size_t i=begin; i<end; i++)
+               count[(keys[i] >> shift) & (BUCKETS - 1)]++;
+         });
+         // Exclusive prefix over (bucket, thread) so each thread scatters its slice stably into its own ranges
+         size_t total = 0;
+         bool is_trivial = false;
+         for (size_t b=0; b<BUCKETS; b++)
+         {
+            size_t bucket = 0;
+            for (size_t t=0; t<threads; t++)
+            {
+               const size_t c = counts[t*BUCKETS + b];
+               counts[t*BUCKETS + b] = total;
+               total += c;
+               bucket += c;
+            }
+            if (bucket == n)
+               is_trivial = true;
+         }
+         if (is_trivial) continue; // every key has the same digit
+         parallel_slices(n, threads, [&](size_t t, size_t begin, size_t end)
+         {
+            size_t* offset = counts.data() + t*BUCKETS;
+            for (size_t i=begin; i<end; i++)
+            {
+               const size_t j = offset[(keys[i] >> shift) & (BUCKETS - 1)]++;
+               keys_out[j] = keys[i];
+               index_out[j] = index[i];
+            }
+         });
+         keys.swap(keys_out);
+         index.swap(index_out);
+      }
+      return std::vector<uint64_t>(index.begin(), index.end());
+   }
+}
+
+std::vector<uint64_t> morton_sort(const std::vector<uint64_t>& codes, unsigned threads)
+//-------------------------------------------------------------------------------------
+{
+   // Slices below 64K keys are not worth a thread
+   const size_t slices = std::max<size_t>(1, std::min<size_t>(threads, codes.size() / 65536));
+   if (codes.size() <= std::numeric_limits<uint32_t>::max())
+      return radix_sort<uint32_t>(codes, slices);
+   return radix_sort<uint64_t>(codes, slices);
+}
@@ -0,0 +1,80 @@
+#ifndef _MORTONORDER_H_
+#define _MORTONORDER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+#include <thread>
+#include <algorithm>
+
+#include "types.h"
+
+/*
+ * Load time Morton (Z-order) reordering. Scanner PLY files are usually in sensor (row major) order so spatially
+ * adjacent points can be far apart in memory. Sorting the points by the Morton code of their position within the
+ * cloud bounds (16 bits per axis) makes points that are close in space close in memory, which benefits the kd-tree
+ * leaf scans, radius searches and the GPU vertex cache.
+ */
+
+// Spreads the low 16 bits of v so bit i moves to bit 3i
+inline uint64_t morton_spread(uint64_t v)
+{
+   v &= 0xFFFF;
+   v = (v | (v << 16)) & 0x0000FF0000FFULL;
+   v = (v | (v << 8)) & 0x00F00F00F00FULL;
+   v = (v | (v << 4)) & 0x0C30C30C30C3ULL;
+   v = (v | (v << 2)) & 0x249249249249ULL;
+   return v;
+}
+
+// Permutation ordering codes ascending (stable), by a parallel LSD radix sort over threads threads.
+std::vector<uint64_t> morton_sort(const std::vector<uint64_t>& codes, unsigned threads);
+
+/*
+ * Morton order of n points, point(i) returning the position of point i. Returns order, order[k] being the index of
+ * the k-th point in Morton order.
+ */
+template <typename Point>
+std::vector<uint64_t> morton_order(size_t n, Point point, unsigned threads)
+//-------------------------------------------------------------------------
+{
+   if (n == 0) return std::vector<uint64_t>();
+   threads = std::max(threads, 1u);
+   float lo[3] = { std::numeric_limits<float>::max(), std::numeric_limits<float>::max(),
+                   std::numeric_limits<float>::max() };
+   float hi[3] = { std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest(),
+                   std::numeric_limits<float>::lowest() };
+   for (size_t i=0; i<n; i++)
+   {
+      const Real3<float> p = point(i);
+      lo[0] = std::min(lo[0], p.x); hi[0] = std::max(hi[0], p.x);
+      lo[1] = std::min(lo[1], p.y); hi[1] = std::max(hi[1], p.y);
+      lo[2] = std::min(lo[2], p.z); hi[2] = std::max(hi[2], p.z);
+   }
+   float cell[3];
+   for (int d=0; d<3; d++)
+      cell[d] = (hi[d] > lo[d]) ? 65535.0f / (hi[d] - lo[d]) : 0.0f;
+
+   std::vector<uint64_t> codes(n);
+   const size_t slice = (n + threads - 1) / threads;
+   auto encode = [&](size_t begin, size_t end)
+   {
+      for (size_t i=begin; i<end; i++)
+      {
+         const Real3<float> p = point(i);
+         const uint64_t x = static_cast<uint64_t>((p.x - lo[0])*cell[0]),
+                        y = static_cast<uint64_t>((p.y - lo[1])*cell[1]),
+                        z = static_cast<uint64_t>((p.z - lo[2])*cell[2]);
+         codes[i] = morton_spread(x) | (morton_spread(y) << 1) | (morton_spread(z) << 2);
+      }
+   };
+   std::vector<std::thread> workers;
+   for (size_t t=1; t<threads; t++)
+      workers.emplace_back(encode, std::min(n, t*slice), std::min(n, (t + 1)*slice));
+   encode(0, std::min(n, slice));
+   for (std::thread& worker : workers)
+      worker.join();
+   return morton_sort(codes, threads);
+}
+#endif //_MORTONORDER_H_
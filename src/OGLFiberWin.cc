@@ -48,18 +48,25 @@ namespace oglfiber
       }
    }
 
+   // Renders the window whenever it has been invalidated, at most once every fps_ns. Events are pumped by the executor
+   // (OGLFiberExecutor::run) so an idle window only wakes to drain its event ring and check its dirty flag.
    void OGLFiberWindow::run()
    //-----------------------------------------
    {
       GLFWwindow* win = window.get();
-      TimeType last_timestamp = std::chrono::high_resolution_clock::now();
       while (! glfwWindowShouldClose(win))
       {
          if ( (parent != nullptr) && (parent->is_stopping()) )
             break;
+         dispatch_events();
+         if (! is_dirty.exchange(false))
+         {
+            boost::this_fiber::sleep_for(OGLFiberExecutor::EVENT_POLL_INTERVAL);
+            continue;
+         }
 
+         const TimeType timestamp = std::chrono::high_resolution_clock::now();
          glfwMakeContextCurrent(win);
-         TimeType timestamp = std::chrono::high_resolution_clock::now();
          if (! on_render())
          {
             if (parent != nullptr)
@@ -68,10 +75,9 @@ namespace oglfiber
          }
          glfwSwapBuffers(win);
          glfwMakeContextCurrent(nullptr);
-         glfwPollEvents();
-         last_timestamp = timestamp;
-         long elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(timestamp - last_timestamp).count();
-         long dozetime = fps_ns - elapsed;
+         const long elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                 std::chrono::high_resolution_clock::now() - timestamp).count();
+         const long dozetime = fps_ns - elapsed;
          if (dozetime > 0)
             boost::this_fiber::sleep_for(std::chrono::nanoseconds(dozetime));
          else
@@ -80,6 +86,195 @@ namespace oglfiber
       OGLFiberExecutor::instance().running--;
    }
 
+   // Render loop of a window running on its own thread (see OGLFiberExecutor::start). The context stays current on the
+   // thread and the input events posted by the event thread are handled before each frame.
+   void OGLFiberWindow::run_thread()
+   //-------------------------------
+   {
+      GLFWwindow* win = window.get();
+      render_thread.store(std::this_thread::get_id());
+      glfwMakeContextCurrent(win);
+      while (! glfwWindowShouldClose(win))
+      {
+         if ( (parent != nullptr) && (parent->is_stopping()) )
+            break;
+         dispatch_events();
+         if (! is_dirty.exchange(false))
+         {
+            std::unique_lock<std::mutex> lock(event_mutex);
+            event_cv.wait_for(lock, std::chrono::duration<double>(OGLFiberExecutor::IDLE_WAIT_SECS),
+                              [this]() { return ( (is_dirty.load()) || (! tasks.empty()) ); });
+            continue;
+         }
+
+         const TimeType timestamp = std::chrono::high_resolution_clock::now();
+         if (glfwGetCurrentContext() != win) // eg after release_context
+            glfwMakeContextCurrent(win);
+         if (! on_render())
+         {
+            if (parent != nullptr)
+               parent->stop();
+            break;
+         }
+         glfwSwapBuffers(win);
+         const long elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                 std::chrono::high_resolution_clock::now() - timestamp).count();
+         const long dozetime = fps_ns - elapsed;
+         if (dozetime > 0)
+            std::this_thread::sleep_for(std::chrono::nanoseconds(dozetime));
+      }
+      glfwMakeContextCurrent(nullptr);
+   }
+
+   void OGLFiberWindow::invalidate()
+   //-------------------------------
+   {
+      {
+         std::lock_guard<std::mutex> lock(event_mutex);
+         is_dirty.store(true);
+      }
+      event_cv.notify_one();
+      glfwPostEmptyEvent();
+   }
+
+   void OGLFiberWindow::post(std::function<void()> task)
+   //---------------------------------------------------
+   {
+      if ( (! has_thread.load()) || (std::this_thread::get_id() == render_thread.load()) )
+      {
+         task();
+         invalidate();
+         return;
+      }
+      {
+         std::lock_guard<std::mutex> lock(event_mutex);
+         tasks.push_back(std::move(task));
+         is_dirty.store(true);
+      }
+      event_cv.notify_one();
+   }
+
+   /*
+    * Adds an input event to the event ring (called from the GLFW callbacks on the event thread). Consecutive cursor
+    * moves only keep the latest position, which is not pushed until another event is posted or the executor flushes
+    * the window after pumping events, so a fast drag costs one ring entry per pump instead of one per move.
+    */
+   void OGLFiberWindow::post_event(const InputEvent& event)
+   //------------------------------------------------------
+   {
+      if (event.type == InputEvent::CURSOR)
+      {
+         cursor_event = event;
+         has_cursor_event = true;
+         return;
+      }
+      if ( (has_cursor_event) && (events.push(cursor_event)) )
+         has_cursor_event = false;
+      events.push(event); // only fails (dropping the event) if the render loop has stalled for hundreds of events
+      is_event_posted = true;
+   }
+
+   // Pushes the pending cursor move and wakes the render loop if events were posted since the last flush
+   void OGLFiberWindow::flush_events()
+   //---------------------------------
+   {
+      if ( (has_cursor_event) && (events.push(cursor_event)) )
+      {
+         has_cursor_event = false;
+         is_event_posted = true;
+      }
+      if (! is_event_posted) return;
+      is_event_posted = false;
+      {
+         std::lock_guard<std::mutex> lock(event_mutex);
+         is_dirty.store(true);
+      }
+      event_cv.notify_one();
+   }
+
+   void OGLFiberWindow::request_cursor(int shape)
+   //--------------------------------------------
+   {
+      requested_cursor.store(shape);
+      is_cursor_request.store(true);
+      glfwPostEmptyEvent();
+   }
+
+   // Sets the cursor requested by request_cursor, on the event thread
+   void OGLFiberWindow::apply_cursor()
+   //---------------------------------
+   {
+      if (! is_cursor_request.exchange(false)) return;
+      const int shape = requested_cursor.load();
+      if (shape == cursor_shape) return;
+      GLFWcursor* previous = cursor;
+      cursor = (shape == 0) ? nullptr : glfwCreateStandardCursor(shape);
+      glfwSetCursor(window.get(), cursor);
+      if (previous != nullptr)
+         glfwDestroyCursor(previous);
+      if (cursor == nullptr)
+         glfwSetInputMode(window.get(), GLFW_CURSOR, GLFW_CURSOR_NORMAL);
+      cursor_shape = shape;
+   }
+
+   // Runs the posted tasks and calls the input handlers for the events in the ring, on the render thread (or fiber).
+   // Cursor moves still queued back to back (posted in different pumps) are collapsed to the last one.
+   void OGLFiberWindow::dispatch_events()
+   //------------------------------------
+   {
+      std::deque<std::function<void()>> pending_tasks;
+      {
+         std::lock_guard<std::mutex> lock(event_mutex);
+         pending_tasks.swap(tasks);
+      }
+      for (std::function<void()>& task : pending_tasks)
+         task();
+      InputEvent event, cursor{InputEvent::CURSOR, {0, 0, 0, 0}, 0, 0};
+      bool is_cursor_pending = false;
+      while (events.pop(event))
+      {
+         if (event.type == InputEvent::CURSOR)
+         {
+            cursor = event;
+            is_cursor_pending = true;
+            continue;
+         }
+         if (is_cursor_pending)
+         {
+            dispatch(cursor);
+            is_cursor_pending = false;
+         }
+         dispatch(event);
+      }
+      if (is_cursor_pending)
+         dispatch(cursor);
+   }
+
+   void OGLFiberWindow::dispatch(const InputEvent& event)
+   //----------------------------------------------------
+   {
+      switch (event.type)
+      {
+         case InputEvent::KEY:
+            key_queue.emplace(event.i[0], event.i[1], event.i[2], event.i[3]);
+            if (key_queue.size() > OGLFiberExecutor::MAX_KEYBUF_SIZE)
+               key_queue.pop();
+            on_key_press(key_queue.back());
+            break;
+         case InputEvent::CURSOR: onCursorUpdate(event.x, event.y); break;
+         case InputEvent::BUTTON: on_mouse_click(event.i[0], event.i[1], event.i[2]); break;
+         case InputEvent::SCROLL: on_mouse_scroll(event.x, event.y); break;
+         case InputEvent::FOCUS: on_focus(event.i[0] != 0); break;
+         case InputEvent::SIZE:
+            width = event.i[0];
+            height = event.i[1];
+            if (glfwGetCurrentContext() != window.get()) // the render loop makes it current again before rendering
+               glfwMakeContextCurrent(window.get());
+            on_resized(width, height);
+            break;
+      }
+   }
+
    //Stuff that must be done on the main thread
    void OGLFiberExecutor::setup_win(OGLFiberWindow *window)
    //----------------------------------------------------------
@@ -103,9 +298,11 @@ namespace oglfiber
       glfwSetWindowCloseCallback(win, &glfw_on_close);
    }
 
-   bool OGLFiberExecutor::start(std::initializer_list<OGLFiberWindow *> windows_, bool is_threaded)
-   //------------------------------------------------------------------------
+   bool OGLFiberExecutor::start(std::initializer_list<OGLFiberWindow *> windows_, bool is_threaded,
+                                bool is_thread_per_window_)
+   //----------------------------------------------------------------------------------------------
    {
+      is_thread_per_window = is_thread_per_window_;
       for (OGLFiberWindow *window : windows_)
       {
          windows.emplace_back(window);
@@ -121,9 +318,11 @@ namespace oglfiber
       return true;
    }
 
-   bool OGLFiberExecutor::start(std::initializer_list<std::shared_ptr<OGLFiberWindow>> windows_, bool is_threaded)
+   bool OGLFiberExecutor::start(std::initializer_list<std::shared_ptr<OGLFiberWindow>> windows_, bool is_threaded,
+                                bool is_thread_per_window_)
    //---------------------------------------------------------------------------------------------------------
    {
+      is_thread_per_window = is_thread_per_window_;
       windows.insert(windows.end(), windows_.begin(), windows_.end());
       std::for_each(windows.begin(), windows.end(),
                     [this](const std::shared_ptr<OGLFiberWindow> window) { this->setup_win(window.get()); });
@@ -136,33 +335,45 @@ namespace oglfiber
 
    std::unordered_map<GLFWwindow*, OGLFiberWindow*> OGLFiberExecutor::window_lookup;
 
-   void OGLFiberExecutor::run()
-   //---------------------------
+   // Makes the window context current on the calling thread, loads the OpenGL entry points and initializes the window
+   void OGLFiberExecutor::initialize_window(OGLFiberWindow* window)
+   //--------------------------------------------------------------
    {
-      for (const std::shared_ptr<OGLFiberWindow>& window : windows)
-      {
-         GLFWwindow* win = window->window.get();
-         glfwMakeContextCurrent(win);
+      GLFWwindow* win = window->window.get();
+      glfwMakeContextCurrent(win);
 #ifdef USE_GLEW
-         if (glewInit() != GLEW_OK)
-         {
-            std::cerr <<  "Error initializing GLEW" << std::endl;
-            throw std::runtime_error("Error initializing GLEW");
-         }
+      if (glewInit() != GLEW_OK)
+      {
+         std::cerr <<  "Error initializing GLEW" << std::endl;
+         throw std::runtime_error("Error initializing GLEW");
+      }
 #endif
 #ifdef USE_GLAD
-         if (!gladLoadGLLoader((GLADloadproc) glfwGetProcAddress))
-         {
-            std::cerr << "Error initializing GLAD" << std::endl;
-            throw std::runtime_error("Error initializing GLAD");
-         }
+      if (!gladLoadGLLoader((GLADloadproc) glfwGetProcAddress))
+      {
+         std::cerr << "Error initializing GLAD" << std::endl;
+         throw std::runtime_error("Error initializing GLAD");
+      }
 #endif
-         std::cout << "OpenGL: " << ((const char *)glGetString(GL_VENDOR)) << " "
-                   << ((const char *)glGetString(GL_RENDERER)) << " "
-                   << ((const char *)glGetString(GL_VERSION)) << " (GLSL "
-                   << ((const char *)glGetString(GL_SHADING_LANGUAGE_VERSION)) << ")\n";
-         window->on_initialize(win);
-         window->on_resized(window->width, window->height);
+      std::cout << "OpenGL: " << ((const char *)glGetString(GL_VENDOR)) << " "
+                << ((const char *)glGetString(GL_RENDERER)) << " "
+                << ((const char *)glGetString(GL_VERSION)) << " (GLSL "
+                << ((const char *)glGetString(GL_SHADING_LANGUAGE_VERSION)) << ")\n";
+      window->on_initialize(win);
+      window->on_resized(window->width, window->height);
+   }
+
+   void OGLFiberExecutor::run()
+   //---------------------------
+   {
+      if (is_thread_per_window)
+      {
+         run_window_threads();
+         return;
+      }
+      for (const std::shared_ptr<OGLFiberWindow>& window : windows)
+      {
+         initialize_window(window.get());
          glfwMakeContextCurrent(nullptr);
 
          boost::fibers::fiber* pfiber = new boost::fibers::fiber(std::bind(&OGLFiberWindow::run, window));
@@ -173,9 +384,18 @@ namespace oglfiber
    //      fibers.emplace_back(std::bind(&OGLWindow::run, window));
       }
 
+      // Pump events for all windows. While no window has a frame pending the thread blocks in glfwWaitEventsTimeout
+      // until input arrives or a window is invalidated (which posts an empty event).
       must_stop.store(false);
       while (! must_stop.load())
-         boost::this_fiber::sleep_for(std::chrono::milliseconds(300));
+      {
+         if (is_any_dirty())
+            glfwPollEvents();
+         else
+            glfwWaitEventsTimeout(IDLE_WAIT_SECS);
+         flush_events();
+         boost::this_fiber::sleep_for(EVENT_POLL_INTERVAL);
+      }
       for (const std::shared_ptr<OGLFiberWindow>& window : windows)
       {
          glfwSetWindowShouldClose(window->window.get(), GLFW_TRUE);
@@ -188,6 +408,64 @@ namespace oglfiber
       }
    }
 
+   // Windows are initialized here in turn, then each renders on its own thread while this one only waits for and
+   // routes events (see OGLFiberWindow::post_event).
+   void OGLFiberExecutor::run_window_threads()
+   //-----------------------------------------
+   {
+      must_stop.store(false);
+      for (const std::shared_ptr<OGLFiberWindow>& window : windows)
+      {
+         initialize_window(window.get());
+         glfwMakeContextCurrent(nullptr);
+      }
+      for (const std::shared_ptr<OGLFiberWindow>& window : windows)
+      {
+         window->has_thread.store(true);
+         window_threads.emplace_back(&OGLFiberWindow::run_thread, window.get());
+      }
+
+      while (! must_stop.load())
+      {
+         glfwWaitEventsTimeout(IDLE_WAIT_SECS);
+         flush_events();
+      }
+      for (const std::shared_ptr<OGLFiberWindow>& window : windows)
+      {
+         glfwSetWindowShouldClose(window->window.get(), GLFW_TRUE);
+         window->invalidate();
+      }
+      for (std::thread& window_thread : window_threads)
+         window_thread.join();
+      window_threads.clear();
+      for (const std::shared_ptr<OGLFiberWindow>& window : windows)
+         window->has_thread.store(false);
+      for (const std::shared_ptr<OGLFiberWindow>& window : windows)
+         window->on_exit();
+   }
+
+   bool OGLFiberExecutor::is_any_dirty() const
+   //-----------------------------------------
+   {
+      for (const std::shared_ptr<OGLFiberWindow>& window : windows)
+      {
+         if (window->is_dirty.load())
+            return true;
+      }
+      return false;
+   }
+
+   // Called on the event thread after each pump, which is also where cursor changes requested by the windows are made
+   void OGLFiberExecutor::flush_events()
+   //-----------------------------------
+   {
+      for (const std::shared_ptr<OGLFiberWindow>& window : windows)
+      {
+         window->flush_events();
+         window->apply_cursor();
+      }
+   }
+
    void OGLFiberExecutor::glfw_on_key(GLFWwindow* win, int key, int scancode, int action, int modifier)
    //---------------------------------------------------------------------------------------------------
    {
@@ -195,10 +473,7 @@ namespace oglfiber
       if (it != window_lookup.end())
       {
          OGLFiberWindow* window = it->second;
-         window->key_queue.emplace(key, scancode, action, modifier);
-         if (window->key_queue.size() > MAX_KEYBUF_SIZE)
-            window->key_queue.pop();
-         window->on_key_press(window->key_queue.back());
+         window->post_event(InputEvent{InputEvent::KEY, {key, scancode, action, modifier}, 0, 0});
       }
    }
 
@@ -209,12 +484,7 @@ namespace oglfiber
       if (it != window_lookup.end())
       {
          OGLFiberWindow* window = it->second;
-         //glfwGetFramebufferSize(win, &window.width, &window.height);
-         window->width = width;
-         window->height = height;
-         glfwMakeContextCurrent(win);
-         window->on_resized(width, height);
-         glfwMakeContextCurrent(nullptr);
+         window->post_event(InputEvent{InputEvent::SIZE, {width, height, 0, 0}, 0, 0});
       }
    }
 
@@ -232,7 +502,7 @@ namespace oglfiber
       if (it != window_lookup.end())
       {
          OGLFiberWindow* window = it->second;
-         window->on_focus(has_focus == GLFW_TRUE);
+         window->post_event(InputEvent{InputEvent::FOCUS, {(has_focus == GLFW_TRUE) ? 1 : 0, 0, 0, 0}, 0, 0});
       }
    }
 
@@ -243,7 +513,7 @@ namespace oglfiber
       if (it != window_lookup.end())
       {
          OGLFiberWindow* window = it->second;
-         window->onCursorUpdate(xpos, ypos);
+         window->post_event(InputEvent{InputEvent::CURSOR, {0, 0, 0, 0}, xpos, ypos});
       }
    }
 
@@ -254,7 +524,7 @@ namespace oglfiber
       if (it != window_lookup.end())
       {
          OGLFiberWindow* window = it->second;
-         window->on_mouse_click(button, action, mods);
+         window->post_event(InputEvent{InputEvent::BUTTON, {button, action, mods, 0}, 0, 0});
       }
    }
 
@@ -265,7 +535,7 @@ namespace oglfiber
       if (it != window_lookup.end())
       {
          OGLFiberWindow* window = it->second;
-         window->on_mouse_scroll(xoffset, yoffset);
+         window->post_event(InputEvent{InputEvent::SCROLL, {0, 0, 0, 0}, xoffset, yoffset});
       }
    }
 
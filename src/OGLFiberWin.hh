@@ -50,8 +50,14 @@ SOFTWARE.
 #include <utility>
 #include <unordered_map>
 #include <queue>
+#include <deque>
 #include <atomic>
 #include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <algorithm>
 
 #ifdef STD_FILESYSTEM
 #include <filesystem>
@@ -96,6 +102,54 @@ namespace oglfiber
       KeyPress(int key, int scancode, int action, int modifiers) : key(key), scancode(scancode), action(action), modifiers(modifiers) {}
    };
 
+   // Input event routed from the GLFW callbacks (event thread) to the render loop of the window it was delivered to
+   struct InputEvent
+   {
+      enum Type { KEY, CURSOR, BUTTON, SCROLL, FOCUS, SIZE };
+
+      Type type;
+      int i[4];    // KEY key, scancode, action, modifiers; BUTTON button, action, mods; FOCUS has focus; SIZE w, h
+      double x, y; // CURSOR position; SCROLL offsets
+   };
+
+   /*
+    * Bounded lock-free single producer, single consumer ring. push is only called from one thread (the event thread)
+    * and pop from one other (the window render loop); N must be a power of 2.
+    */
+   template <typename T, size_t N>
+   class SPSCRing
+   //=============
+   {
+      static_assert( (N > 0) && ((N & (N - 1)) == 0), "SPSCRing size must be a power of 2");
+   public:
+      // False (and the item dropped) if the ring is full
+      bool push(const T& item)
+      {
+         const size_t t = tail.load(std::memory_order_relaxed);
+         if (t - head.load(std::memory_order_acquire) >= N) return false;
+         items[t & (N - 1)] = item;
+         tail.store(t + 1, std::memory_order_release);
+         return true;
+      }
+
+      bool pop(T& item)
+      {
+         const size_t h = head.load(std::memory_order_relaxed);
+         if (h == tail.load(std::memory_order_acquire)) return false;
+         item = items[h & (N - 1)];
+         head.store(h + 1, std::memory_order_release);
+         return true;
+      }
+
+      bool empty() const { return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire); }
+
+   private:
+      // Separate cache lines so the producer and consumer do not invalidate each others index
+      alignas(64) std::atomic<size_t> head{0};
+      alignas(64) std::atomic<size_t> tail{0};
+      T items[N];
+   };
+
    class OGLFiberWindow
    //===================
    {
@@ -128,7 +182,8 @@ namespace oglfiber
 
       std::string messages() { return log.str(); }
 
-      void frames_per_second(long fps_) { fps = fps_; fps_ns = (1000000000L / (fps >> 1)); }
+      // Maximum frame rate, the minimum interval between the starts of consecutive frames being 1/fps seconds.
+      void frames_per_second(long fps_) { fps = std::max(fps_, 1L); fps_ns = (1000000000L / fps); }
 
       long frames_per_second() { return fps; }
 
@@ -156,6 +211,27 @@ namespace oglfiber
 
       void request_focus() { if (window) { glfwShowWindow(window.get()); glfwFocusWindow(window.get()); } }
 
+      /*
+       * Requests a frame. Windows are only rendered when invalidated: input events invalidate the window they are
+       * delivered to, anything else changing what is drawn (data updates from other threads, ongoing loading or
+       * animation, where on_render invalidates again for the next frame) must call this. Safe from any thread.
+       */
+      void invalidate();
+
+      /*
+       * Runs task on the window's render thread before its next frame, or at once when called on that thread (always
+       * the case unless windows run on their own threads, see OGLFiberExecutor::start). Used for calls from one window
+       * into another. Invalidates the window.
+       */
+      void post(std::function<void()> task);
+
+      /*
+       * Requests the cursor shown over the window, a GLFW standard cursor shape (eg GLFW_HAND_CURSOR) or 0 for the
+       * default. GLFW only allows cursor changes on the thread pumping events, so the executor applies the request
+       * after its next pump (see apply_cursor). Safe from any thread.
+       */
+      void request_cursor(int shape);
+
       friend class OGLFiberExecutor;
 
    protected:
@@ -176,7 +252,24 @@ namespace oglfiber
       GLFWmonitor* monitor = nullptr;
       std::stringstream log;
       long fps = 50;
-      long fps_ns = (1000000000L / (fps >> 1));
+      long fps_ns = (1000000000L / fps);
+      std::atomic_bool is_dirty{true};
+      // Input events, written by the GLFW callbacks and drained by the render loop before each frame. Cursor moves
+      // are coalesced into cursor_event until the executor flushes them after pumping events (see post_event).
+      SPSCRing<InputEvent, 256> events;
+      InputEvent cursor_event{InputEvent::CURSOR, {0, 0, 0, 0}, 0, 0};
+      bool has_cursor_event = false, is_event_posted = false;
+      // Tasks posted by other windows and wake ups for a window running on its own thread
+      std::mutex event_mutex;
+      std::condition_variable event_cv;
+      std::deque<std::function<void()>> tasks;
+      std::atomic_bool has_thread{false};
+      std::atomic<std::thread::id> render_thread;
+      // Cursor shape set by request_cursor, cursor_shape and cursor are only used on the event thread
+      std::atomic<int> requested_cursor{0};
+      std::atomic_bool is_cursor_request{false};
+      int cursor_shape = 0;
+      GLFWcursor* cursor = nullptr;
       OGLFiberExecutor* parent = nullptr;
       std::unique_ptr<GLFWwindow> window{nullptr};
       boost::fibers::fiber_specific_ptr<int> last_error;
@@ -184,6 +277,12 @@ namespace oglfiber
 
       bool create(std::stringstream* errs =nullptr);
       void run();
+      void run_thread();
+      void post_event(const InputEvent& event);
+      void flush_events();
+      void apply_cursor();
+      void dispatch_events();
+      void dispatch(const InputEvent& event);
    };
 
    class OGLFiberExecutor
@@ -198,11 +297,17 @@ namespace oglfiber
 
       /*
       is_threaded - true to run fiber in a different thread.
+      is_thread_per_window - true to run each window on its own thread with its context kept current, so windows
+      render in parallel. The executor (fiber) then only handles GLFW events.
+      In both modes GLFW events are routed to per window event rings which the window render loops drain before each
+      frame, so input handlers always run on the thread (or fiber) that renders the window.
       */
-      bool start(std::initializer_list<OGLFiberWindow *> windows_, bool is_threaded =false);
-      bool start(std::initializer_list<std::shared_ptr<OGLFiberWindow>> windows_, bool is_threaded =false);
+      bool start(std::initializer_list<OGLFiberWindow *> windows_, bool is_threaded =false,
+                 bool is_thread_per_window =false);
+      bool start(std::initializer_list<std::shared_ptr<OGLFiberWindow>> windows_, bool is_threaded =false,
+                 bool is_thread_per_window =false);
 
-      void stop() { must_stop.store(true); }
+      void stop() { must_stop.store(true); glfwPostEmptyEvent(); }
       bool is_stopping() { return must_stop.load(); };
       void join()
       {
@@ -215,11 +320,17 @@ namespace oglfiber
 
    private:
       void run();
+      void run_window_threads();
+      bool is_any_dirty() const;
+      void flush_events();
+      static void initialize_window(OGLFiberWindow* window);
 
       std::thread thread;
       boost::fibers::fiber main_fiber;
       std::vector<std::shared_ptr<OGLFiberWindow>> windows;
       std::vector<std::shared_ptr<boost::fibers::fiber>> fibers;
+      std::vector<std::thread> window_threads;
+      bool is_thread_per_window = false;
       size_t running = 0;
       std::atomic_bool must_stop; // atomic so an external thread can also terminate loop
       OGLFiberWindow* current_window = nullptr;
@@ -255,6 +366,10 @@ namespace oglfiber
       static void glfw_on_close(GLFWwindow *);
 
       static const size_t MAX_KEYBUF_SIZE = 100;
+      // Event polling interval while any window has a frame pending, and the maximum time blocked waiting for events
+      // when none has.
+      static constexpr std::chrono::milliseconds EVENT_POLL_INTERVAL{4};
+      static constexpr double IDLE_WAIT_SECS = 0.5;
 
       friend class OGLFiberWindow;
 
@@ -424,4 +424,123 @@ namespace oglutil
       }
       return false;
    }
-}
\ No newline at end of file
+
+   unsigned char* StreamingTexture::begin_upload(GLsizei width, GLsizei height, int channels, GLenum format,
+                                                 GLenum internal_format)
+   //------------------------------------------------------------------------------------------------------
+   {
+      if ( (width <= 0) || (height <= 0) || (channels <= 0) || (pbos.empty()) ) return nullptr;
+      if ( (tex == 0) || (width != tex_width) || (height != tex_height) || (internal_format != tex_internal_format) )
+      {
+         if (tex == 0)
+            glGenTextures(1, &tex);
+         glBindTexture(target, tex);
+         glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+         glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+         glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+         glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+         glTexImage2D(target, 0, internal_format, width, height, 0, format, GL_UNSIGNED_BYTE, nullptr);
+         glBindTexture(target, 0);
+         tex_width = width; tex_height = height; tex_internal_format = internal_format;
+      }
+      tex_format = format;
+      row_bytes = (static_cast<size_t>(width)*channels + 3) & ~static_cast<size_t>(3); // GL_UNPACK_ALIGNMENT 4
+      const size_t size = row_bytes*static_cast<size_t>(height);
+      if (size > capacity)
+      {
+         release_buffers();
+         const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+         glGenBuffers(static_cast<GLsizei>(pbos.size()), pbos.data());
+         for (size_t i=0; i<pbos.size(); i++)
+         {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbos[i]);
+            glBufferStorage(GL_PIXEL_UNPACK_BUFFER, size, nullptr, flags);
+            mapped[i] = static_cast<unsigned char*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, flags));
+            if (mapped[i] == nullptr)
+            {
+               std::cerr << "StreamingTexture::begin_upload: Error mapping " << size << " byte pixel buffer"
+                         << std::endl;
+               glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+               release_buffers();
+               return nullptr;
+            }
+         }
+         glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+         capacity = size;
+      }
+      GLsync& fence = fences[current];
+      if (fence != nullptr)
+      {
+         GLenum status;
+         do
+            status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+         while (status == GL_TIMEOUT_EXPIRED);
+         glDeleteSync(fence);
+         fence = nullptr;
+      }
+      is_uploading = true;
+      return mapped[current];
+   }
+
+   bool StreamingTexture::end_upload()
+   //---------------------------------
+   {
+      if (! is_uploading) return false;
+      is_uploading = false;
+      GLenum err;
+      std::stringstream errs;
+      clearGLErrors();
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbos[current]);
+      glBindTexture(target, tex);
+      glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+      glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+      glTexSubImage2D(target, 0, 0, 0, tex_width, tex_height, tex_format, GL_UNSIGNED_BYTE, nullptr);
+      fences[current] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+      glBindTexture(target, 0);
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+      current = (current + 1) % pbos.size();
+      if (! isGLOk(err, &errs))
+      {
+         std::cerr << "StreamingTexture::end_upload: " << err << " - " << errs.str() << std::endl;
+         return false;
+      }
+      return true;
+   }
+
+   void StreamingTexture::release()
+   //------------------------------
+   {
+      release_buffers();
+      if (tex != 0)
+         glDeleteTextures(1, &tex);
+      tex = 0;
+      tex_width = tex_height = 0;
+      tex_internal_format = 0;
+   }
+
+   void StreamingTexture::release_buffers()
+   //--------------------------------------
+   {
+      for (GLsync& fence : fences)
+      {
+         if (fence != nullptr)
+            glDeleteSync(fence);
+         fence = nullptr;
+      }
+      for (size_t i=0; i<pbos.size(); i++)
+      {
+         if (pbos[i] == 0) continue;
+         if (mapped[i] != nullptr)
+         {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbos[i]);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+         }
+         glDeleteBuffers(1, &pbos[i]);
+         pbos[i] = 0;
+         mapped[i] = nullptr;
+      }
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+      capacity = 0;
+      current = 0;
+   }
+}
@@ -24,6 +24,7 @@ SOFTWARE.
 #define TRAINER_OGLSHADERUTILS_H
 
 #include <string>
+#include <vector>
 #include <unordered_map>
 #include <algorithm>
 #include <regex>
@@ -41,6 +42,7 @@ namespace filesystem = boost::filesystem;
 #endif
 
 #include <GL/gl.h>
+#include <GL/glext.h>
 
 namespace oglutil
 {
@@ -124,6 +126,49 @@ namespace oglutil
 
       bool delu(const std::string& k, GLuint* v);
    };
+
+   /*
+    * Texture updated through a ring of persistently mapped pixel unpack buffers (OpenGL 4.4 glBufferStorage). The
+    * caller writes the pixels straight into the mapped buffer returned by begin_upload and end_upload copies them to
+    * the texture with glTexSubImage2D, so the copy runs asynchronously on the GPU. A fence per buffer stops it being
+    * overwritten while the GPU may still read it, which only blocks if more than buffers uploads are in flight. The
+    * texture is only reallocated when the image size or format changes. Must be used with a context current.
+    */
+   class StreamingTexture
+   //====================
+   {
+   public:
+      explicit StreamingTexture(GLenum target =GL_TEXTURE_2D, size_t buffers =3) : target(target),
+                                                                                  pbos(buffers, 0),
+                                                                                  fences(buffers, nullptr),
+                                                                                  mapped(buffers, nullptr) {}
+
+      // Next buffer to write height rows of width pixels into, stride() bytes apart. nullptr on error.
+      unsigned char* begin_upload(GLsizei width, GLsizei height, int channels, GLenum format, GLenum internal_format);
+
+      // Copies the buffer written since begin_upload into the texture
+      bool end_upload();
+
+      size_t stride() const { return row_bytes; }
+
+      GLuint texture() const { return tex; }
+
+      // Deletes the texture and buffers (with the context current)
+      void release();
+
+   private:
+      GLenum target;
+      GLuint tex = 0;
+      GLsizei tex_width = 0, tex_height = 0;
+      GLenum tex_format = GL_RGB, tex_internal_format = 0;
+      std::vector<GLuint> pbos;
+      std::vector<GLsync> fences;
+      std::vector<unsigned char*> mapped;
+      size_t capacity = 0, row_bytes = 0, current = 0;
+      bool is_uploading = false;
+
+      void release_buffers();
+   };
 };
 
 #endif //TRAINER_OGLSHADERUTILS_H
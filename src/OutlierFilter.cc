@@ -0,0 +1,67 @@
+#include "OutlierFilter.h"
+
+#include <cmath>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+
+void knn_mean_distances(const kd_tree_t& index, size_t n, size_t k, unsigned threads, float* distances)
+//----------------------------------------------------------------------------------------------------
+{
+   // Blocks of points are handed out dynamically as search cost varies with the local density. Points are visited in
+   // kd-tree leaf order (vind) so consecutive queries touch the same nodes and points.
+   constexpr size_t BLOCK = 4096;
+   const bool is_leaf_order = (index.vind.size() == n);
+   std::atomic<size_t> next{0};
+   auto worker = [&]()
+   {
+      // k + 1 as each point finds itself (at distance 0)
+      std::vector<size_t> indices(k + 1);
+      std::vector<float> dists(k + 1);
+      float query[3];
+      for (size_t start = next.fetch_add(BLOCK); start < n; start = next.fetch_add(BLOCK))
+      {
+         const size_t end = std::min(n, start + BLOCK);
+         for (size_t j=start; j<end; j++)
+         {
+            const size_t i = (is_leaf_order) ? index.vind[j] : j;
+            query[0] = index.dataset.kdtree_get_pt(i, 0);
+            query[1] = index.dataset.kdtree_get_pt(i, 1);
+            query[2] = index.dataset.kdtree_get_pt(i, 2);
+            const size_t found = index.knnSearch(query, k + 1, indices.data(), dists.data());
+            double total = 0;
+            for (size_t m=0; m<found; m++)
+               total += std::sqrt(dists[m]);
+            distances[i] = (found > 1) ? static_cast<float>(total / static_cast<double>(found - 1)) : 0.0f;
+         }
+      }
+   };
+   std::vector<std::thread> workers;
+   for (unsigned t=1; t<threads; t++)
+      workers.emplace_back(worker);
+   worker();
+   for (std::thread& t : workers)
+      t.join();
+}
+
+std::vector<size_t> statistical_outliers(const float* distances, size_t n, float sigma)
+//-------------------------------------------------------------------------------------
+{
+   std::vector<size_t> outliers;
+   if (n < 2) return outliers;
+   double sum = 0, sum2 = 0;
+   for (size_t i=0; i<n; i++)
+   {
+      sum += distances[i];
+      sum2 += static_cast<double>(distances[i])*distances[i];
+   }
+   const double mean = sum / static_cast<double>(n);
+   const double variance = std::max(0.0, (sum2 - sum*mean) / static_cast<double>(n - 1));
+   const double threshold = mean + sigma*std::sqrt(variance);
+   for (size_t i=0; i<n; i++)
+   {
+      if (distances[i] > threshold)
+         outliers.push_back(i);
+   }
+   return outliers;
+}
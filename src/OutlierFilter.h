@@ -0,0 +1,27 @@
+#ifndef _OUTLIERFILTER_H_
+#define _OUTLIERFILTER_H_
+
+#include <cstddef>
+#include <vector>
+
+#include "PointCloudSource.h"
+
+/*
+ * Statistical outlier removal (as in PCL StatisticalOutlierRemoval). Each point is scored by the mean distance to its
+ * k nearest neighbours and points scoring more than sigma standard deviations above the mean score of the cloud are
+ * outliers (eg the flying pixels at depth discontinuities in Tango or Kinect scans). sigma 0 disables the filter.
+ */
+struct OutlierOptions
+{
+   size_t k = 8;
+   float sigma = 0;
+
+   bool enabled() const { return ( (sigma > 0) && (k > 0) ); }
+};
+
+// Mean distance from each of the n points indexed by index to its k nearest neighbours, computed by threads threads.
+void knn_mean_distances(const kd_tree_t& index, size_t n, size_t k, unsigned threads, float* distances);
+
+// Indices of the points whose mean neighbour distance is above the mean by more than sigma standard deviations.
+std::vector<size_t> statistical_outliers(const float* distances, size_t n, float sigma);
+#endif //_OUTLIERFILTER_H_
@@ -0,0 +1,189 @@
+#include "PackedVertex.h"
+
+#ifdef USE_GLEW
+#include <GL/glew.h>
+#endif
+#ifdef USE_GLAD
+#include <glad/glad.h>
+#endif
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <algorithm>
+
+size_t vertex_size(VertexFormat format)
+//-------------------------------------
+{
+   switch (format)
+   {
+      case VertexFormat::PACKED:    return sizeof(PackedVertex);
+      case VertexFormat::QUANTIZED: return sizeof(QuantizedVertex);
+      default:                      return 8*sizeof(float);
+   }
+}
+
+size_t vertex_flags_offset(VertexFormat format)
+//---------------------------------------------
+{
+   switch (format)
+   {
+      case VertexFormat::PACKED:    return offsetof(PackedVertex, flags);
+      case VertexFormat::QUANTIZED: return offsetof(QuantizedVertex, flags);
+      default:                      return 3*sizeof(float);
+   }
+}
+
+size_t vertex_flags_size(VertexFormat format)
+//-------------------------------------------
+{
+   switch (format)
+   {
+      case VertexFormat::PACKED:    return sizeof(PackedVertex::flags);
+      case VertexFormat::QUANTIZED: return sizeof(QuantizedVertex::flags);
+      default:                      return sizeof(float);
+   }
+}
+
+const char* vertex_shader_subdir(VertexFormat format)
+//---------------------------------------------------
+{
+   return (format == VertexFormat::FLOAT32) ? "" : "packed";
+}
+
+bool parse_vertex_format(const std::string& name, VertexFormat& format)
+//---------------------------------------------------------------------
+{
+   if (name == "float")
+      format = VertexFormat::FLOAT32;
+   else if (name == "packed")
+      format = VertexFormat::PACKED;
+   else if (name == "quantized")
+      format = VertexFormat::QUANTIZED;
+   else
+      return false;
+   return true;
+}
+
+QuantizationBox quantization_box(const float* vertices, size_t n)
+//---------------------------------------------------------------
+{
+   float lo[3] = { std::numeric_limits<float>::max(), std::numeric_limits<float>::max(),
+                   std::numeric_limits<float>::max() };
+   float hi[3] = { std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest(),
+                   std::numeric_limits<float>::lowest() };
+   for (size_t i=0; i<n; i++)
+   {
+      const float* v = vertices + i*8;
+      for (int d=0; d<3; d++)
+      {
+         lo[d] = std::min(lo[d], v[d]);
+         hi[d] = std::max(hi[d], v[d]);
+      }
+   }
+   QuantizationBox box;
+   if (n == 0) return box;
+   for (int d=0; d<3; d++)
+   {
+      box.offset[d] = lo[d];
+      box.scale[d] = (hi[d] > lo[d]) ? (hi[d] - lo[d]) / 65535.0f : 1.0f;
+   }
+   return box;
+}
+
+inline uint8_t _unorm8(float c) { return static_cast<uint8_t>(std::lround(std::min(std::max(c, 0.0f), 1.0f)*255.0f)); }
+
+void convert_vertices(VertexFormat format, const float* vertices, size_t n, uint8_t* out, const QuantizationBox* box,
+                      bool is_distance)
+//-------------------------------------------------------------------------------------------------------------------
+{
+   switch (format)
+   {
+      case VertexFormat::FLOAT32:
+         memcpy(out, vertices, n*8*sizeof(float));
+         break;
+
+      case VertexFormat::PACKED:
+      {
+         PackedVertex* pv = reinterpret_cast<PackedVertex*>(out);
+         for (size_t i=0; i<n; i++, pv++)
+         {
+            const float* v = vertices + i*8;
+            pv->x = v[0]; pv->y = v[1]; pv->z = v[2];
+            pv->flags = (is_distance) ? ((v[3] == 0) ? 0 : 1) : static_cast<uint8_t>(v[3]);
+            pv->r = _unorm8(v[4]); pv->g = _unorm8(v[5]); pv->b = _unorm8(v[6]);
+         }
+         break;
+      }
+
+      case VertexFormat::QUANTIZED:
+      {
+         const QuantizationBox qbox = (box == nullptr) ? quantization_box(vertices, n) : *box;
+         QuantizedVertex* qv = reinterpret_cast<QuantizedVertex*>(out);
+         for (size_t i=0; i<n; i++, qv++)
+         {
+            const float* v = vertices + i*8;
+            int16_t q[3];
+            for (int d=0; d<3; d++)
+            {
+               long l = std::lround((v[d] - qbox.offset[d]) / qbox.scale[d]) - 32768;
+               q[d] = static_cast<int16_t>(std::min(std::max(l, -32768L), 32767L));
+            }
+            qv->x = q[0]; qv->y = q[1]; qv->z = q[2];
+            qv->flags = (is_distance) ? ((v[3] == 0) ? 0 : 1) : static_cast<uint16_t>(v[3]);
+            qv->r = _unorm8(v[4]); qv->g = _unorm8(v[5]); qv->b = _unorm8(v[6]); qv->a = _unorm8(v[7]);
+         }
+         break;
+      }
+   }
+}
+
+void set_vertex_flags(VertexFormat format, uint8_t* vertex, float flags)
+//----------------------------------------------------------------------
+{
+   uint8_t* p = vertex + vertex_flags_offset(format);
+   switch (format)
+   {
+      case VertexFormat::PACKED:    *p = static_cast<uint8_t>(flags); break;
+      case VertexFormat::QUANTIZED:
+      {
+         const uint16_t v = static_cast<uint16_t>(flags);
+         memcpy(p, &v, sizeof(v));
+         break;
+      }
+      default:                      memcpy(p, &flags, sizeof(float)); break;
+   }
+}
+
+void set_vertex_attributes(VertexFormat format)
+//---------------------------------------------
+{
+   const GLsizei stride = static_cast<GLsizei>(vertex_size(format));
+   glEnableVertexAttribArray(0);
+   glEnableVertexAttribArray(1);
+   switch (format)
+   {
+      case VertexFormat::FLOAT32:
+         glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, stride, 0);
+         glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<const void *>(4 * sizeof (GLfloat)));
+         break;
+      case VertexFormat::PACKED:
+         glEnableVertexAttribArray(2);
+         glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, 0);
+         glVertexAttribPointer(1, 3, GL_UNSIGNED_BYTE, GL_TRUE, stride,
+                               reinterpret_cast<const void *>(offsetof(PackedVertex, r)));
+         glVertexAttribPointer(2, 1, GL_UNSIGNED_BYTE, GL_FALSE, stride,
+                               reinterpret_cast<const void *>(offsetof(PackedVertex, flags)));
+         break;
+      case VertexFormat::QUANTIZED:
+         glEnableVertexAttribArray(2);
+         glVertexAttribPointer(0, 3, GL_SHORT, GL_FALSE, stride, 0);
+         glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride,
+                               reinterpret_cast<const void *>(offsetof(QuantizedVertex, r)));
+         glVertexAttribPointer(2, 1, GL_UNSIGNED_SHORT, GL_FALSE, stride,
+                               reinterpret_cast<const void *>(offsetof(QuantizedVertex, flags)));
+         break;
+   }
+}
@@ -0,0 +1,66 @@
+#ifndef _PACKEDVERTEX_H_
+#define _PACKEDVERTEX_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+/*
+ * Point cloud VBO vertex formats. Vertices are produced (and cached, see PointCloudCache and PointOctree) in the
+ * 8 float (x, y, z, w, r, g, b, a) layout where w is the selection flag (or the distance in MatchWin) and are
+ * converted to the GPU format when uploaded:
+ *   FLOAT32   - the 8 float layout as is (32 bytes, shaders in <shader_dir>/cloud)
+ *   PACKED    - 3 float position, RGB8 colour and an 8 bit flag (16 bytes, shaders in <shader_dir>/cloud/packed)
+ *   QUANTIZED - 3 int16 position quantized against the bounding box of the uploaded block, a 16 bit flag and RGBA8
+ *               colour (12 bytes, same shaders as PACKED). The shader dequantizes using the quantOffset and
+ *               quantScale uniforms of the block being drawn (see QuantizationBox).
+ * The alpha component is dropped by PACKED as point rendering does not blend.
+ */
+enum class VertexFormat { FLOAT32, PACKED, QUANTIZED };
+
+struct PackedVertex
+{
+   float x, y, z;
+   uint8_t r, g, b, flags;
+};
+static_assert(sizeof(PackedVertex) == 16, "PackedVertex must be 16 bytes");
+
+struct QuantizedVertex
+{
+   int16_t x, y, z;
+   uint16_t flags;
+   uint8_t r, g, b, a;
+};
+static_assert(sizeof(QuantizedVertex) == 12, "QuantizedVertex must be 12 bytes");
+
+// position = offset + (quantized + 32768) * scale
+struct QuantizationBox
+{
+   float offset[3] = { 0, 0, 0 }, scale[3] = { 1, 1, 1 };
+};
+
+size_t vertex_size(VertexFormat format);
+// Byte offset of the selection flag (distance) within a vertex
+size_t vertex_flags_offset(VertexFormat format);
+size_t vertex_flags_size(VertexFormat format);
+// Sub-directory (relative to the cloud shader directory) of the vertex shader for the format, which shares the cloud
+// fragment shader
+const char* vertex_shader_subdir(VertexFormat format);
+bool parse_vertex_format(const std::string& name, VertexFormat& format);
+
+// Bounding box of n 8 float vertices mapped onto the int16 range
+QuantizationBox quantization_box(const float* vertices, size_t n);
+
+/*
+ * Converts n 8 float vertices to format in out (which must hold n*vertex_size(format) bytes). box is required for
+ * QUANTIZED. When is_distance is true w is a distance (MatchWin) and only its being zero (selected) is preserved.
+ */
+void convert_vertices(VertexFormat format, const float* vertices, size_t n, uint8_t* out,
+                      const QuantizationBox* box =nullptr, bool is_distance =false);
+
+// Writes the flag value of a vertex (0, 1 or 2 in PointCloudWin) into a vertex in format.
+void set_vertex_flags(VertexFormat format, uint8_t* vertex, float flags);
+
+// Sets up attributes 0 (position), 1 (colour) and 2 (flags, not FLOAT32) for the VAO and ARRAY_BUFFER bound.
+void set_vertex_attributes(VertexFormat format);
+#endif //_PACKEDVERTEX_H_
@@ -0,0 +1,339 @@
+#include "PointCloudCache.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+
+static const char CACHE_MAGIC[8] = { 'P', 'N', 'P', 'C', 'A', 'C', 'H', 'E' };
+
+inline uint64_t align64(uint64_t offset) { return (offset + 63) & ~static_cast<uint64_t>(63); }
+
+bool PointCloudCache::ply_stat(const std::string& plyfile, uint64_t& size, int64_t& mtime_ns)
+//--------------------------------------------------------------------------------------------
+{
+   struct stat st;
+   if (stat(plyfile.c_str(), &st) != 0)
+      return false;
+   size = static_cast<uint64_t>(st.st_size);
+   mtime_ns = static_cast<int64_t>(st.st_mtim.tv_sec)*1000000000LL + static_cast<int64_t>(st.st_mtim.tv_nsec);
+   return true;
+}
+
+uint64_t PointCloudCache::points_stride(uint64_t count) { return align64(count*sizeof(float)); }
+
+bool PointCloudCache::open(const std::string& plyfile, float scale, bool yz_flip, bool mean_center,
+                           const VoxelGridOptions& voxels, bool is_morton, std::stringstream* errs)
+//--------------------------------------------------------------------------------------------------------
+{
+   close();
+   uint64_t ply_size;
+   int64_t ply_mtime;
+   if (! ply_stat(plyfile, ply_size, ply_mtime))
+      return false;
+   path = cache_path(plyfile);
+   fd = ::open(path.c_str(), O_RDONLY);
+   if (fd < 0)
+      return false;
+   struct stat st;
+   if ( (fstat(fd, &st) != 0) || (static_cast<size_t>(st.st_size) < sizeof(Header)) )
+   {
+      if (errs) *errs << "PointCloudCache: " << path << " truncated";
+      close();
+      return false;
+   }
+   data_size = static_cast<size_t>(st.st_size);
+   void* p = mmap(nullptr, data_size, PROT_READ, MAP_PRIVATE, fd, 0);
+   if (p == MAP_FAILED)
+   {
+      if (errs) *errs << "PointCloudCache: mmap of " << path << " failed: " << strerror(errno);
+      data = nullptr;
+      close();
+      return false;
+   }
+   data = static_cast<uint8_t*>(p);
+   const Header& h = header();
+   const uint32_t flags = (yz_flip ? YZ_FLIP : 0) | (mean_center ? MEAN_CENTER : 0) |
+                          ( (voxels.enabled()) && (voxels.is_centroid) ? VOXEL_CENTROID : 0 ) |
+                          (is_morton ? MORTON_ORDER : 0);
+   std::string reason;
+   if ( (memcmp(h.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0) || (h.version != VERSION) ||
+        ((h.flags & COMPLETE) == 0) )
+      reason = "invalid or different version";
+   else if ( (h.ply_size != ply_size) || (h.ply_mtime_ns != ply_mtime) )
+      reason = "out of date";
+   else if ( (h.scale != scale) || ((h.flags & (YZ_FLIP | MEAN_CENTER | VOXEL_CENTROID | MORTON_ORDER)) != flags) ||
+             (h.voxel_size != voxels.leaf_size) || (h.voxel_target != voxels.target_count) )
+      reason = "created with different options";
+   else if ( (h.vertices_offset + h.count*8*sizeof(float) > data_size) ||
+             (h.points_offset + 6*points_stride(h.count) > data_size) ||
+             (h.index_offset + h.index_size > data_size) || (h.count == 0) ||
+             ( (h.source_index_offset != 0) && (h.source_index_offset + h.count*sizeof(uint64_t) > data_size) ) ||
+             ( (h.source_index_offset == 0) && ( (voxels.enabled()) || (is_morton) ) ) ||
+             ( (h.knn_offset != 0) && (h.knn_offset + h.count*sizeof(float) > data_size) ) )
+      reason = "truncated";
+   if (! reason.empty())
+   {
+      if (errs) *errs << "PointCloudCache: " << path << " " << reason;
+      close();
+      return false;
+   }
+   madvise(data, data_size, MADV_WILLNEED);
+   return true;
+}
+
+FILE* PointCloudCache::index_stream() const
+//-----------------------------------------
+{
+   if (data == nullptr) return nullptr;
+   const Header& h = header();
+   return fmemopen(const_cast<uint8_t*>(data + h.index_offset), h.index_size, "rb");
+}
+
+void PointCloudCache::close()
+//---------------------------
+{
+   if (data != nullptr)
+      munmap(data, data_size);
+   data = nullptr;
+   data_size = 0;
+   if (fd >= 0)
+      ::close(fd);
+   fd = -1;
+}
+
+// Writes count bytes at offset, retrying short writes
+static bool pwrite_all(int fd, const void* buf, size_t count, off_t offset)
+//-------------------------------------------------------------------------
+{
+   const char* p = static_cast<const char*>(buf);
+   while (count > 0)
+   {
+      const ssize_t r = pwrite(fd, p, count, offset);
+      if (r < 0)
+      {
+         if (errno == EINTR) continue;
+         return false;
+      }
+      p += r;
+      count -= static_cast<size_t>(r);
+      offset += r;
+   }
+   return true;
+}
+
+bool PointCloudCache::write_knn_distances(size_t k, const float* distances, std::stringstream* errs)
+//--------------------------------------------------------------------------------------------------
+{
+   if (data == nullptr) return false;
+   const Header& h = header();
+   const uint64_t size = h.count*sizeof(float);
+   const int wfd = ::open(path.c_str(), O_WRONLY);
+   struct stat st;
+   if ( (wfd < 0) || (fstat(wfd, &st) != 0) )
+   {
+      if (errs) *errs << "PointCloudCache: Could not open " << path << " for writing: " << strerror(errno);
+      if (wfd >= 0) ::close(wfd);
+      return false;
+   }
+   // A block appended (after the index) for a previous k is overwritten, else the distances are appended. The stored
+   // distances are invalidated first so the header never refers to a partly written block.
+   const uint64_t index_end = h.index_offset + h.index_size;
+   const uint64_t offset = ( (h.knn_offset >= index_end) && (h.knn_offset + size <= static_cast<uint64_t>(st.st_size)) )
+                           ? h.knn_offset : align64(static_cast<uint64_t>(st.st_size));
+   const uint64_t knn[2] = { offset, k }; // knn_offset, knn_k
+   const uint64_t none = 0;
+   const off_t knn_field = static_cast<off_t>(offsetof(Header, knn_offset));
+   const bool ok = (pwrite_all(wfd, &none, sizeof(none), knn_field)) &&
+                   (pwrite_all(wfd, distances, size, static_cast<off_t>(offset))) &&
+                   (fdatasync(wfd) == 0) && (pwrite_all(wfd, knn, sizeof(knn), knn_field));
+   if ( (::close(wfd) != 0) || (! ok) )
+   {
+      if (errs) *errs << "PointCloudCache: Error writing kNN distances to " << path;
+      return false;
+   }
+   return true;
+}
+
+bool PointCloudCache::Writer::begin(const std::string& plyfile, size_t count, float scale, bool yz_flip,
+                                    bool mean_center, bool is_color, bool is_alpha, const VoxelGridOptions& voxels,
+                                    bool is_morton, std::stringstream* errs)
+//-------------------------------------------------------------------------------------------------------------
+{
+   abort();
+   header = Header{};
+   if (! ply_stat(plyfile, header.ply_size, header.ply_mtime_ns))
+      return false;
+   path = cache_path(plyfile);
+   tmp_path = path + ".tmp";
+   fp = fopen(tmp_path.c_str(), "wb");
+   if (fp == nullptr)
+   {
+      if (errs) *errs << "PointCloudCache: Could not create " << tmp_path << ": " << strerror(errno);
+      return false;
+   }
+   memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+   header.version = VERSION;
+   header.flags = (yz_flip ? YZ_FLIP : 0) | (mean_center ? MEAN_CENTER : 0) | (is_color ? COLOR : 0) |
+                  (is_alpha ? ALPHA : 0) | ( (voxels.enabled()) && (voxels.is_centroid) ? VOXEL_CENTROID : 0 ) |
+                  (is_morton ? MORTON_ORDER : 0);
+   header.scale = scale;
+   header.voxel_size = voxels.leaf_size;
+   header.voxel_target = voxels.target_count;
+   header.count = count;
+   header.vertices_offset = align64(sizeof(Header));
+   header.points_offset = align64(header.vertices_offset + count*8*sizeof(float));
+   vertices_written = 0;
+   is_points_written = false;
+   // Incomplete header (no COMPLETE flag) until end()
+   if ( (fwrite(&header, sizeof(Header), 1, fp) != 1) ||
+        (fseek(fp, static_cast<long>(header.vertices_offset), SEEK_SET) != 0) )
+   {
+      abort();
+      return false;
+   }
+   return true;
+}
+
+bool PointCloudCache::Writer::append_vertices(const float* vertices, size_t n)
+//----------------------------------------------------------------------------
+{
+   if (fp == nullptr) return false;
+   if ( (vertices_written + n > header.count) || (fwrite(vertices, sizeof(float)*8, n, fp) != n) )
+   {
+      abort();
+      return false;
+   }
+   vertices_written += n;
+   return true;
+}
+
+bool PointCloudCache::Writer::write_points(const float* x, const float* y, const float* z, const float* ply_x,
+                                           const float* ply_y, const float* ply_z)
+//---------------------------------------------------------------------------------------------------------
+{
+   if (fp == nullptr) return false;
+   const size_t n = static_cast<size_t>(header.count);
+   const uint64_t stride = points_stride(header.count);
+   const float* coords[6] = { x, y, z, ply_x, ply_y, ply_z };
+   if (vertices_written != n)
+   {
+      abort();
+      return false;
+   }
+   for (int d=0; d<6; d++)
+   {
+      if ( (fseek(fp, static_cast<long>(header.points_offset + d*stride), SEEK_SET) != 0) ||
+           (fwrite(coords[d], sizeof(float), n, fp) != n) )
+      {
+         abort();
+         return false;
+      }
+   }
+   is_points_written = true;
+   return true;
+}
+
+bool PointCloudCache::Writer::write_source_index(const uint64_t* index)
+//---------------------------------------------------------------------
+{
+   if ( (fp == nullptr) || (! is_points_written) ) return false;
+   const size_t n = static_cast<size_t>(header.count);
+   header.source_index_offset = align64(header.points_offset + 6*points_stride(header.count));
+   if ( (fseek(fp, static_cast<long>(header.source_index_offset), SEEK_SET) != 0) ||
+        (fwrite(index, sizeof(uint64_t), n, fp) != n) )
+   {
+      abort();
+      return false;
+   }
+   return true;
+}
+
+bool PointCloudCache::Writer::write_knn_distances(size_t k, const float* distances)
+//--------------------------------------------------------------------------------
+{
+   if ( (fp == nullptr) || (! is_points_written) ) return false;
+   const size_t n = static_cast<size_t>(header.count);
+   header.knn_offset = points_end();
+   header.knn_k = k;
+   if ( (fseek(fp, static_cast<long>(header.knn_offset), SEEK_SET) != 0) ||
+        (fwrite(distances, sizeof(float), n, fp) != n) )
+   {
+      abort();
+      return false;
+   }
+   return true;
+}
+
+// Offset following the last of the point coordinate, PLY index and kNN distance blocks written
+uint64_t PointCloudCache::Writer::points_end() const
+//---------------------------------------------------
+{
+   if (header.knn_offset != 0)
+      return align64(header.knn_offset + header.count*sizeof(float));
+   if (header.source_index_offset != 0)
+      return align64(header.source_index_offset + header.count*sizeof(uint64_t));
+   return align64(header.points_offset + 6*points_stride(header.count));
+}
+
+bool PointCloudCache::Writer::begin_index()
+//-----------------------------------------
+{
+   if ( (fp == nullptr) || (vertices_written != header.count) || (! is_points_written) )
+   {
+      abort();
+      return false;
+   }
+   header.index_offset = points_end();
+   if (fseek(fp, static_cast<long>(header.index_offset), SEEK_SET) != 0)
+   {
+      abort();
+      return false;
+   }
+   return true;
+}
+
+bool PointCloudCache::Writer::end_index(const float bounds[6], const float centroid[3])
+//------------------------------------------------------------------------------------
+{
+   const long end = ftell(fp);
+   if (end < 0)
+   {
+      abort();
+      return false;
+   }
+   header.index_size = static_cast<uint64_t>(end) - header.index_offset;
+   header.minx = bounds[0]; header.maxx = bounds[1];
+   header.miny = bounds[2]; header.maxy = bounds[3];
+   header.minz = bounds[4]; header.maxz = bounds[5];
+   memcpy(header.centroid, centroid, sizeof(header.centroid));
+   header.flags |= COMPLETE;
+   if ( (fseek(fp, 0, SEEK_SET) != 0) || (fwrite(&header, sizeof(Header), 1, fp) != 1) || (fclose(fp) != 0) )
+   {
+      fp = nullptr;
+      unlink(tmp_path.c_str());
+      return false;
+   }
+   fp = nullptr;
+   if (rename(tmp_path.c_str(), path.c_str()) != 0)
+   {
+      unlink(tmp_path.c_str());
+      return false;
+   }
+   return true;
+}
+
+void PointCloudCache::Writer::abort()
+//-----------------------------------
+{
+   if (fp != nullptr)
+   {
+      fclose(fp);
+      fp = nullptr;
+      unlink(tmp_path.c_str());
+   }
+}
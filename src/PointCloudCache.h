@@ -0,0 +1,165 @@
+#ifndef _POINTCLOUDCACHE_H_
+#define _POINTCLOUDCACHE_H_
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <sstream>
+
+#include "VoxelGrid.h"
+
+/*
+ * Binary sidecar cache (<plyfile>.pnpcache) for a point cloud. Holds the transformed vertices in the 8 float
+ * (x, y, z, w, r, g, b, a) layout uploaded to the point cloud VBO, the world space x, y and z point coordinate arrays
+ * used by the kd-tree adaptor, the untransformed (PLY) coordinates of the points, the bounds and centroid and a
+ * serialized nanoflann kd-tree (saveIndex). The cache is keyed on the size and modification time of the PLY file and
+ * on the load options which affect its contents (scale, Y/Z flip, mean or median centre, voxel grid downsampling,
+ * Morton order). Downsampled or reordered clouds also store the PLY index of each point, and the per point mean k
+ * nearest neighbour distances used for outlier removal are stored (with their k) when computed.
+ * When valid it is memory mapped so the vertex block can be uploaded directly and the index loaded (loadIndex)
+ * without re-parsing the PLY.
+ *
+ * Layout: PointCloudCache::Header | vertices (count*8 floats) |
+ *         world x, y, z then PLY x, y, z (count floats each, 64 byte aligned) |
+ *         [PLY indices (count uint64, downsampled or reordered clouds only)] | [kNN distances (count floats)] |
+ *         kd-tree index | [kNN distances computed after the cache was written, see write_knn_distances]
+ */
+class PointCloudCache
+//===================
+{
+public:
+   static constexpr uint32_t VERSION = 6;
+
+   enum Flags : uint32_t { COLOR = 1, ALPHA = 2, MEAN_CENTER = 4, YZ_FLIP = 8, COMPLETE = 16, VOXEL_CENTROID = 32,
+                        MORTON_ORDER = 64 };
+
+   struct Header
+   {
+      char magic[8];
+      uint32_t version, flags;
+      uint64_t ply_size;
+      int64_t ply_mtime_ns;
+      float scale;
+      uint64_t count;
+      float minx, maxx, miny, maxy, minz, maxz;
+      float centroid[3];
+      float voxel_size;           // VoxelGridOptions used to downsample (0 and 0 if not downsampled)
+      uint64_t voxel_target;
+      uint64_t vertices_offset, points_offset, index_offset, index_size;
+      uint64_t source_index_offset; // 0 unless downsampled or reordered
+      uint64_t knn_offset;          // 0 unless kNN distances were stored
+      uint64_t knn_k;
+   };
+
+   PointCloudCache() = default;
+   PointCloudCache(const PointCloudCache&) = delete;
+   PointCloudCache& operator=(const PointCloudCache&) = delete;
+   ~PointCloudCache() { close(); }
+
+   static std::string cache_path(const std::string& plyfile) { return plyfile + ".pnpcache"; }
+   static bool ply_stat(const std::string& plyfile, uint64_t& size, int64_t& mtime_ns);
+   // Size in bytes of each of the x, y and z coordinate arrays
+   static uint64_t points_stride(uint64_t count);
+
+   // Maps the cache for plyfile if it exists and matches the PLY file and load options.
+   bool open(const std::string& plyfile, float scale, bool yz_flip, bool mean_center, const VoxelGridOptions& voxels,
+             bool is_morton, std::stringstream* errs =nullptr);
+   void close();
+   bool good() const { return (data != nullptr); }
+
+   const Header& header() const { return *reinterpret_cast<const Header*>(data); }
+   size_t count() const { return (data == nullptr) ? 0 : static_cast<size_t>(header().count); }
+   const float* vertices() const { return reinterpret_cast<const float*>(data + header().vertices_offset); }
+   // World space coordinate array for dimension dim (0 x, 1 y, 2 z)
+   const float* points(int dim) const
+   {
+      return reinterpret_cast<const float*>(data + header().points_offset + dim*points_stride(header().count));
+   }
+
+   // Untransformed (as in the PLY file, or the voxel centroid) coordinate array for dimension dim
+   const float* ply_points(int dim) const
+   {
+      return reinterpret_cast<const float*>(data + header().points_offset + (3 + dim)*points_stride(header().count));
+   }
+
+   // PLY index of each point of a downsampled or reordered cloud, else null
+   const uint64_t* source_index() const
+   {
+      return (header().source_index_offset == 0) ? nullptr
+                                                 : reinterpret_cast<const uint64_t*>(data + header().source_index_offset);
+   }
+
+   // Mean distance of each point to its k nearest neighbours if stored for this k (and mapped), else null
+   const float* knn_distances(size_t k) const
+   {
+      return ( (header().knn_offset == 0) || (header().knn_k != k) ||
+               (header().knn_offset + header().count*sizeof(float) > data_size) )
+             ? nullptr : reinterpret_cast<const float*>(data + header().knn_offset);
+   }
+
+   /*
+    * Stores the kNN distances computed for a cache opened without them for this k, appending them to the cache file
+    * and updating its header in place. Only the file is changed, the distances are found by the next open.
+    */
+   bool write_knn_distances(size_t k, const float* distances, std::stringstream* errs =nullptr);
+
+   // Read only FILE stream over the serialized index for nanoflann loadIndex. Caller must fclose.
+   FILE* index_stream() const;
+
+   /*
+    * Writes a cache incrementally while the PLY is being loaded: begin(), then the vertices in order
+    * (append_vertices), then the world space and PLY point coordinates (write_points), the PLY indices if
+    * downsampled or reordered (write_source_index), the kNN distances if computed (write_knn_distances) and finally
+    * end() with the extents and the built index. The cache is written to a temporary file which is renamed on success.
+    */
+   class Writer
+   //==========
+   {
+   public:
+      ~Writer() { abort(); }
+
+      bool begin(const std::string& plyfile, size_t count, float scale, bool yz_flip, bool mean_center,
+                 bool is_color, bool is_alpha, const VoxelGridOptions& voxels, bool is_morton,
+                 std::stringstream* errs =nullptr);
+      bool append_vertices(const float* vertices, size_t n);
+      bool write_points(const float* x, const float* y, const float* z, const float* ply_x, const float* ply_y,
+                        const float* ply_z);
+      bool write_source_index(const uint64_t* index);
+      bool write_knn_distances(size_t k, const float* distances);
+      template <typename Index>
+      bool end(const float bounds[6], const float centroid[3], Index& index)
+      {
+         if (! begin_index()) return false;
+         try
+         {
+            index.saveIndex(fp);
+         }
+         catch (const std::exception& e)
+         {
+            abort();
+            return false;
+         }
+         return end_index(bounds, centroid);
+      }
+      void abort();
+      bool good() const { return (fp != nullptr); }
+
+   private:
+      FILE* fp = nullptr;
+      std::string path, tmp_path;
+      Header header{};
+      size_t vertices_written = 0;
+      bool is_points_written = false;
+
+      uint64_t points_end() const;
+      bool begin_index();
+      bool end_index(const float bounds[6], const float centroid[3]);
+   };
+
+private:
+   std::string path;
+   int fd = -1;
+   uint8_t* data = nullptr;
+   size_t data_size = 0;
+};
+#endif //_POINTCLOUDCACHE_H_
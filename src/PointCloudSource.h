@@ -0,0 +1,114 @@
+#ifndef _POINTCLOUDSOURCE_H_
+#define _POINTCLOUDSOURCE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "nanoflann.hpp"
+#include "types.h"
+
+/*
+ * kd-tree adaptor holding the points in world space (scaled and Y/Z flipped as displayed) as separate x, y and z
+ * arrays so nanoflann and the picking code read the coordinates directly. The arrays are either owned (resize/set)
+ * or mapped from the point cloud cache (map). Points appended after the kd-tree is built (see PointIndex) are always
+ * owned, a mapped source being copied to owned arrays on the first append.
+ */
+template <typename T>
+struct PointCloudFlannSource
+//==========================
+{
+   PointCloudFlannSource(float scale_ =1.0, bool yz_flip_ =false) : scale(scale_), flip((yz_flip_) ? -1 : 1) {}
+
+   float scale, flip;
+   std::vector<T> xs, ys, zs;
+   std::vector<uint32_t> colors; // RGBA8 (red in the low byte) when set_color is used, else empty
+   const T* coords[3] = { nullptr, nullptr, nullptr };
+   size_t count = 0;
+   // When set coords point into a memory mapped block (the point cloud cache). mapping keeps the file alive.
+   std::shared_ptr<const void> mapping;
+
+   void clear()
+   {
+      xs.clear(); ys.clear(); zs.clear(); colors.clear(); mapping.reset();
+      coords[0] = coords[1] = coords[2] = nullptr;
+      count = 0;
+   }
+
+   // Allocates owned storage for n points which must then be written with set (before the kd-tree is built).
+   void resize(size_t n, bool is_color =false)
+   {
+      clear();
+      xs.resize(n); ys.resize(n); zs.resize(n);
+      if (is_color)
+         colors.resize(n);
+      coords[0] = xs.data(); coords[1] = ys.data(); coords[2] = zs.data();
+      count = n;
+   }
+
+   // Sets point i from untransformed (as in the PLY file) coordinates
+   inline void set(size_t i, T x, T y, T z) { xs[i] = x*scale; ys[i] = y*scale*flip; zs[i] = z*scale*flip; }
+
+   inline void set_color(size_t i, uint8_t r, uint8_t g, uint8_t b, uint8_t a =255)
+   {
+      colors[i] = static_cast<uint32_t>(r) | (static_cast<uint32_t>(g) << 8) | (static_cast<uint32_t>(b) << 16) |
+                  (static_cast<uint32_t>(a) << 24);
+   }
+
+   // Uses n world space points in place from x, y and z, owner keeping them valid.
+   void map(std::shared_ptr<const void> owner, const T* x, const T* y, const T* z, size_t n)
+   {
+      clear();
+      mapping = std::move(owner);
+      coords[0] = x; coords[1] = y; coords[2] = z;
+      count = n;
+   }
+
+   bool is_mapped() const { return (mapping != nullptr); }
+
+   // Appends a point given in untransformed (as in the PLY file) coordinates, returning its index. Invalidates
+   // pointers previously obtained from coords.
+   size_t append(T x, T y, T z)
+   {
+      if (is_mapped())
+         make_owned();
+      xs.push_back(x*scale); ys.push_back(y*scale*flip); zs.push_back(z*scale*flip);
+      if (! colors.empty())
+         colors.push_back(0xFFFFFFFFu);
+      coords[0] = xs.data(); coords[1] = ys.data(); coords[2] = zs.data();
+      return count++;
+   }
+
+   // Copies mapped coordinates to owned storage and releases the mapping.
+   void make_owned()
+   {
+      if (! is_mapped()) return;
+      xs.assign(coords[0], coords[0] + count);
+      ys.assign(coords[1], coords[1] + count);
+      zs.assign(coords[2], coords[2] + count);
+      coords[0] = xs.data(); coords[1] = ys.data(); coords[2] = zs.data();
+      mapping.reset();
+   }
+
+   // Untransformed (as in the PLY file) coordinates, recomputed from the world space ones so not always bit exact
+   Real3<T> point(size_t i) const
+   {
+      return Real3<T>(coords[0][i] / scale, coords[1][i] / (scale * flip), coords[2][i] / (scale * flip));
+   }
+
+   Real3<T> get(size_t i) const { return Real3<T>(coords[0][i], coords[1][i], coords[2][i]); }
+
+   bool is_selected = false;
+
+   inline size_t kdtree_get_point_count() const { return count; }
+
+   inline T kdtree_get_pt(const size_t i, int dim) const { return coords[dim][i]; }
+
+   template <class BBOX>
+   bool kdtree_get_bbox(BBOX& /* bb */) const { return false; }
+};
+
+typedef nanoflann::KDTreeSingleIndexAdaptor<nanoflann::L2_Simple_Adaptor<float, PointCloudFlannSource<float>>,
+                                            PointCloudFlannSource<float>, 3> kd_tree_t;
+#endif //_POINTCLOUDSOURCE_H_
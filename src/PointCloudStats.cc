@@ -0,0 +1,200 @@
+#include "PointCloudStats.h"
+
+#include <cstring>
+#include <algorithm>
+#include <thread>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define STATS_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+   // Slices below this many points are not worth a thread
+   constexpr size_t MIN_THREAD_SLICE = 65536;
+
+   // Monotonic map from (non NaN) floats to unsigned integers
+   inline uint32_t float_key(float f)
+   {
+      uint32_t u;
+      memcpy(&u, &f, sizeof(u));
+      return (u & 0x80000000u) ? ~u : (u | 0x80000000u);
+   }
+
+   inline float key_float(uint32_t key)
+   {
+      const uint32_t u = (key & 0x80000000u) ? (key & 0x7FFFFFFFu) : ~key;
+      float f;
+      memcpy(&f, &u, sizeof(f));
+      return f;
+   }
+
+   struct Reduction
+   {
+      float lo = std::numeric_limits<float>::max(), hi = std::numeric_limits<float>::lowest();
+      double sum = 0;
+   };
+
+   Reduction reduce(const float* v, size_t n)
+   //----------------------------------------
+   {
+      Reduction r;
+      size_t i = 0;
+#ifdef STATS_SSE2
+      if (n >= 4)
+      {
+         __m128 lo = _mm_loadu_ps(v), hi = lo;
+         __m128d sum_lo = _mm_setzero_pd(), sum_hi = _mm_setzero_pd();
+         for (; i + 4 <= n; i += 4)
+         {
+            const __m128 x = _mm_loadu_ps(v + i);
+            lo = _mm_min_ps(lo, x);
+            hi = _mm_max_ps(hi, x);
+            sum_lo = _mm_add_pd(sum_lo, _mm_cvtps_pd(x));
+            sum_hi = _mm_add_pd(sum_hi, _mm_cvtps_pd(_mm_movehl_ps(x, x)));
+         }
+         float los[4], his[4];
+         double sums[2];
+         _mm_storeu_ps(los, lo);
+         _mm_storeu_ps(his, hi);
+         _mm_storeu_pd(sums, _mm_add_pd(sum_lo, sum_hi));
+         r.lo = std::min(std::min(los[0], los[1]), std::min(los[2], los[3]));
+         r.hi = std::max(std::max(his[0], his[1]), std::max(his[2], his[3]));
+         r.sum = sums[0] + sums[1];
+      }
+#endif
+      for (; i<n; i++)
+      {
+         if (v[i] < r.lo) r.lo = v[i];
+         if (v[i] > r.hi) r.hi = v[i];
+         r.sum += v[i];
+      }
+      return r;
+   }
+
+   // Calls fn(t, begin, end) for up to threads contiguous slices of [0, n) concurrently
+   template <typename F>
+   void parallel_slices(size_t n, unsigned threads, F fn)
+   //----------------------------------------------------
+   {
+      const size_t slices = std::max<size_t>(1, std::min<size_t>(threads, n / MIN_THREAD_SLICE));
+      const size_t slice = (n + slices - 1) / slices;
+      std::vector<std::thread> workers;
+      for (size_t t=1; t<slices; t++)
+         workers.emplace_back(fn, t, std::min(n, t*slice), std::min(n, (t + 1)*slice));
+      fn(0, 0, std::min(n, slice));
+      for (std::thread& worker : workers)
+         worker.join();
+   }
+}
+
+PointCloudStats::PointCloudStats(unsigned threads_, bool is_median_) : threads(std::max(threads_, 1u)),
+                                                                      is_median(is_median_)
+//-----------------------------------------------------------------------------------------------------
+{
+}
+
+void PointCloudStats::add(const float* const coords[3], size_t start, size_t count)
+//---------------------------------------------------------------------------------
+{
+   if (count == 0) return;
+   const size_t slices = std::max<size_t>(1, std::min<size_t>(threads, count / MIN_THREAD_SLICE));
+   std::vector<Reduction> reductions(slices*3);
+   if ( (is_median) && (thread_histograms.size() < slices) )
+      thread_histograms.resize(slices, std::vector<uint32_t>(3*BINS, 0));
+   parallel_slices(count, threads, [&](size_t t, size_t begin, size_t end)
+   {
+      for (int d=0; d<3; d++)
+      {
+         const float* v = coords[d] + start + begin;
+         reductions[t*3 + d] = reduce(v, end - begin);
+         if (is_median)
+         {
+            uint32_t* bins = thread_histograms[t].data() + d*BINS;
+            for (size_t i=0; i<end - begin; i++)
+               bins[float_key(v[i]) >> 16]++;
+         }
+      }
+   });
+   for (size_t t=0; t<slices; t++)
+   {
+      for (int d=0; d<3; d++)
+      {
+         const Reduction& r = reductions[t*3 + d];
+         lo[d] = std::min(lo[d], r.lo);
+         hi[d] = std::max(hi[d], r.hi);
+         sum[d] += r.sum;
+      }
+   }
+   n += count;
+}
+
+glm::vec3 PointCloudStats::mean() const
+//-------------------------------------
+{
+   if (n == 0) return glm::vec3(0, 0, 0);
+   const double total = static_cast<double>(n);
+   return glm::vec3(static_cast<float>(sum[0] / total), static_cast<float>(sum[1] / total),
+                    static_cast<float>(sum[2] / total));
+}
+
+glm::vec3 PointCloudStats::median(const float* const coords[3]) const
+//-------------------------------------------------------------------
+{
+   if ( (! is_median) || (n == 0) ) return mean();
+   const size_t rank = n / 2;
+   uint32_t high[3];
+   size_t remaining[3];
+   std::vector<uint64_t> histogram(3*BINS, 0);
+   for (const std::vector<uint32_t>& bins : thread_histograms)
+   {
+      for (size_t b=0; b<3*BINS; b++)
+         histogram[b] += bins[b];
+   }
+   for (int d=0; d<3; d++)
+   {
+      const uint64_t* bins = histogram.data() + d*BINS;
+      size_t below = 0;
+      uint32_t b = 0;
+      while (below + bins[b] <= rank)
+         below += bins[b++];
+      high[d] = b;
+      remaining[d] = rank - below;
+   }
+
+   // Histogram the low 16 bits of the keys falling in the bin holding the median
+   const size_t slices = std::max<size_t>(1, std::min<size_t>(threads, n / MIN_THREAD_SLICE));
+   std::vector<std::vector<uint32_t>> low_histograms(slices, std::vector<uint32_t>(3*BINS, 0));
+   parallel_slices(n, threads, [&](size_t t, size_t begin, size_t end)
+   {
+      for (int d=0; d<3; d++)
+      {
+         const float* v = coords[d];
+         const uint32_t h = high[d];
+         uint32_t* bins = low_histograms[t].data() + d*BINS;
+         for (size_t i=begin; i<end; i++)
+         {
+            const uint32_t key = float_key(v[i]);
+            if ((key >> 16) == h)
+               bins[key & 0xFFFFu]++;
+         }
+      }
+   });
+   float m[3];
+   for (int d=0; d<3; d++)
+   {
+      size_t below = 0;
+      uint32_t b = 0;
+      for (; b<BINS; b++)
+      {
+         size_t c = 0;
+         for (size_t t=0; t<slices; t++)
+            c += low_histograms[t][d*BINS + b];
+         if (below + c > remaining[d]) break;
+         below += c;
+      }
+      m[d] = key_float((high[d] << 16) | b);
+   }
+   return glm::vec3(m[0], m[1], m[2]);
+}
@@ -0,0 +1,49 @@
+#ifndef _POINTCLOUDSTATS_H_
+#define _POINTCLOUDSTATS_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "glm/glm.hpp"
+
+/*
+ * Streaming statistics over world space points held as separate x, y and z arrays (see PointCloudFlannSource).
+ * Chunks are accumulated with add as they are loaded, each split across threads with SIMD (SSE2) min, max and sum
+ * reductions. When is_median is set add also counts (per thread, merged by median) the high 16 bits of the order
+ * preserving integer key of each coordinate in 64K bin histograms, so median needs a single further pass over the
+ * points (refining the bin holding the middle rank on the low 16 bits) instead of copying and partially sorting them.
+ * The median is exact, being the element std::nth_element would place at n/2.
+ */
+class PointCloudStats
+//===================
+{
+public:
+   explicit PointCloudStats(unsigned threads =1, bool is_median =false);
+
+   // Accumulates points [start, start + n) of coords (x, y and z arrays)
+   void add(const float* const coords[3], size_t start, size_t n);
+
+   size_t count() const { return n; }
+   float min(int dim) const { return lo[dim]; }
+   float max(int dim) const { return hi[dim]; }
+   glm::vec3 mean() const;
+
+   // Median of the count() points (the same arrays passed to add) per coordinate. Requires is_median.
+   glm::vec3 median(const float* const coords[3]) const;
+
+private:
+   static constexpr size_t BINS = 65536;
+
+   unsigned threads;
+   bool is_median;
+   size_t n = 0;
+   float lo[3] = { std::numeric_limits<float>::max(), std::numeric_limits<float>::max(),
+                   std::numeric_limits<float>::max() };
+   float hi[3] = { std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest(),
+                   std::numeric_limits<float>::lowest() };
+   double sum[3] = { 0, 0, 0 };
+   std::vector<std::vector<uint32_t>> thread_histograms; // 3 x BINS counts of the high 16 key bits per thread slice
+};
+#endif //_POINTCLOUDSTATS_H_
@@ -148,6 +148,17 @@ void PointCloudWin::on_initialize(const GLFWwindow *win)
       is_good = false;
       return;
    }
+   if (vertex_format != VertexFormat::FLOAT32) // only the vertex shader differs
+   {
+      std::string unused;
+      dir /= filesystem::path(vertex_shader_subdir(vertex_format));
+      if ( (! oglutil::load_shaders(dir.string(), vertex_glsl, unused)) || (vertex_glsl.empty()) )
+      {
+         std::cerr << "Error loading point cloud vertex shader from " << dir.string() << std::endl;
+         is_good = false;
+         return;
+      }
+   }
    pointcloud_unit.program = oglutil::compile_link_shader(replace_ver(vertex_glsl.c_str(), glsl_ver),
                                                           replace_ver(fragment_glsl.c_str(), glsl_ver),
                                                           pointcloud_unit.vertex_shader,
@@ -173,13 +184,7 @@ void PointCloudWin::on_initialize(const GLFWwindow *win)
       std::cerr << errs.str().c_str() << std::endl;
       exit(1);
    }
-   initialised_pc = init_pointcloud();
-   if (! initialised_pc)
-   {
-      std::cerr << "Error initializing point cloud buffers from " << plyfile.string() << std::endl;
-      is_good = false;
-      return;
-   }
+   start_loading();
    if (is_axes)
       initialised_axes = init_axes();
    else
@@ -230,49 +235,21 @@ bool PointCloudWin::on_render()
       glBindBuffer(GL_ARRAY_BUFFER, 0);
       glUseProgram(0);
    }
-   if (initialised_pc)
+   if (! is_load_complete)
+   {
+      upload_loaded_chunks();
+      if (! is_load_complete)
+         invalidate(); // keep drawing while chunks arrive
+   }
+   if (is_octree_ready.load())
+      render_octree();
+   else if (initialised_pc)
    {
+      if (! pending_removed.empty())
+         write_removed_flags();
       if (is_selection_change)
       {
-         glBindBuffer(GL_ARRAY_BUFFER, pointcloud_unit.GLuint_get("VBO_VERTICES"));
-         GLfloat sel;
-         GLfloat* vertices = static_cast<GLfloat *>(glMapBuffer(GL_ARRAY_BUFFER, GL_WRITE_ONLY));
-         if (! oglutil::isGLOk(err, &errs))
-            std::cout << err << ": " << errs.str() << std::endl;
-         if (match_window != nullptr)
-            match_window->clear_points(points.flip);
-         for (size_t j =0; j<points.pts.size(); j++)
-         {
-            auto it = selected.find(j);
-            if (it == selected.end())
-               sel = 0;
-            else
-            {
-               if (match_window != nullptr)
-               {
-                  Real3<float> pt = points.pts[j];
-                  match_window->add_point(pt, it->second);
-               }
-               if (it->second == 0)
-                  sel = 2;
-               else
-                  sel = 1;
-            }
-            if (vertices == nullptr)
-               glBufferSubData(GL_ARRAY_BUFFER, j * sizeof(GLfloat) * 8 + sizeof(GLfloat) * 3, sizeof(GLfloat),
-                               &sel);
-            else
-               vertices[j * 8 + 3] = sel;
-         }
-         if (!oglutil::isGLOk(err, &errs)) std::cerr << err << ": " << errs.str().c_str() << std::endl;
-         is_selection_change = false;
-         if (vertices != nullptr)
-            glUnmapBuffer(GL_ARRAY_BUFFER);
-         if (!oglutil::isGLOk(err, &errs)) std::cerr << err << ": " << errs.str().c_str() << std::endl;
-         glBindBuffer(GL_ARRAY_BUFFER, 0);
-         if (!oglutil::isGLOk(err, &errs)) std::cerr << err << ": " << errs.str().c_str() << std::endl;
-         if (match_window != nullptr)
-            match_window->update_points(this);
+         update_selection();
          if (!oglutil::isGLOk(err, &errs)) std::cerr << err << ": " << errs.str().c_str() << std::endl;
       }
       pointcloud_unit.activate();
@@ -284,7 +261,20 @@ bool PointCloudWin::on_render()
       glBindVertexArray(pointcloud_unit.GLuint_get("VAO_VERTICES"));
       //glPointSize(3);
       glEnable(GL_PROGRAM_POINT_SIZE);
-      glDrawArrays(GL_POINTS, 0, count);
+      if (vertex_format == VertexFormat::QUANTIZED)
+      {
+         // Each uploaded chunk is quantized against its own bounding box
+         for (const QuantizedBlock& block : quantized_blocks)
+         {
+            set_quantization(&block.box);
+            glDrawArrays(GL_POINTS, static_cast<GLint>(block.start), static_cast<GLsizei>(block.count));
+         }
+      }
+      else
+      {
+         set_quantization(nullptr);
+         glDrawArrays(GL_POINTS, 0, static_cast<GLsizei>(uploaded_count));
+      }
       glBindVertexArray(0);
 #ifdef PCW_DEBUG_SHADER
       const glm::vec3 close_color = glm::vec3(1, 0, 0);
@@ -360,16 +350,25 @@ inline void _push_vertex(GLfloat*& vertices, GLfloat x, GLfloat y, GLfloat z, GL
    *vertices++ = r; *vertices++ = g; *vertices++ = b; *vertices++ = a;
 }
 
-std::unique_ptr<GLfloat[]> PointCloudWin::load_pointcloud()
-//---------------------------------------------------------
+// Runs on the loader thread (see start_loading). The PLY file is parsed (or memory mapped) and the vertices are then
+// published to the render thread in chunks of LOAD_CHUNK_SIZE points as they are produced, together with the running
+// extents so the view can be set up before the whole cloud is available. The centroid and kd-tree index are computed
+// last, and picking is only enabled (is_index_ready) once the index has been built (octree rendered clouds don't keep
+// the index, see open_octree).
+bool PointCloudWin::load_pointcloud()
+//-----------------------------------
 {
-   if (plyfile.empty()) return nullptr;
+   if (plyfile.empty()) return false;
+   source_indices = nullptr;
+   if ( (use_cache) && (load_cached_pointcloud()) )
+      return true;
+   if (map_pointcloud())
+      return true;
    std::ifstream ifs(plyfile.c_str(), std::ios::binary);
    if (ifs.fail())
    {
       std::cerr << "Could not open pointcloud file " << plyfile.filename() << std::endl;;
-      initialised_pc = false;
-      return nullptr;
+      return false;
    }
    tinyply::PlyFile file;
    std::shared_ptr<tinyply::PlyData> verts, colors;
@@ -378,8 +377,7 @@ std::unique_ptr<GLfloat[]> PointCloudWin::load_pointcloud()
       if (! file.parse_header(ifs))
       {
          std::cerr << "Could not parse pointcloud file header for " << plyfile.filename() << std::endl;
-         initialised_pc = false;
-         return nullptr;
+         return false;
       }
       for (auto e : file.get_elements())
       {
@@ -413,32 +411,23 @@ std::unique_ptr<GLfloat[]> PointCloudWin::load_pointcloud()
    catch (const std::exception & e)
    {
       std::cerr << "Exception: " << e.what() << " reading ply file " << plyfile.filename() << std::endl;
-      initialised_pc = false;
-      return nullptr;
+      return false;
    }
    if ( (! verts) || (verts->count == 0) )
    {
       std::stringstream ss;
       ss << "No vertices in file " << plyfile.filename();
       std::cerr << ss.str().c_str() << std::endl;
-      initialised_pc = false;
-      return nullptr;
+      return false;
    }
    if ( (! colors) || (colors->count == 0) )
       is_color_pointcloud = is_alpha_pointcloud = false;
 
-//   size_t bytes = verts->buffer.size_bytes();
-#ifdef BOUNDS_VERTICES
-   count = verts->count + 8;
-#else
-   count = verts->count;
-#endif
    struct RGB { u_char r,g,b; };
    struct RGBA { u_char r,g,b,a; };
-   std::vector<GLfloat> Xs, Ys, Zs;
-   Real3<float>* vertdata = reinterpret_cast<Real3<float> *>(verts->buffer.get());
-   RGB* RGBdata = nullptr;
-   RGBA* RGBAdata = nullptr;
+   const Real3<float>* vertdata = reinterpret_cast<Real3<float> *>(verts->buffer.get());
+   const RGB* RGBdata = nullptr;
+   const RGBA* RGBAdata = nullptr;
    if (is_color_pointcloud)
    {
       if (is_alpha_pointcloud)
@@ -446,129 +435,907 @@ std::unique_ptr<GLfloat[]> PointCloudWin::load_pointcloud()
       else
          RGBdata = reinterpret_cast<RGB *>(colors->buffer.get());
    }
-
-   const size_t buffer_size = count*8;
-   std::unique_ptr<GLfloat[]> vertices(new GLfloat[buffer_size]);
-   GLfloat *vertices_ptr = vertices.get();
-#ifndef NDEBUG
-   GLfloat *vertices_ptr_end = &vertices_ptr[buffer_size];
-#endif
-   const GLfloat flip = (yz_flip) ? -1 : 1;
-   double totalx = 0, totaly = 0, totalz = 0;
-   double n = 0;
-#ifdef PCW_DEBUG_SHADER
-   _vertices_.clear();
-#endif
-   if (! mean_center)
+   const size_t color_count = (is_color_pointcloud) ? colors->count : 0;
+   size_t point_count = verts->count;
+   const bool is_centroids = ( (voxel_options.enabled()) && (voxel_options.is_centroid) );
+   if (voxel_options.enabled())
    {
-      Xs.resize(verts->count);
-      Ys.resize(verts->count);
-      Zs.resize(verts->count);
+      point_count = downsample(verts->count, [vertdata](size_t i) { return vertdata[i]; },
+                               [RGBdata, RGBAdata](size_t i) -> uint32_t
+                               {
+                                  if (RGBAdata != nullptr)
+                                     return RGBAdata[i].r | (RGBAdata[i].g << 8) | (RGBAdata[i].b << 16) |
+                                            (static_cast<uint32_t>(RGBAdata[i].a) << 24);
+                                  return RGBdata[i].r | (RGBdata[i].g << 8) | (RGBdata[i].b << 16) | 0xFF000000u;
+                               }, (color_count == verts->count));
    }
-   GLfloat x, y, z, red =1.0f, green =0, blue =0, alpha =1.0f;
-   for (size_t i=0; i<count; i++)
+   if (is_morton)
+      reorder(point_count, [vertdata](size_t i) { return vertdata[i]; });
+   points.resize(point_count, is_color_pointcloud);
+   ply_points.resize(point_count);
+   return load_chunks(point_count, [&](size_t start, size_t n, GLfloat* vertices)
    {
-      const Real3<float> item = vertdata[i];
-      x = item.x * scale;
-      y = item.y * scale * flip;
-      z = item.z * scale * flip;
-      if ( (is_color_pointcloud) && (i < colors->count) )
+      u_char r = 255, g = 0, b = 0, a = 255;
+      for (size_t i=start; i<start + n; i++)
       {
-         if (is_color_pointcloud)
+         const size_t j = ply_index(i);
+         const Real3<float> item = (is_centroids) ? voxels.points[i] : vertdata[j];
+         if ( (is_centroids) && (! voxels.colors.empty()) )
+         {
+            const uint32_t c = voxels.colors[i];
+            r = c & 0xFF; g = (c >> 8) & 0xFF; b = (c >> 16) & 0xFF; a = c >> 24;
+            points.set_color(i, r, g, b, a);
+         }
+         else if (j < color_count)
          {
             if (is_alpha_pointcloud)
             {
-               red = static_cast<float>(RGBAdata[i].r) / 255.0f;
-               green = static_cast<float>(RGBAdata[i].g) / 255.0f;
-               blue = static_cast<float>(RGBAdata[i].b) / 255.0f;
-               alpha = static_cast<float>(RGBAdata[i].a) / 255.0f;
+               r = RGBAdata[j].r; g = RGBAdata[j].g; b = RGBAdata[j].b; a = RGBAdata[j].a;
             }
             else
             {
-               red = static_cast<float>(RGBdata[i].r) / 255.0f;
-               green = static_cast<float>(RGBdata[i].g) / 255.0f;
-               blue = static_cast<float>(RGBdata[i].b) / 255.0f;
-               alpha = 1.0f;
+               r = RGBdata[j].r; g = RGBdata[j].g; b = RGBdata[j].b; a = 255;
             }
+            points.set_color(i, r, g, b, a);
+         }
+         else
+         {
+            r = a = 255;
+            g = b = 0;
+         }
+         points.set(i, item.x, item.y, item.z);
+         ply_points.set(i, item.x, item.y, item.z);
+         const Real3<float> p = points.get(i);
+         _push_vertex(vertices, p.x, p.y, p.z, 0, r / 255.0f, g / 255.0f, b / 255.0f, a / 255.0f);
+      }
+   });
+}
+
+// Voxel grid downsamples the n PLY points (see VoxelGrid.h) into voxels, pointing source_indices at the PLY indices
+// of the points kept, and returns the number kept.
+template<typename Point, typename Color>
+size_t PointCloudWin::downsample(size_t n, Point point, Color color, bool is_color)
+//---------------------------------------------------------------------------------
+{
+   voxels = voxel_grid(n, point, color, is_color, voxel_options, index_threads);
+   source_indices = voxels.index.data();
+   std::cout << "Voxel grid downsampling (leaf size " << voxels.leaf_size << ") kept " << voxels.index.size()
+             << " of " << n << " points" << std::endl;
+   return voxels.index.size();
+}
+
+// Sorts the n points to be loaded (the PLY points, point(i) returning PLY point i, or those kept by downsample) into
+// Morton order (see MortonOrder.h). The order is composed with any downsampling into load_order so ply_index still
+// maps loaded points to PLY points, and centroids are permuted in place.
+template<typename Point>
+void PointCloudWin::reorder(size_t n, Point point)
+//------------------------------------------------
+{
+   const bool is_centroids = ( (voxel_options.enabled()) && (voxel_options.is_centroid) );
+   std::vector<uint64_t> order;
+   if (is_centroids)
+      order = morton_order(n, [this](size_t i) { return voxels.points[i]; }, index_threads);
+   else
+      order = morton_order(n, [this, &point](size_t i) { return point(ply_index(i)); }, index_threads);
+   load_order.resize(n);
+   for (size_t k=0; k<n; k++)
+      load_order[k] = ply_index(order[k]);
+   if (is_centroids)
+   {
+      std::vector<Real3<float>> centroids;
+      centroids.reserve(n);
+      for (size_t k=0; k<n; k++)
+         centroids.push_back(voxels.points[order[k]]);
+      voxels.points.swap(centroids);
+      if (! voxels.colors.empty())
+      {
+         std::vector<uint32_t> colors(n);
+         for (size_t k=0; k<n; k++)
+            colors[k] = voxels.colors[order[k]];
+         voxels.colors.swap(colors);
+      }
+   }
+   std::vector<uint64_t>().swap(voxels.index);
+   source_indices = load_order.data();
+}
+
+// Publishes the vertices [0, n) in chunks. fill(start, count, vertices) must set the points in the kd-tree source and
+// write their 8 float VBO records to vertices. When the PLY is memory mapped vertices is null, the chunk is published
+// without vertex data and the render thread fills the VBO directly from the mapping (fill_mapped_vertices).
+template<typename F>
+bool PointCloudWin::load_chunks(size_t n, F fill)
+//-----------------------------------------------
+{
+   PointCloudCache::Writer cache_writer;
+   if (use_cache)
+   {
+      std::stringstream errs;
+      if (! cache_writer.begin(plyfile.string(), n, scale, yz_flip, mean_center, is_color_pointcloud,
+                               is_alpha_pointcloud, voxel_options, is_morton, &errs))
+         std::cerr << "Point cloud cache not written: " << errs.str() << std::endl;
+   }
+   // The octree is built from the cache, so large clouds are only loaded for it if the cache can be written (set
+   // before load_count so the render thread does not allocate a VBO for them).
+   is_octree.store( (cache_writer.good()) && (n > octree_threshold) );
+   load_count.store(n);
+   PointCloudStats stats(index_threads, ! mean_center);
+   CloudExtents extents;
+   for (size_t start=0; start<n; start += LOAD_CHUNK_SIZE)
+   {
+      if (must_stop_loading.load()) return false;
+      const size_t chunk_size = std::min(LOAD_CHUNK_SIZE, n - start);
+      LoadedChunk chunk{start, chunk_size, nullptr, nullptr};
+      if (! mapped_ply)
+      {
+         chunk.vertices.reset(new GLfloat[chunk_size*8]);
+         chunk.data = chunk.vertices.get();
+      }
+      fill(start, chunk_size, chunk.vertices.get());
+      if (cache_writer.good())
+      {
+         if (chunk.data != nullptr)
+            cache_writer.append_vertices(chunk.data, chunk_size);
+         else
+         {
+            std::unique_ptr<GLfloat[]> vertices(new GLfloat[chunk_size*8]);
+            fill_mapped_vertices(vertices.get(), start, chunk_size);
+            cache_writer.append_vertices(vertices.get(), chunk_size);
+         }
+      }
+      stats.add(points.coords, start, chunk_size);
+      extents.minx = stats.min(0); extents.maxx = stats.max(0);
+      extents.miny = stats.min(1); extents.maxy = stats.max(1);
+      extents.minz = stats.min(2); extents.maxz = stats.max(2);
+      extents.centroid = stats.mean();
+      std::lock_guard<std::mutex> lock(load_mutex);
+      if (! is_octree.load())
+         loaded_chunks.push_back(std::move(chunk));
+      loaded_extents = extents;
+      is_extents_update = true;
+   }
+
+   if (! mean_center)
+   {
+      extents.centroid = stats.median(points.coords);
+      std::lock_guard<std::mutex> lock(load_mutex);
+      loaded_extents.centroid = extents.centroid;
+      is_extents_update = true;
+   }
+   if (must_stop_loading.load()) return false;
+
+   std::unique_ptr<kd_tree_t> tree(new kd_tree_t(3, points, nanoflann::KDTreeSingleIndexAdaptorParams(10, index_threads)));
+   tree->buildIndex();
+   kd_tree_t& static_tree = *tree;
+   if (! is_octree.load())
+   {
+      index.reset(new PointIndex(points, std::move(tree)));
+      is_index_ready.store(true);
+   }
+   std::vector<float> knn_distances;
+   find_outliers(static_tree, n, nullptr, knn_distances);
+   if (must_stop_loading.load()) return false;
+
+   bool is_cached = false;
+   if (cache_writer.good())
+   {
+      cache_writer.write_points(points.xs.data(), points.ys.data(), points.zs.data(), ply_points.xs.data(),
+                                ply_points.ys.data(), ply_points.zs.data());
+      if (source_indices != nullptr)
+         cache_writer.write_source_index(source_indices);
+      if (! knn_distances.empty())
+         cache_writer.write_knn_distances(outlier_options.k, knn_distances.data());
+      const float bounds[6] = { extents.minx, extents.maxx, extents.miny, extents.maxy, extents.minz, extents.maxz };
+      const float centroid[3] = { extents.centroid.x, extents.centroid.y, extents.centroid.z };
+      is_cached = cache_writer.end(bounds, centroid, static_tree);
+      if (! is_cached)
+         std::cerr << "Error writing point cloud cache for " << plyfile.filename() << std::endl;
+   }
+   if (is_octree.load())
+   {
+      if ( (is_cached) && (open_octree()) )
+      {
+         // The kd-tree was only built for the cache, open_octree_index loads it back on the first pick
+         tree.reset();
+         return true;
+      }
+      // Fall back to uploading the whole cloud, publishing the chunks skipped above
+      std::cerr << "Octree display unavailable for " << plyfile.filename() << ", loading all " << n << " points"
+                << std::endl;
+      is_octree.store(false);
+      for (size_t start=0; start<n; start += LOAD_CHUNK_SIZE)
+      {
+         if (must_stop_loading.load()) return false;
+         const size_t chunk_size = std::min(LOAD_CHUNK_SIZE, n - start);
+         LoadedChunk chunk{start, chunk_size, nullptr, nullptr};
+         if (! mapped_ply)
+         {
+            chunk.vertices.reset(new GLfloat[chunk_size*8]);
+            chunk.data = chunk.vertices.get();
+            fill(start, chunk_size, chunk.vertices.get());
          }
+         std::lock_guard<std::mutex> lock(load_mutex);
+         loaded_chunks.push_back(std::move(chunk));
+      }
+      index.reset(new PointIndex(points, std::move(tree)));
+      is_index_ready.store(true);
+      find_outliers(static_tree, n, nullptr, knn_distances);
+   }
+   return true;
+}
+
+// Loads the point cloud from the memory mapped <plyfile>.pnpcache sidecar if it is valid for the PLY file and the
+// current load options. The cached vertex block is published as a single chunk and uploaded as is, the kd-tree reads
+// the cached world space coordinate arrays in place and the index is deserialized instead of being rebuilt.
+bool PointCloudWin::load_cached_pointcloud()
+//------------------------------------------
+{
+   std::shared_ptr<PointCloudCache> cache = std::make_shared<PointCloudCache>();
+   std::stringstream errs;
+   if (! cache->open(plyfile.string(), scale, yz_flip, mean_center, voxel_options, is_morton, &errs))
+   {
+      if (! errs.str().empty())
+         std::cerr << errs.str() << std::endl;
+      return false;
+   }
+   const PointCloudCache::Header& header = cache->header();
+   const size_t n = cache->count();
+   points.map(cache, cache->points(0), cache->points(1), cache->points(2), n);
+   ply_points.map(cache, cache->ply_points(0), cache->ply_points(1), cache->ply_points(2), n);
+   is_color_pointcloud = ((header.flags & PointCloudCache::COLOR) != 0);
+   is_alpha_pointcloud = ((header.flags & PointCloudCache::ALPHA) != 0);
+   CloudExtents extents;
+   extents.minx = header.minx; extents.maxx = header.maxx;
+   extents.miny = header.miny; extents.maxy = header.maxy;
+   extents.minz = header.minz; extents.maxz = header.maxz;
+   extents.centroid = glm::vec3(header.centroid[0], header.centroid[1], header.centroid[2]);
+   if (n > octree_threshold) // the kd-tree is then loaded on the first pick (open_octree_index)
+   {
+      point_cache = cache;
+      source_indices = cache->source_index();
+      is_octree.store(true);
+      load_count.store(n);
+      {
+         std::lock_guard<std::mutex> lock(load_mutex);
+         loaded_extents = extents;
+         is_extents_update = true;
+      }
+      if (open_octree())
+         return true;
+      std::cerr << "Octree display unavailable for " << plyfile.filename() << ", loading all " << n << " points"
+                << std::endl;
+      is_octree.store(false);
+   }
+   std::unique_ptr<kd_tree_t> cached_index = load_cached_index(*cache);
+   if (! cached_index)
+   {
+      points.clear();
+      ply_points.clear();
+      point_cache.reset();
+      source_indices = nullptr;
+      return false;
+   }
+   point_cache = cache;
+   source_indices = cache->source_index();
+   load_count.store(n);
+   {
+      std::lock_guard<std::mutex> lock(load_mutex);
+      loaded_chunks.push_back(LoadedChunk{0, n, nullptr, cache->vertices()});
+      loaded_extents = extents;
+      is_extents_update = true;
+   }
+   const kd_tree_t& static_tree = *cached_index;
+   index.reset(new PointIndex(points, std::move(cached_index)));
+   is_index_ready.store(true);
+   std::vector<float> knn_distances;
+   find_outliers(static_tree, n, cache->knn_distances(outlier_options.k), knn_distances);
+   if (! knn_distances.empty()) // not cached for this k
+   {
+      errs.str("");
+      if (! cache->write_knn_distances(outlier_options.k, knn_distances.data(), &errs))
+         std::cerr << errs.str() << std::endl;
+   }
+   return true;
+}
+
+// Deserializes the kd-tree saved in the point cloud cache over points, which must be mapped from cache. Returns null
+// (after reporting any error) if the index could not be read.
+std::unique_ptr<kd_tree_t> PointCloudWin::load_cached_index(const PointCloudCache& cache)
+//---------------------------------------------------------------------------------------
+{
+   std::unique_ptr<kd_tree_t> tree(new kd_tree_t(3, points, nanoflann::KDTreeSingleIndexAdaptorParams(10)));
+   FILE* fp = cache.index_stream();
+   if (fp == nullptr)
+      return nullptr;
+   try
+   {
+      tree->loadIndex(fp);
+      fclose(fp);
+   }
+   catch (const std::exception& e)
+   {
+      fclose(fp);
+      std::cerr << "Error loading kd-tree from point cloud cache (" << e.what() << ")" << std::endl;
+      return nullptr;
+   }
+   return tree;
+}
+
+// Statistical outlier removal (see OutlierFilter.h) over the n points of the built kd-tree, on the loader thread. The
+// mean kNN distances are taken from cached_distances if not null, else computed (on index_threads threads) into
+// distances for the cache. The outliers are left in pending_outliers for upload_loaded_chunks to remove.
+void PointCloudWin::find_outliers(const kd_tree_t& tree, size_t n, const float* cached_distances,
+                                  std::vector<float>& distances)
+//-----------------------------------------------------------------------------------------------
+{
+   if ( (! outlier_options.enabled()) || (n == 0) ) return;
+   if (is_octree.load())
+   {
+      std::cerr << "Outlier removal is not supported for octree rendered point clouds" << std::endl;
+      return;
+   }
+   if (cached_distances == nullptr)
+   {
+      distances.resize(n);
+      knn_mean_distances(tree, n, outlier_options.k, index_threads, distances.data());
+      cached_distances = distances.data();
+   }
+   std::vector<size_t> outliers = statistical_outliers(cached_distances, n, outlier_options.sigma);
+   std::lock_guard<std::mutex> lock(load_mutex);
+   pending_outliers.swap(outliers);
+}
+
+// Opens (building it from the point cloud cache vertex block if required) the LOD octree for the cloud and starts
+// the RAM node cache. Runs on the loader thread; the render thread switches to render_octree once is_octree_ready.
+// The point coordinates are left mapped from the cache and picking is enabled without a kd-tree in memory, the index
+// being loaded from the cache on the first pick (open_octree_index).
+bool PointCloudWin::open_octree()
+//-------------------------------
+{
+   std::shared_ptr<PointCloudCache> cache = point_cache;
+   std::stringstream errs;
+   if (! cache)
+   {
+      cache = std::make_shared<PointCloudCache>();
+      if (! cache->open(plyfile.string(), scale, yz_flip, mean_center, voxel_options, is_morton, &errs))
+      {
+         std::cerr << "Octree display requires the point cloud cache: " << errs.str() << std::endl;
+         return false;
+      }
+   }
+   const std::string path = PointOctree::octree_path(plyfile.string());
+   const uint64_t ply_size = cache->header().ply_size;
+   const int64_t ply_mtime = cache->header().ply_mtime_ns;
+   if (! octree.read(path, ply_size, ply_mtime))
+   {
+      const float* vertices = cache->vertices();
+      std::vector<uint32_t> order;
+      std::cout << "Building octree for " << plyfile.filename() << std::endl;
+      if ( (! octree.build(cache->count(), [vertices](size_t i, float* xyz)
+                           { std::memcpy(xyz, &vertices[i*8], 3*sizeof(float)); }, order)) ||
+           (! octree.write(path, ply_size, ply_mtime, order, [vertices](size_t i) { return &vertices[i*8]; }, &errs)) ||
+           (! octree.read(path, ply_size, ply_mtime, &errs)) )
+      {
+         std::cerr << "Error creating octree " << path << ": " << errs.str() << std::endl;
+         return false;
       }
+   }
+   octree_cache.reset(new OctreeNodeCache);
+   if (! octree_cache->open(path, octree, octree_ram_budget, &errs))
+   {
+      std::cerr << errs.str() << std::endl;
+      return false;
+   }
+   if (! points.is_mapped()) // loaded from the PLY file
+   {
+      points.map(cache, cache->points(0), cache->points(1), cache->points(2), cache->count());
+      ply_points.map(cache, cache->ply_points(0), cache->ply_points(1), cache->ply_points(2), cache->count());
+   }
+   point_cache = cache;
+   is_octree_ready.store(true);
+   is_index_ready.store(true);
+   return true;
+}
+
+// Loads the kd-tree of an octree rendered cloud from the point cloud cache on the first pick (on the render thread,
+// the loader having finished with points once is_index_ready is set). Picking is disabled if it can't be read.
+bool PointCloudWin::open_octree_index()
+//-------------------------------------
+{
+   std::unique_ptr<kd_tree_t> tree;
+   if (point_cache)
+      tree = load_cached_index(*point_cache);
+   if (! tree)
+   {
+      std::cerr << "Point cloud picking disabled: the kd-tree could not be loaded from the point cloud cache"
+                << std::endl;
+      is_index_ready.store(false);
+      return false;
+   }
+   index.reset(new PointIndex(points, std::move(tree)));
+   return true;
+}
+
+// Draws the octree nodes chosen by PointOctree::select for the current view. Nodes not yet on the GPU are uploaded
+// from the RAM node cache (at most MAX_OCTREE_UPLOADS_PER_FRAME per frame) or requested from disk, in which case they
+// are drawn in a later frame (their ancestors provide a coarser representation in the meantime).
+void PointCloudWin::render_octree()
+//---------------------------------
+{
+   if (is_selection_change)
+      update_octree_selection();
+   frame_no++;
+   pointcloud_unit.activate();
+   glUniformMatrix4fv(pointcloud_unit.uniform("MV"), 1, GL_FALSE, &MV[0][0]);
+   glUniformMatrix4fv(pointcloud_unit.uniform("P"), 1, GL_FALSE, &P[0][0]);
+   glUniform1f(pointcloud_unit.uniform("pointSize"), pointSize);
+   glEnable(GL_PROGRAM_POINT_SIZE);
+
+   const glm::mat4 MVP = P * MV;
+   octree.select(glm::value_ptr(MVP), P[1][1], static_cast<float>(height), octree_point_budget, octree_max_error,
+                 visible_nodes);
+   size_t uploads = 0;
+   bool is_pending = false; // nodes still to be drawn in a later frame
+   for (uint32_t i : visible_nodes)
+   {
+      auto it = gpu_nodes.find(i);
+      if (it == gpu_nodes.end())
+      {
+         std::shared_ptr<const std::vector<float>> vertices = octree_cache->get(i);
+         if (! vertices)
+         {
+            if (octree_cache->request(i))
+               is_pending = true;
+            continue;
+         }
+         if (uploads >= MAX_OCTREE_UPLOADS_PER_FRAME)
+         {
+            is_pending = true;
+            continue;
+         }
+         GPUNode node;
+         const size_t n = vertices->size()/8;
+         node.bytes = n*vertex_size(vertex_format);
+         const void* data = vertices->data();
+         if (vertex_format != VertexFormat::FLOAT32)
+         {
+            if (vertex_format == VertexFormat::QUANTIZED)
+               node.box = quantization_box(vertices->data(), n);
+            upload_buffer.resize(node.bytes);
+            convert_vertices(vertex_format, vertices->data(), n, upload_buffer.data(), &node.box);
+            data = upload_buffer.data();
+         }
+         glGenBuffers(1, &node.vbo);
+         glBindBuffer(GL_ARRAY_BUFFER, node.vbo);
+         glBufferData(GL_ARRAY_BUFFER, node.bytes, data, GL_STATIC_DRAW);
+         glGenVertexArrays(1, &node.vao);
+         glBindVertexArray(node.vao);
+         set_vertex_attributes(vertex_format);
+         glBindVertexArray(0);
+         glBindBuffer(GL_ARRAY_BUFFER, 0);
+         gpu_bytes += node.bytes;
+         uploads++;
+         it = gpu_nodes.emplace(i, node).first;
+      }
+      it->second.frame = frame_no;
+      set_quantization(&it->second.box);
+      glBindVertexArray(it->second.vao);
+      glDrawArrays(GL_POINTS, 0, static_cast<GLsizei>(octree.node(i).count));
+   }
+   if (selected_count > 0)
+   {
+      glDepthFunc(GL_LEQUAL);
+      set_quantization(&selected_box);
+      glBindVertexArray(pointcloud_unit.GLuint_get("VAO_SELECTED"));
+      glDrawArrays(GL_POINTS, 0, static_cast<GLsizei>(selected_count));
+      glDepthFunc(GL_LESS);
+   }
+   glBindVertexArray(0);
+   glUseProgram(0);
+   evict_gpu_nodes();
+   if (is_pending)
+      invalidate();
+   GLenum err;
+   std::stringstream errs;
+   if (! oglutil::isGLOk(err, &errs))
+      std::cerr << err << ": " << errs.str().c_str() << std::endl;
+}
+
+// Releases the least recently drawn GPU nodes while over the GPU budget (nodes drawn in this frame are kept).
+void PointCloudWin::evict_gpu_nodes()
+//-----------------------------------
+{
+   while (gpu_bytes > octree_gpu_budget)
+   {
+      auto oldest = gpu_nodes.end();
+      for (auto it = gpu_nodes.begin(); it != gpu_nodes.end(); ++it)
+         if ( (it->second.frame < frame_no) && ((oldest == gpu_nodes.end()) || (it->second.frame < oldest->second.frame)) )
+            oldest = it;
+      if (oldest == gpu_nodes.end())
+         break;
+      glDeleteVertexArrays(1, &oldest->second.vao);
+      glDeleteBuffers(1, &oldest->second.vbo);
+      gpu_bytes -= oldest->second.bytes;
+      gpu_nodes.erase(oldest);
+   }
+}
+
+// Only the flags of the vertices whose selection state changed since the last update (drawn_selection) are
+// rewritten so the cost of a selection change is proportional to the size of the selection, not the cloud.
+void PointCloudWin::update_selection()
+//------------------------------------
+{
+   std::vector<size_t> indices;
+   for (const auto& it : selected)
+      indices.push_back(it.first);
+   std::sort(indices.begin(), indices.end());
+   std::vector<std::pair<Real3<float>, float>> match_points;
+   std::vector<std::pair<size_t, GLfloat>> changed;
+   for (const auto& it : drawn_selection)
+   {
+      if ( (it.second != REMOVED_FLAG) && (selected.find(it.first) == selected.end()) )
+         changed.emplace_back(it.first, 0.0f);
+   }
+   for (size_t j : indices)
+   {
+      const float distance = selected[j];
+      if (match_window != nullptr)
+         match_points.emplace_back(ply_point(j), distance);
+      const GLfloat sel = (distance == 0) ? 2 : 1;
+      auto it = drawn_selection.find(j);
+      if ( (it == drawn_selection.end()) || (it->second != sel) )
+         changed.emplace_back(j, sel);
+   }
+   glBindBuffer(GL_ARRAY_BUFFER, pointcloud_unit.GLuint_get("VBO_VERTICES"));
+   for (const std::pair<size_t, GLfloat>& change : changed)
+   {
+      if (change.second == 0)
+         drawn_selection.erase(change.first);
       else
+         drawn_selection[change.first] = change.second;
+      // Vertices not uploaded yet get their flags in upload_loaded_chunks
+      if (change.first < uploaded_count)
+         write_selection_flags(change.first, change.second);
+   }
+   glBindBuffer(GL_ARRAY_BUFFER, 0);
+   is_selection_change = false;
+   send_match_points(std::move(match_points));
+}
+
+// Replaces the points shown in the match window, on the match window's render thread
+void PointCloudWin::send_match_points(std::vector<std::pair<Real3<float>, float>> match_points)
+//---------------------------------------------------------------------------------------------
+{
+   if (match_window == nullptr) return;
+   const float flip = points.flip;
+   std::shared_ptr<std::vector<std::pair<Real3<float>, float>>> shared =
+      std::make_shared<std::vector<std::pair<Real3<float>, float>>>(std::move(match_points));
+   match_window->post([this, flip, shared]()
+   {
+      match_window->clear_points(flip);
+      for (std::pair<Real3<float>, float>& point : *shared)
+         match_window->add_point(point.first, point.second);
+      match_window->update_points(this);
+   });
+}
+
+// Writes the selection flags of vertex j into the bound VBO_VERTICES
+void PointCloudWin::write_selection_flags(size_t j, GLfloat sel)
+//--------------------------------------------------------------
+{
+   const size_t flags_offset = vertex_flags_offset(vertex_format);
+   uint8_t vertex[sizeof(GLfloat)*8];
+   set_vertex_flags(vertex_format, vertex, sel);
+   glBufferSubData(GL_ARRAY_BUFFER, j*vertex_size(vertex_format) + flags_offset, vertex_flags_size(vertex_format),
+                   vertex + flags_offset);
+}
+
+// The octree nodes are shared static buffers so selected points are drawn from a separate small buffer
+// (VBO_SELECTED) over the cloud instead of being flagged in the vertex w coordinate.
+void PointCloudWin::update_octree_selection()
+//-------------------------------------------
+{
+   std::vector<size_t> indices;
+   for (const auto& it : selected)
+      indices.push_back(it.first);
+   std::sort(indices.begin(), indices.end());
+   std::vector<std::pair<Real3<float>, float>> match_points;
+   std::vector<GLfloat> vertices(indices.size()*8);
+   GLfloat* vertices_ptr = vertices.data();
+   for (size_t j : indices)
+   {
+      const float distance = selected[j];
+      if (match_window != nullptr)
+         match_points.emplace_back(ply_point(j), distance);
+      const Real3<float> p = points.get(j);
+      _push_vertex(vertices_ptr, p.x, p.y, p.z, (distance == 0) ? 2 : 1, 1, 1, 1, 1);
+   }
+   selected_count = indices.size();
+   if (! pointcloud_unit.GLuint_get("VBO_SELECTED"))
+   {
+      glGenBuffers(1, &pointcloud_unit.GLuint_ref("VBO_SELECTED"));
+      glGenVertexArrays(1, &pointcloud_unit.GLuint_ref("VAO_SELECTED"));
+      glBindVertexArray(pointcloud_unit.GLuint_get("VAO_SELECTED"));
+      glBindBuffer(GL_ARRAY_BUFFER, pointcloud_unit.GLuint_get("VBO_SELECTED"));
+      set_vertex_attributes(vertex_format);
+      glBindVertexArray(0);
+   }
+   selected_box = (vertex_format == VertexFormat::QUANTIZED) ? quantization_box(vertices.data(), selected_count)
+                                                             : QuantizationBox();
+   upload_buffer.resize(selected_count*vertex_size(vertex_format));
+   convert_vertices(vertex_format, vertices.data(), selected_count, upload_buffer.data(), &selected_box);
+   glBindBuffer(GL_ARRAY_BUFFER, pointcloud_unit.GLuint_get("VBO_SELECTED"));
+   glBufferData(GL_ARRAY_BUFFER, upload_buffer.size(), upload_buffer.data(), GL_DYNAMIC_DRAW);
+   glBindBuffer(GL_ARRAY_BUFFER, 0);
+   is_selection_change = false;
+   send_match_points(std::move(match_points));
+}
+
+// Binary PLY files in host byte order with float x,y,z are memory mapped and read in place instead of being copied
+// through tinyply buffers, once to set the world space kd-tree coordinates and then when filling the VBO (see
+// fill_mapped_vertices).
+bool PointCloudWin::map_pointcloud()
+//----------------------------------
+{
+   std::shared_ptr<MappedPly> ply = std::make_shared<MappedPly>();
+   std::stringstream errs;
+   if ( (! ply->open(plyfile.string(), &errs)) || (! ply->is_zero_copy()) || (ply->vertex_count() == 0) )
+   {
+      if ( (ply->is_binary()) && (! errs.str().empty()) )
+         std::cerr << errs.str() << " (" << plyfile.filename() << ")" << std::endl;
+      return false;
+   }
+   const MappedPly::Property *px = ply->property("x"), *py = ply->property("y"), *pz = ply->property("z");
+   if ( (px == nullptr) || (py == nullptr) || (pz == nullptr) || (px->type != tinyply::Type::FLOAT32) ||
+        (py->type != tinyply::Type::FLOAT32) || (pz->type != tinyply::Type::FLOAT32) )
+      return false;
+   const MappedPly::Property *pr = ply->property("red"), *pg = ply->property("green"), *pb = ply->property("blue"),
+                             *pa = ply->property("alpha");
+   is_color_pointcloud = ( (pr != nullptr) && (pg != nullptr) && (pb != nullptr) &&
+                           (pr->type == tinyply::Type::UINT8) && (pg->type == tinyply::Type::UINT8) &&
+                           (pb->type == tinyply::Type::UINT8) );
+   is_alpha_pointcloud = ( (is_color_pointcloud) && (pa != nullptr) && (pa->type == tinyply::Type::UINT8) );
+   if (is_color_pointcloud)
+   {
+      mapped_red = pr; mapped_green = pg; mapped_blue = pb;
+      if (is_alpha_pointcloud)
+         mapped_alpha = pa;
+   }
+   mapped_ply = ply;
+   ply->advise_sequential();
+   const size_t xoffset = px->offset, yoffset = py->offset, zoffset = pz->offset;
+   size_t point_count = ply->vertex_count();
+   const bool is_centroids = ( (voxel_options.enabled()) && (voxel_options.is_centroid) );
+   if (voxel_options.enabled())
+   {
+      point_count = downsample(ply->vertex_count(),
+                               [&ply, xoffset, yoffset, zoffset](size_t i)
+                               {
+                                  return Real3<float>(ply->get<float>(i, xoffset), ply->get<float>(i, yoffset),
+                                                      ply->get<float>(i, zoffset));
+                               },
+                               [this](size_t i) -> uint32_t
+                               {
+                                  const uint32_t alpha = (is_alpha_pointcloud)
+                                                         ? mapped_ply->get<uint8_t>(i, mapped_alpha->offset) : 255;
+                                  return mapped_ply->get<uint8_t>(i, mapped_red->offset) |
+                                         (mapped_ply->get<uint8_t>(i, mapped_green->offset) << 8) |
+                                         (mapped_ply->get<uint8_t>(i, mapped_blue->offset) << 16) | (alpha << 24);
+                               }, is_color_pointcloud);
+   }
+   if (is_morton)
+      reorder(point_count, [&ply, xoffset, yoffset, zoffset](size_t i)
+      {
+         return Real3<float>(ply->get<float>(i, xoffset), ply->get<float>(i, yoffset), ply->get<float>(i, zoffset));
+      });
+   // Centroid colours are averaged so are kept in the kd-tree source for fill_mapped_vertices
+   points.resize(point_count, (is_centroids) && (! voxels.colors.empty()));
+   ply_points.resize(point_count);
+   auto fill = [this, &ply, xoffset, yoffset, zoffset, is_centroids](size_t start, size_t n, GLfloat*)
+   {
+      for (size_t i=start; i<start + n; i++)
+      {
+         if (is_centroids)
+         {
+            const Real3<float>& p = voxels.points[i];
+            points.set(i, p.x, p.y, p.z);
+            ply_points.set(i, p.x, p.y, p.z);
+            if (! voxels.colors.empty())
+               points.colors[i] = voxels.colors[i];
+            continue;
+         }
+         const size_t j = ply_index(i);
+         const float x = ply->get<float>(j, xoffset), y = ply->get<float>(j, yoffset), z = ply->get<float>(j, zoffset);
+         points.set(i, x, y, z);
+         ply_points.set(i, x, y, z);
+      }
+   };
+   if (! load_chunks(point_count, fill))
+      std::cerr << "Loading of " << plyfile.filename() << " failed or cancelled" << std::endl;
+   return true;
+}
+
+void PointCloudWin::fill_mapped_vertices(GLfloat* vertices, size_t start, size_t n)
+//----------------------------------------------------------------------------------
+{
+   GLfloat red =1.0f, green =0, blue =0, alpha =1.0f;
+   for (size_t i=start; i<start + n; i++)
+   {
+      const Real3<float> p = points.get(i);
+      if (! points.colors.empty())
       {
-         red = alpha = 1.0f;
-         green = blue = 0;
+         const uint32_t c = points.colors[i];
+         red = static_cast<float>(c & 0xFF) / 255.0f;
+         green = static_cast<float>((c >> 8) & 0xFF) / 255.0f;
+         blue = static_cast<float>((c >> 16) & 0xFF) / 255.0f;
+         alpha = static_cast<float>(c >> 24) / 255.0f;
       }
-      _push_vertex(vertices_ptr, x, y, z, 0, red, green, blue, alpha);
-      points.add(item.x, item.y, item.z, &red, &green, &blue, &alpha);
-      if (! mean_center)
+      else if (is_color_pointcloud)
       {
-         Xs[i] = x;
-         Ys[i] = y;
-         Zs[i] = z;
+         const size_t j = ply_index(i);
+         red = static_cast<float>(mapped_ply->get<uint8_t>(j, mapped_red->offset)) / 255.0f;
+         green = static_cast<float>(mapped_ply->get<uint8_t>(j, mapped_green->offset)) / 255.0f;
+         blue = static_cast<float>(mapped_ply->get<uint8_t>(j, mapped_blue->offset)) / 255.0f;
+         if (is_alpha_pointcloud)
+            alpha = static_cast<float>(mapped_ply->get<uint8_t>(j, mapped_alpha->offset)) / 255.0f;
       }
-//      std::cout << std::fixed << std::setprecision(5) << x << ", " << y << ", " << z << std::endl;
+      _push_vertex(vertices, p.x, p.y, p.z, 0, red, green, blue, alpha);
+   }
+}
 
-      if (x < minx) minx = x;
-      if (x > maxx) maxx = x;
-      if (y < miny) miny = y;
-      if (y > maxy) maxy = y;
-      if (z < minz) minz = z;
-      if (z > maxz) maxz = z;
-      totalx += x; totaly += y; totalz += z;
-      n++;
+void PointCloudWin::start_loading()
+//---------------------------------
+{
+   is_index_ready.store(false);
+   must_stop_loading.store(false);
+   is_loading.store(true);
+   loader = std::thread([this]()
+   {
+      if (! load_pointcloud())
+         std::cerr << "Error loading point cloud from " << plyfile.string() << std::endl;
+      is_loading.store(false);
+   });
+}
+
+void PointCloudWin::stop_loading()
+//--------------------------------
+{
+   must_stop_loading.store(true);
+   if (loader.joinable())
+      loader.join();
+}
+
+// Called from on_render (GL context current) while the loader thread is running (and once after it has completed) to
+// upload the chunks published so far into the VBO, which is allocated for the full point count from the PLY header.
+// Only the uploaded prefix (uploaded_count) is drawn so the display grows as the cloud is loaded.
+void PointCloudWin::upload_loaded_chunks()
+//----------------------------------------
+{
+   const bool is_last = ! is_loading.load();
+   if ( (! initialised_pc) && (load_count.load() > 0) && (! is_octree.load()) )
+      initialised_pc = init_pointcloud();
+   std::deque<LoadedChunk> chunks;
+   CloudExtents extents;
+   bool is_extents = false;
+   {
+      std::lock_guard<std::mutex> lock(load_mutex);
+      chunks.swap(loaded_chunks);
+      if (is_extents_update)
+      {
+         extents = loaded_extents;
+         is_extents = true;
+         is_extents_update = false;
+      }
+   }
+   if ( (initialised_pc) && (! chunks.empty()) )
+   {
+      glBindBuffer(GL_ARRAY_BUFFER, pointcloud_unit.GLuint_get("VBO_VERTICES"));
+      const size_t vsize = vertex_size(vertex_format);
+      for (LoadedChunk& chunk : chunks)
+      {
+         const GLintptr offset = chunk.start*vsize;
+         const GLsizeiptr size = chunk.count*vsize;
+         if (vertex_format != VertexFormat::FLOAT32)
+         {
+            const GLfloat* data = chunk.data;
+            if (data == nullptr)
+            {
+               chunk.vertices.reset(new GLfloat[chunk.count*8]);
+               fill_mapped_vertices(chunk.vertices.get(), chunk.start, chunk.count);
+               data = chunk.vertices.get();
+            }
+            QuantizedBlock block{chunk.start, chunk.count, QuantizationBox()};
+            if (vertex_format == VertexFormat::QUANTIZED)
+            {
+               block.box = quantization_box(data, chunk.count);
+               quantized_blocks.push_back(block);
+            }
+            upload_buffer.resize(size);
+            convert_vertices(vertex_format, data, chunk.count, upload_buffer.data(), &block.box);
+            glBufferSubData(GL_ARRAY_BUFFER, offset, size, upload_buffer.data());
+         }
+         else if (chunk.data != nullptr)
+            glBufferSubData(GL_ARRAY_BUFFER, offset, size, chunk.data);
+         else
+         {
+            GLfloat* vertices = static_cast<GLfloat *>(glMapBufferRange(GL_ARRAY_BUFFER, offset, size,
+                                                                        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT));
+            if (vertices != nullptr)
+            {
+               fill_mapped_vertices(vertices, chunk.start, chunk.count);
+               glUnmapBuffer(GL_ARRAY_BUFFER);
+            }
+            else
+            {
+               chunk.vertices.reset(new GLfloat[chunk.count*8]);
+               fill_mapped_vertices(chunk.vertices.get(), chunk.start, chunk.count);
+               glBufferSubData(GL_ARRAY_BUFFER, offset, size, chunk.vertices.get());
+            }
+         }
+         uploaded_count = chunk.start + chunk.count;
+         for (const auto& it : drawn_selection)
+         {
+            if ( (it.first >= chunk.start) && (it.first < uploaded_count) )
+               write_selection_flags(it.first, it.second);
+         }
+      }
+      glBindBuffer(GL_ARRAY_BUFFER, 0);
+   }
+   if (is_extents)
+      set_extents(extents);
+   if (is_last)
+   {
+      if (loader.joinable())
+         loader.join();
+      is_load_complete = true;
+      if (! pending_outliers.empty())
+      {
+         const size_t removed = remove_points(pending_outliers);
+         std::vector<size_t>().swap(pending_outliers);
+         std::cout << "Removed " << removed << " outliers (" << index->active_count() << " remaining)" << std::endl;
+      }
    }
-   assert(vertices_ptr == vertices_ptr_end);
+}
+
+void PointCloudWin::set_extents(const CloudExtents& extents)
+//-----------------------------------------------------------
+{
+   const bool is_first = (max_r == 0);
+   minx = extents.minx; maxx = extents.maxx;
+   miny = extents.miny; maxy = extents.maxy;
+   minz = extents.minz; maxz = extents.maxz;
    rangex = fabsf(maxx - minx); rangey = fabsf(maxy - miny); rangez = fabsf(maxz - minz);
    max_r = sqrtf(rangex*rangex + rangey*rangey + rangez*rangez);
    if (isnanf(r))
       r = max_r/2.0f;
-   phi =PIf/2.0f; theta =0;
-   cartesian();
-
-   if (mean_center)
-   {
-      const auto meanx = static_cast<float>(totalx / n);
-      const auto meany = static_cast<float>(totaly / n);
-      const auto meanz = static_cast<float>(totalz / n);
-      centroid = glm::vec3(meanx, meany, meanz);
-   }
-   else
+   if (is_first)
    {
-      std::nth_element(Xs.begin(), Xs.begin() + Xs.size() / 2, Xs.end());
-      std::nth_element(Ys.begin(), Ys.begin() + Ys.size() / 2, Ys.end());
-      std::nth_element(Zs.begin(), Zs.begin() + Zs.size() / 2, Zs.end());
-      const float medianx = Xs[Xs.size() / 2];
-      const float mediany = Ys[Ys.size() / 2];
-      const float medianz = Zs[Zs.size() / 2];
-      centroid = glm::vec3(medianx, mediany, medianz);
+      phi = PIf/2.0f; theta = 0;
    }
-   index.reset(new kd_tree_t(3, points, nanoflann::KDTreeSingleIndexAdaptorParams(10)));
-   index->buildIndex();
-   return vertices;
+   centroid = extents.centroid;
+   cartesian();
+   if ( (width > 0) && (height > 0) )
+      P = glm::perspective(glm::radians(45.0f), (float)width / (float)height, 0.01f, rangez*3);
+   IP = glm::inverse(P);
 }
 
 bool PointCloudWin::init_pointcloud()
 //-----------------------------------
 {
    if (! pointcloud_unit) return false;
-   std::unique_ptr<GLfloat[]> vertices = load_pointcloud();
-   if (! vertices) return false;
+   count = load_count.load();
    pointcloud_unit.del("VAO_VERTICES");
    pointcloud_unit.del("VBO_VERTICES");
 
    oglutil::clearGLErrors();
    glGenBuffers(1, &pointcloud_unit.GLuint_ref("VBO_VERTICES"));
    glBindBuffer(GL_ARRAY_BUFFER, pointcloud_unit.GLuint_get("VBO_VERTICES"));
-   glBufferData(GL_ARRAY_BUFFER, count*8*sizeof(GLfloat), vertices.get(), GL_DYNAMIC_DRAW);
+   glBufferData(GL_ARRAY_BUFFER, count*vertex_size(vertex_format), nullptr, GL_DYNAMIC_DRAW);
    glBindBuffer(GL_ARRAY_BUFFER, 0);
 
    glGenVertexArrays(1, &pointcloud_unit.GLuint_ref("VAO_VERTICES"));
    glBindVertexArray(pointcloud_unit.GLuint_get("VAO_VERTICES"));
    glBindBuffer(GL_ARRAY_BUFFER, pointcloud_unit.GLuint_get("VBO_VERTICES"));
-   glEnableVertexAttribArray(0);
-   glEnableVertexAttribArray (1);
-   GLsizei stride = sizeof(GLfloat) * (4 + 4);
-   glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, stride, 0);
-   glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<const void *>(4 * sizeof (GLfloat)));
+   set_vertex_attributes(vertex_format);
    glBindVertexArray(0);
    std::stringstream errs;
    GLuint err;
@@ -578,13 +1345,29 @@ bool PointCloudWin::init_pointcloud()
       std::cerr << errs.str().c_str() << std::endl;
       pointcloud_unit.del("VAO_VERTICES");
       pointcloud_unit.del("VBO_VERTICES");
-      initialised_pc = false;
       return false;
    }
-   initialised_pc = true;
+   uploaded_count = 0;
+   quantized_blocks.clear();
+   drawn_selection.clear();
+   pending_removed.clear();
    return true;
 }
 
+// Sets the dequantization uniforms of the packed shaders for a block of QUANTIZED vertices, or the identity (box
+// null) for PACKED vertices. Not used by the FLOAT32 shaders.
+void PointCloudWin::set_quantization(const QuantizationBox* box)
+//--------------------------------------------------------------
+{
+   if (vertex_format == VertexFormat::FLOAT32) return;
+   static const QuantizationBox identity;
+   if (vertex_format != VertexFormat::QUANTIZED)
+      box = &identity;
+   glUniform3fv(pointcloud_unit.uniform("quantOffset"), 1, box->offset);
+   glUniform3fv(pointcloud_unit.uniform("quantScale"), 1, box->scale);
+   glUniform1f(pointcloud_unit.uniform("quantBias"), (vertex_format == VertexFormat::QUANTIZED) ? 32768.0f : 0.0f);
+}
+
 void PointCloudWin::cartesian()
 //---------------------------------
 {
@@ -625,21 +1408,12 @@ void PointCloudWin::on_mouse_click(int button, int action, int mods)
       {
          is_dragging = true;
          drag_start = cursor_pos;
-         if (rotating_cursor == nullptr)
-         {
-            rotating_cursor = glfwCreateStandardCursor(GLFW_HAND_CURSOR);
-            glfwSetCursor(GLFW_win(), rotating_cursor);
-         }
+         request_cursor(GLFW_HAND_CURSOR);
       }
       else if (last_button_action == GLFW_RELEASE)
       {
          is_dragging = false;
-         if (rotating_cursor != nullptr)
-         {
-            glfwDestroyCursor(rotating_cursor);
-            rotating_cursor = nullptr;
-            glfwSetInputMode(GLFW_win(), GLFW_CURSOR, GLFW_CURSOR_NORMAL);
-         }
+         request_cursor(0);
       }
    }
 //         rotation_update(last_xpos, last_ypos);
@@ -660,6 +1434,7 @@ void PointCloudWin::rotation_update(double xpos, double ypos)
 void PointCloudWin::cast_ray()
 //----------------------------
 {
+   if ( (! is_index_ready.load()) || ( (! index) && (! open_octree_index()) ) ) return;
    float x = (2.0f * static_cast<float>(cursor_pos.first)) / width - 1.0f;
    float y = 1.0f - (2.0f * static_cast<float>(cursor_pos.second)) / height;
    glm::vec4 img_ray(x, y, -1, 1);
@@ -676,26 +1451,19 @@ void PointCloudWin::cast_ray()
 
    glm::vec3 O = location; //(0, 0, 0);
    float search_radius = 0.25;
-   size_t hit = std::numeric_limits<size_t>::max();
-   float dist = std::numeric_limits<float>::max();
-   for (size_t i=0; i<points.kdtree_get_point_count(); i++)
-   {
-      if (i == selected_index) continue;
-      Real3<float> p = points.get(i);
-      glm::vec3 C(p.x, p.y, p.z);
-      glm::vec3 OC = O - C;
-      float b = glm::dot(ray, OC);
-      float c = glm::dot(OC, OC) - search_radius;
-      float disc2 = b*b - c;
-      if (disc2 >= 0)
-      {
-         float d = glm::distance(O, C);
-         if (d < dist)
-         {
-            hit = i;
-            dist = d;
-         }
-      }
+   float dist;
+   size_t hit;
+   if (pick_mode == RayPickMode::BRUTE_FORCE)
+      hit = index->pick_brute_force(O, ray, search_radius, selected_index, dist);
+   else
+      hit = index->pick(O, ray, search_radius, selected_index, dist);
+   if (pick_mode == RayPickMode::VERIFY)
+   {
+      float reference_dist;
+      size_t reference = index->pick_brute_force(O, ray, search_radius, selected_index, reference_dist);
+      if (reference != hit)
+         std::cerr << "PointCloudWin::cast_ray: kd-tree pick " << hit << " (" << dist << ") differs from reference "
+                   << reference << " (" << reference_dist << ")" << std::endl;
    }
    if (hit < points.kdtree_get_point_count())
    {
@@ -724,15 +1492,62 @@ void PointCloudWin::cast_ray()
    }
 }
 
+size_t PointCloudWin::remove_points(const std::vector<size_t>& indices)
+//----------------------------------------------------------------------
+{
+   if ( (! is_load_complete) || (is_octree.load()) || (! index) ) return 0;
+   size_t removed = 0;
+   for (size_t i : indices)
+   {
+      if (! index->remove(i)) continue;
+      removed++;
+      selected.erase(i);
+      if (i == selected_index)
+         selected_index = std::numeric_limits<size_t>::max();
+      pending_removed.push_back(i);
+   }
+   if (removed > 0)
+      is_selection_change = true;
+   return removed;
+}
+
+// Hides the points queued by remove_points, on the render fiber as input handlers have no current GL context
+void PointCloudWin::write_removed_flags()
+//---------------------------------------
+{
+   glBindBuffer(GL_ARRAY_BUFFER, pointcloud_unit.GLuint_get("VBO_VERTICES"));
+   for (size_t i : pending_removed)
+   {
+      drawn_selection[i] = REMOVED_FLAG;
+      write_selection_flags(i, REMOVED_FLAG);
+   }
+   glBindBuffer(GL_ARRAY_BUFFER, 0);
+   std::vector<size_t>().swap(pending_removed);
+}
+
+void PointCloudWin::on_key_press(oglfiber::KeyPress& keyPress)
+//------------------------------------------------------------
+{
+   if (keyPress.action != GLFW_PRESS) return;
+   if ( (keyPress.key == GLFW_KEY_DELETE) && (! selected.empty()) )
+   {
+      std::vector<size_t> indices;
+      for (const auto& it : selected)
+         indices.push_back(it.first);
+      const size_t removed = remove_points(indices);
+      if (removed > 0)
+         std::cout << "Removed " << removed << " points (" << index->active_count() << " remaining)" << std::endl;
+   }
+}
+
 void PointCloudWin::on_match_select_change(float x, float y, float z)
 //-------------------------------------------------------------------
 {
-   const float flip = (yz_flip) ? -1 : 1;
-   x *= scale; y *= flip*scale; z *= flip*scale;
+   // x, y, z come from ply_point (via MatchWin::add_point) so are compared untransformed
    for (auto it=selected.begin(); it != selected.end(); ++it)
    {
       size_t i = it->first;
-      Real3<float> p = points.get(i);
+      Real3<float> p = ply_point(i);
 //      std::cout << i << ": " <<  x << "," << y << "," << z << " -> " << p.x << "," << p.y << "," << p.z
 //                << glm::distance(glm::vec3(x, y, z), glm::vec3(p.x, p.y, p.z)) << std::endl;
       if ( (near_zero(x - p.x, 0.000001f)) && (near_zero(y - p.y, 0.000001f)) && (near_zero(z - p.z, 0.000001f)) )
@@ -741,6 +1556,7 @@ void PointCloudWin::on_match_select_change(float x, float y, float z)
          selected_index = i;
          selected[selected_index] = 0;
          is_selection_change = true;
+         invalidate();
          break;
       }
    }
@@ -30,60 +30,30 @@ SOFTWARE.
 #define FIBERGL_POINTCLOUDWIN_H
 
 #include <iostream>
+#include <thread>
+#include <mutex>
+#include <deque>
+#include <atomic>
+#include <algorithm>
 
 #include "OGLFiberWin.hh"
 #include "MatchWin.h"
-#include "nanoflann.hpp"
+#include "PointCloudSource.h"
+#include "PointIndex.h"
+#include "PointCloudStats.h"
+#include "VoxelGrid.h"
+#include "OutlierFilter.h"
+#include "MortonOrder.h"
+#include "MappedPly.h"
+#include "PointCloudCache.h"
+#include "PointOctree.h"
+#include "PackedVertex.h"
+#include "RayPick.h"
 #include "util.h"
 #include "types.h"
 
 class MatchWin;
 
-template <typename T>
-struct PointCloudFlannSource
-//==========================
-{
-   PointCloudFlannSource(float scale_ =1.0, bool yz_flip_ =false) : scale(scale_), flip((yz_flip_) ? -1 : 1) {}
-
-   float scale, flip;
-   std::vector<Real3<T>> pts;
-   std::vector<std::tuple<T, T, T, T>> colors;
-
-   void clear() { pts.clear(); }
-   void add(T x, T y, T z, T* r = nullptr, T* g = nullptr, T* b = nullptr, T* a= nullptr)
-   {
-      pts.emplace_back(x, y, z);
-      bool iscolor = (r != nullptr && g != nullptr && b != nullptr);
-      if (iscolor)
-      {
-         if (a == nullptr)
-            colors.push_back(std::make_tuple(*r, *g, *b, 1.0));
-         else
-            colors.push_back(std::make_tuple(*r, *g, *b, *a));
-      }
-   }
-
-   Real3<T> get(size_t i) { return Real3<T>(pts[i].x * scale, pts[i].y * scale * flip, pts[i].z * scale * flip); }
-
-   bool is_selected = false;
-
-   inline size_t kdtree_get_point_count() const { return pts.size(); }
-
-   inline T kdtree_get_pt(const size_t i, int dim) const
-   //-----------------------------------------------------
-   {
-      if (dim == 0) return pts[i].x * scale;
-      else if (dim == 1) return pts[i].y * scale * flip;
-      else return pts[i].z * scale * flip;
-   }
-
-   template <class BBOX>
-   bool kdtree_get_bbox(BBOX& /* bb */) const { return false; }
-};
-
-typedef nanoflann::KDTreeSingleIndexAdaptor<nanoflann::L2_Simple_Adaptor<float, PointCloudFlannSource<float>>,
-                                            PointCloudFlannSource<float>, 3> kd_tree_t;
-
 class PointCloudWin : public oglfiber::OGLFiberWindow
 //=====================================================
 {
@@ -110,18 +80,61 @@ public:
                  const std::string& plyfilename, MatchWin* matchWin,
                  float scale_ =1.0f, bool yz_flip_ =false, bool is_mean_center_ = true,
                  int glsl_ver =440, int gl_major =4, int gl_minor = 4, bool can_resize =true);
+   ~PointCloudWin() override { stop_loading(); }
 
    void set_center(GLfloat x, GLfloat y, GLfloat z, GLfloat scale =1.0f) { centroid = glm::vec3(x*scale, y*scale, z*scale); }
    void set_r(float _r) { r = _r; cartesian(); }
    void set_point_size(GLfloat psize) { pointSize = psize; }
+   // Enable/disable reading and writing the <plyfile>.pnpcache sidecar cache (see PointCloudCache). Default enabled.
+   void set_use_cache(bool is_cache) { use_cache = is_cache; }
+   // Number of threads used to build the kd-tree index (1 for a serial build). The tree does not depend on it.
+   void set_index_threads(unsigned threads) { index_threads = std::max(threads, 1u); }
+   // GPU vertex format (see PackedVertex.h). Must be set before the window is initialised, default PACKED.
+   void set_vertex_format(VertexFormat format) { vertex_format = format; }
+   // Ray picking using the kd-tree (default), the brute force reference or both with differences reported.
+   void set_pick_mode(RayPickMode mode) { pick_mode = mode; }
+   // Load time voxel grid downsampling (see VoxelGrid.h), default disabled. Set before the window is initialised.
+   void set_voxel_grid(const VoxelGridOptions& options) { voxel_options = options; }
+   /*
+    * Load time statistical outlier removal (see OutlierFilter.h), default disabled. The outliers are removed as by
+    * remove_points once loading is complete. Not supported for octree rendered clouds.
+    */
+   void set_outlier_filter(const OutlierOptions& options) { outlier_options = options; }
+   // Load time Morton (Z) order sort of the points (see MortonOrder.h), default off. Set before the window is initialised.
+   void set_morton_order(bool is_morton_order) { is_morton = is_morton_order; }
+   // PLY file index of loaded point i, which differs from i when the cloud was downsampled or reordered.
+   size_t ply_index(size_t i) const { return (source_indices == nullptr) ? i : static_cast<size_t>(source_indices[i]); }
+   // Coordinates of loaded point i as in the PLY file (or its voxel centroid), bit exact unlike points.point(i).
+   Real3<float> ply_point(size_t i) const { return (i < ply_points.count) ? ply_points.get(i) : points.point(i); }
+   /*
+    * Removes points from the spatial index and hides them (they keep their index and VBO slot, see PointIndex).
+    * Only valid once loading is complete, not supported for octree rendered clouds. The points are hidden by the
+    * next on_render so this does not need a GL context. Returns the number of points removed. The Delete key
+    * removes the selected points.
+    */
+   size_t remove_points(const std::vector<size_t>& indices);
+   /*
+    * Point clouds with more than threshold points are displayed using the out of core level of detail octree
+    * renderer (see PointOctree) which requires the point cloud cache (they are loaded whole if the cache or octree
+    * can't be written). point_budget is the maximum number of points drawn per frame, max_error the maximum
+    * projected point spacing in pixels before a node is refined and ram_budget/gpu_budget the sizes in bytes of the
+    * RAM and GPU node LRU caches.
+    */
+   void set_octree(size_t threshold, size_t point_budget =5000000, float max_error =1.5f,
+                   size_t ram_budget =size_t(2) << 30, size_t gpu_budget =size_t(1) << 30)
+   {
+      octree_threshold = threshold; octree_point_budget = point_budget; octree_max_error = max_error;
+      octree_ram_budget = ram_budget; octree_gpu_budget = gpu_budget;
+   }
 
 protected:
    void on_initialize(const GLFWwindow*) override;
    void on_resized(int w, int h) override;
-   void on_exit() override {};
+   void on_exit() override { stop_loading(); };
    bool on_render() override;
    void onCursorUpdate(double xpos, double ypos) override;
    void on_mouse_click(int button, int action, int mods) override;
+   void on_key_press(oglfiber::KeyPress& keyPress) override;
    void on_mouse_scroll(double x, double y) override
    {
       r += sgn(y)*0.2f;
@@ -131,20 +144,47 @@ protected:
    }
 
 private:
+   struct CloudExtents
+   {
+      float minx = std::numeric_limits<float>::max(), maxx = std::numeric_limits<float>::lowest(),
+            miny = std::numeric_limits<float>::max(), maxy = std::numeric_limits<float>::lowest(),
+            minz = std::numeric_limits<float>::max(), maxz = std::numeric_limits<float>::lowest();
+      glm::vec3 centroid{0, 0, 0};
+   };
+
+   struct LoadedChunk
+   {
+      size_t start, count;
+      std::unique_ptr<GLfloat[]> vertices;
+      const GLfloat* data; // vertices.get() or the cached vertex block, null if filled from the memory mapped PLY
+   };
+
+   struct QuantizedBlock
+   {
+      size_t start, count;
+      QuantizationBox box;
+   };
+
+   static constexpr size_t LOAD_CHUNK_SIZE = 256*1024;
+   static constexpr GLfloat REMOVED_FLAG = 3; // selection flag value hiding a removed point (see remove_points)
+
    MatchWin* match_window = nullptr;
    int glsl_ver;
    int width =0, height =0;
    bool is_dragging = false, yz_flip = false, mean_center =true;
    float scale = 1.0;
    PointCloudFlannSource<float> points;
+   PointCloudFlannSource<float> ply_points; // untransformed coordinates (scale 1), owned or mapped like points
    std::pair<double, double> cursor_pos, drag_start;
    filesystem::path shader_directory;
    oglutil::OGLProgramUnit axes_unit, pointcloud_unit;
    bool initialised_axes = false, initialised_pc = false;
    size_t count = 0;
    std::unordered_map<size_t, float> selected;
+   std::unordered_map<size_t, GLfloat> drawn_selection; // non-zero selection flags currently in VBO_VERTICES
    bool is_selection_change = false;
    size_t selected_index = std::numeric_limits<size_t>::max();
+   RayPickMode pick_mode = RayPickMode::KDTREE;
    GLfloat ray_data[12];
    filesystem::path plyfile;
    float minx = std::numeric_limits<float>::max(), maxx = std::numeric_limits<float>::lowest(),
@@ -156,13 +196,84 @@ private:
    glm::vec3 location{0, 0, 0}, centroid{0, 0, 0}, tangent{0, 1, 0};
    glm::mat4 P, IP, MV, IMV;
    GLfloat pointSize =1.0f; // gl_pointSize equivalent uniform in shader
-   GLFWcursor* rotating_cursor = nullptr;
    int last_button =0, last_button_action =0, last_button_mods =0;
-   std::unique_ptr<kd_tree_t> index;
+   std::unique_ptr<PointIndex> index;
+   std::shared_ptr<MappedPly> mapped_ply;
+   VertexFormat vertex_format = VertexFormat::PACKED;
+   std::vector<uint8_t> upload_buffer;         // vertices converted to vertex_format for upload
+   std::vector<QuantizedBlock> quantized_blocks; // VBO_VERTICES blocks (chunks) when QUANTIZED
+   const MappedPly::Property *mapped_red = nullptr, *mapped_green = nullptr, *mapped_blue = nullptr,
+                             *mapped_alpha = nullptr;
+
+   // Background loading (see start_loading). Chunks and extents are handed from the loader thread to the render
+   // thread under load_mutex, everything else in the loader is private to it until is_index_ready is set.
+   std::thread loader;
+   std::mutex load_mutex;
+   std::deque<LoadedChunk> loaded_chunks;
+   CloudExtents loaded_extents;
+   bool is_extents_update = false, is_load_complete = false;
+   std::atomic_bool is_loading{false}, is_index_ready{false}, must_stop_loading{false};
+   std::atomic<size_t> load_count{0};
+   size_t uploaded_count = 0;
+   VoxelGridOptions voxel_options;
+   VoxelGridResult voxels;
+   bool is_morton = false;
+   std::vector<uint64_t> load_order; // PLY indices in Morton order when is_morton
+   // PLY index of each point (voxels.index, load_order or in point_cache) if downsampled or reordered
+   const uint64_t* source_indices = nullptr;
+   OutlierOptions outlier_options;
+   std::vector<size_t> pending_outliers; // set by the loader, removed by the render thread when loading completes
+   std::vector<size_t> pending_removed; // removed by remove_points, flags written by on_render (write_removed_flags)
+   std::shared_ptr<PointCloudCache> point_cache;
+   bool use_cache = true;
+   unsigned index_threads = std::max(std::thread::hardware_concurrency(), 1u);
+
+   // Octree LOD rendering for large clouds (is_octree set by the loader before publishing any chunks)
+   struct GPUNode
+   {
+      GLuint vao = 0, vbo = 0;
+      size_t bytes = 0;
+      uint64_t frame = 0;
+      QuantizationBox box;
+   };
+   static constexpr size_t MAX_OCTREE_UPLOADS_PER_FRAME = 16;
+   size_t octree_threshold = 20000000, octree_point_budget = 5000000, octree_ram_budget = size_t(2) << 30,
+          octree_gpu_budget = size_t(1) << 30;
+   float octree_max_error = 1.5f;
+   std::atomic_bool is_octree{false}, is_octree_ready{false};
+   PointOctree octree;
+   std::unique_ptr<OctreeNodeCache> octree_cache;
+   std::unordered_map<uint32_t, GPUNode> gpu_nodes;
+   size_t gpu_bytes = 0, selected_count = 0;
+   QuantizationBox selected_box;
+   uint64_t frame_no = 0;
+   std::vector<uint32_t> visible_nodes;
 
    bool init_pointcloud();
    bool init_axes();
-   std::unique_ptr<GLfloat[]> load_pointcloud();
+   void start_loading();
+   void stop_loading();
+   bool load_pointcloud();
+   bool load_cached_pointcloud();
+   bool map_pointcloud();
+   template<typename F> bool load_chunks(size_t n, F fill);
+   template<typename Point, typename Color> size_t downsample(size_t n, Point point, Color color, bool is_color);
+   template<typename Point> void reorder(size_t n, Point point);
+   void send_match_points(std::vector<std::pair<Real3<float>, float>> match_points);
+   void find_outliers(const kd_tree_t& tree, size_t n, const float* cached_distances, std::vector<float>& distances);
+   void fill_mapped_vertices(GLfloat* vertices, size_t start, size_t n);
+   void upload_loaded_chunks();
+   bool open_octree();
+   bool open_octree_index();
+   std::unique_ptr<kd_tree_t> load_cached_index(const PointCloudCache& cache);
+   void render_octree();
+   void update_selection();
+   void write_selection_flags(size_t j, GLfloat sel);
+   void write_removed_flags();
+   void update_octree_selection();
+   void evict_gpu_nodes();
+   void set_extents(const CloudExtents& extents);
+   void set_quantization(const QuantizationBox* box);
    void rotation_update(double xpos, double ypos);
 
    static float angle_incr;
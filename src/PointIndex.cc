@@ -0,0 +1,87 @@
+#include <algorithm>
+#include <limits>
+
+#include "PointIndex.h"
+
+PointIndex::PointIndex(source_t& points_, std::unique_ptr<kd_tree_t> base_) :
+   points(points_), base(std::move(base_)), inserted_points{points_, points_.kdtree_get_point_count()},
+   inserted(new dynamic_tree_t(3, inserted_points, nanoflann::KDTreeSingleIndexAdaptorParams(10))),
+   removed((points_.kdtree_get_point_count() + 63) / 64, 0)
+//---------------------------------------------------------------------------------------------------
+{
+}
+
+size_t PointIndex::insert(const float* xyz, size_t n)
+//---------------------------------------------------
+{
+   const size_t first = size();
+   if (n == 0) return first;
+   for (size_t i=0; i<n; i++, xyz += 3)
+      points.append(xyz[0], xyz[1], xyz[2]);
+   removed.resize((size() + 63) / 64, 0);
+   inserted->addPoints(first - inserted_points.base, size() - inserted_points.base - 1);
+   return first;
+}
+
+bool PointIndex::remove(size_t i)
+//-------------------------------
+{
+   if ( (i >= size()) || (is_removed(i)) ) return false;
+   removed[i >> 6] |= uint64_t(1) << (i & 63);
+   removed_count++;
+   if (i >= inserted_points.base)
+      inserted->removePoint(i - inserted_points.base);
+   return true;
+}
+
+size_t PointIndex::radiusSearch(const float* query, float radius, std::vector<std::pair<size_t, float>>& matches,
+                                const nanoflann::SearchParams& params) const
+//---------------------------------------------------------------------------------------------------------------
+{
+   nanoflann::RadiusResultSet<float, size_t> results(radius, matches);
+   find_neighbors(results, query, params);
+   if (params.sorted)
+      std::sort(matches.begin(), matches.end(), nanoflann::IndexDist_Sorter());
+   return matches.size();
+}
+
+size_t PointIndex::knnSearch(const float* query, size_t k, size_t* indices, float* dists) const
+//---------------------------------------------------------------------------------------------
+{
+   nanoflann::KNNResultSet<float, size_t> results(k);
+   results.init(indices, dists);
+   find_neighbors(results, query, nanoflann::SearchParams());
+   return results.size();
+}
+
+size_t PointIndex::pick(const glm::vec3& O, const glm::vec3& ray, float radius2, size_t skip, float& dist) const
+//--------------------------------------------------------------------------------------------------------------
+{
+   auto excluded = [this, skip](size_t i) { return ( (i == skip) || (is_removed(i)) ); };
+   size_t hit = ray_pick_kdtree_if(*base, O, ray, radius2, excluded, dist);
+   const size_t offset = inserted_points.base;
+   for (const auto& tree : inserted->getAllIndices())
+   {
+      if (tree.vind.empty()) continue;
+      float d;
+      size_t i = ray_pick_kdtree_if(tree, O, ray, radius2, [&excluded, offset](size_t j) { return excluded(j + offset); },
+                                    d);
+      if (i >= inserted_points.kdtree_get_point_count()) continue;
+      i += offset;
+      if ( (d < dist) || ( (d == dist) && (i < hit) ) )
+      {
+         hit = i;
+         dist = d;
+      }
+   }
+   return std::min(hit, size());
+}
+
+size_t PointIndex::pick_brute_force(const glm::vec3& O, const glm::vec3& ray, float radius2, size_t skip,
+                                    float& dist) const
+//----------------------------------------------------------------------------------------------------------
+{
+   const float origin[3] = { O.x, O.y, O.z }, direction[3] = { ray.x, ray.y, ray.z };
+   return ray_pick_soa(points.coords[0], points.coords[1], points.coords[2], size(), origin, direction, radius2, skip,
+                       removed.data(), dist);
+}
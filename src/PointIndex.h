@@ -0,0 +1,116 @@
+#ifndef _POINTINDEX_H_
+#define _POINTINDEX_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <memory>
+#include <utility>
+
+#include "glm/glm.hpp"
+
+#include "PointCloudSource.h"
+#include "RayPick.h"
+#include "RayPickKernel.h"
+
+/*
+ * Editable spatial index over the points of a PointCloudFlannSource. The points present when the cloud is loaded stay
+ * in the static kd-tree (built or loaded from the point cloud cache as before) while points inserted later are
+ * appended to the source and indexed by a nanoflann KDTreeSingleIndexDynamicAdaptor, a logarithmic forest of kd-trees
+ * where an insert rebuilds only the smallest trees (amortized O(log^2 n)). Removal is lazy: removed points keep their
+ * index (and VBO slot) and are filtered from searches by a bitmap, so no edit ever rebuilds the static tree.
+ * radiusSearch and knnSearch have the same signatures and (squared) distance semantics as the nanoflann kd-tree.
+ */
+class PointIndex
+//==============
+{
+public:
+   typedef PointCloudFlannSource<float> source_t;
+
+   // base is a built (or loaded) kd-tree over all the points currently in points, which must outlive the index.
+   PointIndex(source_t& points, std::unique_ptr<kd_tree_t> base);
+   PointIndex(const PointIndex&) = delete;
+   PointIndex& operator=(const PointIndex&) = delete;
+
+   // Number of point indices handed out including removed points
+   size_t size() const { return points.kdtree_get_point_count(); }
+   size_t active_count() const { return size() - removed_count; }
+   size_t static_count() const { return inserted_points.base; }
+   bool is_removed(size_t i) const { return is_removed(removed, i); }
+   const kd_tree_t& static_index() const { return *base; }
+
+   // Inserts n points given as untransformed (as in the PLY file) x, y, z triples returning the index of the first.
+   size_t insert(const float* xyz, size_t n);
+   size_t insert(float x, float y, float z) { const float xyz[3] = { x, y, z }; return insert(xyz, 1); }
+
+   // Returns false if i was already removed.
+   bool remove(size_t i);
+
+   size_t radiusSearch(const float* query, float radius, std::vector<std::pair<size_t, float>>& matches,
+                       const nanoflann::SearchParams& params) const;
+
+   size_t knnSearch(const float* query, size_t k, size_t* indices, float* dists) const;
+
+   // Ray picking (see RayPick.h) over the points not removed, returns size() if nothing is hit. pick_brute_force uses
+   // the vectorized ray_pick_soa (RayPickKernel.h) with the removed bitmap as its exclusion mask.
+   size_t pick(const glm::vec3& O, const glm::vec3& ray, float radius2, size_t skip, float& dist) const;
+   size_t pick_brute_force(const glm::vec3& O, const glm::vec3& ray, float radius2, size_t skip, float& dist) const;
+
+private:
+   // The points inserted after the static tree was built, local index i being point base + i of the source.
+   struct InsertedPoints
+   {
+      const source_t& points;
+      size_t base;
+
+      inline size_t kdtree_get_point_count() const { return points.kdtree_get_point_count() - base; }
+      inline float kdtree_get_pt(const size_t i, int dim) const { return points.coords[dim][base + i]; }
+      Real3<float> get(size_t i) const { return points.get(base + i); }
+      template <class BBOX>
+      bool kdtree_get_bbox(BBOX& /* bb */) const { return false; }
+   };
+
+   typedef nanoflann::KDTreeSingleIndexDynamicAdaptor<nanoflann::L2_Simple_Adaptor<float, InsertedPoints>,
+                                                      InsertedPoints, 3> dynamic_tree_t;
+
+   static bool is_removed(const std::vector<uint64_t>& removed, size_t i)
+   {
+      return ((removed[i >> 6] >> (i & 63)) & 1) != 0;
+   }
+
+   // Forwards results from either tree to a nanoflann result set as source indices, dropping removed points.
+   template <typename ResultSet>
+   struct RemovedFilter
+   {
+      ResultSet& results;
+      const std::vector<uint64_t>& removed;
+      size_t offset;
+
+      inline bool full() const { return results.full(); }
+      inline float worstDist() const { return results.worstDist(); }
+      inline bool addPoint(float dist, size_t i)
+      {
+         i += offset;
+         if (is_removed(removed, i)) return true;
+         return results.addPoint(dist, i);
+      }
+   };
+
+   template <typename ResultSet>
+   void find_neighbors(ResultSet& results, const float* query, const nanoflann::SearchParams& params) const
+   {
+      RemovedFilter<ResultSet> filter{results, removed, 0};
+      if (base->size(*base) > 0)
+         base->findNeighbors(filter, query, params);
+      filter.offset = inserted_points.base;
+      inserted->findNeighbors(filter, query, params);
+   }
+
+   source_t& points;
+   std::unique_ptr<kd_tree_t> base;
+   InsertedPoints inserted_points;
+   std::unique_ptr<dynamic_tree_t> inserted;
+   std::vector<uint64_t> removed; // bitmap, point i being bit i % 64 of word i / 64
+   size_t removed_count = 0;
+};
+#endif //_POINTINDEX_H_
@@ -0,0 +1,431 @@
+#include "PointOctree.h"
+
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <cstdio>
+#include <iostream>
+#include <limits>
+#include <queue>
+#include <algorithm>
+
+static const char OCTREE_MAGIC[8] = { 'P', 'N', 'P', 'O', 'C', 'T', 'R', 'E' };
+
+inline uint64_t align64(uint64_t offset) { return (offset + 63) & ~static_cast<uint64_t>(63); }
+
+bool PointOctree::build(size_t n, const std::function<void(size_t, float*)>& get_point, std::vector<uint32_t>& order,
+                        const Params& params)
+//--------------------------------------------------------------------------------------------------------------------
+{
+   octree_nodes.clear();
+   points = 0;
+   if ( (n == 0) || (n > std::numeric_limits<uint32_t>::max()) )
+      return false;
+   float lo[3] = { std::numeric_limits<float>::max(), std::numeric_limits<float>::max(),
+                   std::numeric_limits<float>::max() };
+   float hi[3] = { std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest(),
+                   std::numeric_limits<float>::lowest() };
+   order.resize(n);
+   for (size_t i=0; i<n; i++)
+   {
+      float p[3];
+      get_point(i, p);
+      for (int d=0; d<3; d++)
+      {
+         lo[d] = std::min(lo[d], p[d]);
+         hi[d] = std::max(hi[d], p[d]);
+      }
+      order[i] = static_cast<uint32_t>(i);
+   }
+   // Cubic root so that child cubes (and the subsample grid cells) stay cubic
+   float side = std::max(std::max(hi[0] - lo[0], hi[1] - lo[1]), hi[2] - lo[2]);
+   side = std::max(side*1.0001f, std::numeric_limits<float>::min());
+
+   struct Task { int32_t node; size_t begin, end; };
+   std::vector<Task> tasks;
+   Node root{};
+   for (int d=0; d<3; d++) { root.min[d] = lo[d]; root.max[d] = lo[d] + side; }
+   octree_nodes.push_back(root);
+   tasks.push_back({0, 0, n});
+   std::vector<uint32_t> scratch;
+   std::vector<uint8_t> octant;
+   std::unordered_set<uint32_t> cells;
+   static constexpr uint8_t KEPT = 8; // octant value of the subsampled points
+   while (! tasks.empty())
+   {
+      const Task task = tasks.back();
+      tasks.pop_back();
+      Node& node = octree_nodes[task.node];
+      std::fill(node.children, node.children + 8, -1);
+      const size_t count = task.end - task.begin;
+      const float node_side = node.max[0] - node.min[0];
+      node.first = task.begin;
+      if ( (count <= params.leaf_capacity) || (node.level >= params.max_depth) )
+      {
+         node.count = count;
+         node.spacing = node_side / std::max(1.0f, std::cbrt(static_cast<float>(count)));
+         continue;
+      }
+
+      // One pass over the range keeps the first point falling in each subsample grid cell and assigns the rest to
+      // octants. The range is in ascending point order so get_point reads forward through the source.
+      const float cell_scale = SUBSAMPLE_GRID / node_side;
+      const float half[3] = { node.min[0] + node_side/2, node.min[1] + node_side/2, node.min[2] + node_side/2 };
+      cells.clear();
+      octant.resize(count);
+      size_t octant_count[8] = { 0 }, kept = 0;
+      for (size_t k=0; k<count; k++)
+      {
+         float p[3];
+         get_point(order[task.begin + k], p);
+         uint32_t key = 0;
+         for (int d=0; d<3; d++)
+         {
+            int c = static_cast<int>((p[d] - node.min[d]) * cell_scale);
+            c = std::min(std::max(c, 0), SUBSAMPLE_GRID - 1);
+            key = key*SUBSAMPLE_GRID + static_cast<uint32_t>(c);
+         }
+         if (cells.insert(key).second)
+         {
+            octant[k] = KEPT;
+            kept++;
+            continue;
+         }
+         const uint8_t o = static_cast<uint8_t>((p[0] >= half[0] ? 1 : 0) | (p[1] >= half[1] ? 2 : 0) |
+                                                (p[2] >= half[2] ? 4 : 0));
+         octant[k] = o;
+         octant_count[o]++;
+      }
+      node.count = kept;
+      node.spacing = node_side / SUBSAMPLE_GRID;
+
+      // Stable counting sort: the subsample at the front followed by the octants, each still in ascending order
+      size_t octant_start[8];
+      size_t start = task.begin + kept;
+      for (int o=0; o<8; o++) { octant_start[o] = start; start += octant_count[o]; }
+      scratch.assign(order.begin() + task.begin, order.begin() + task.end);
+      size_t fill[9];
+      std::copy(octant_start, octant_start + 8, fill);
+      fill[KEPT] = task.begin;
+      for (size_t k=0; k<count; k++)
+         order[fill[octant[k]]++] = scratch[k];
+
+      const uint32_t level = node.level;
+      const float node_min[3] = { node.min[0], node.min[1], node.min[2] };
+      for (int o=0; o<8; o++)
+      {
+         if (octant_count[o] == 0) continue;
+         Node child{};
+         for (int d=0; d<3; d++)
+         {
+            child.min[d] = ((o >> d) & 1) ? half[d] : node_min[d];
+            child.max[d] = child.min[d] + node_side/2;
+         }
+         child.level = level + 1;
+         const int32_t child_index = static_cast<int32_t>(octree_nodes.size());
+         octree_nodes[task.node].children[o] = child_index; // node reference invalidated by push_back
+         octree_nodes.push_back(child);
+         tasks.push_back({child_index, octant_start[o], octant_start[o] + octant_count[o]});
+      }
+   }
+   points = n;
+   return true;
+}
+
+bool PointOctree::write(const std::string& path, uint64_t ply_size, int64_t ply_mtime_ns,
+                        const std::vector<uint32_t>& order, const std::function<const float*(size_t)>& vertex,
+                        std::stringstream* errs)
+//---------------------------------------------------------------------------------------------------------------
+{
+   const std::string tmp_path = path + ".tmp";
+   FILE* fp = fopen(tmp_path.c_str(), "wb");
+   if (fp == nullptr)
+   {
+      if (errs) *errs << "PointOctree: Could not create " << tmp_path << ": " << strerror(errno);
+      return false;
+   }
+   header = Header{};
+   memcpy(header.magic, OCTREE_MAGIC, sizeof(OCTREE_MAGIC));
+   header.version = VERSION;
+   header.ply_size = ply_size;
+   header.ply_mtime_ns = ply_mtime_ns;
+   header.node_count = octree_nodes.size();
+   header.point_count = order.size();
+   header.nodes_offset = align64(sizeof(Header));
+   header.vertices_offset = align64(header.nodes_offset + header.node_count*sizeof(Node));
+   header.indices_offset = align64(header.vertices_offset + header.point_count*8*sizeof(float));
+   bool ok = (fwrite(&header, sizeof(Header), 1, fp) == 1) &&
+             (fseek(fp, static_cast<long>(header.nodes_offset), SEEK_SET) == 0) &&
+             (fwrite(octree_nodes.data(), sizeof(Node), octree_nodes.size(), fp) == octree_nodes.size()) &&
+             (fseek(fp, static_cast<long>(header.vertices_offset), SEEK_SET) == 0);
+   for (size_t k=0; (ok) && (k<order.size()); k++)
+      ok = (fwrite(vertex(order[k]), sizeof(float)*8, 1, fp) == 1);
+   ok = ok && (fseek(fp, static_cast<long>(header.indices_offset), SEEK_SET) == 0) &&
+        (fwrite(order.data(), sizeof(uint32_t), order.size(), fp) == order.size());
+   if ( (fclose(fp) != 0) || (! ok) || (rename(tmp_path.c_str(), path.c_str()) != 0) )
+   {
+      if (errs) *errs << "PointOctree: Error writing " << path;
+      unlink(tmp_path.c_str());
+      return false;
+   }
+   return true;
+}
+
+bool PointOctree::read(const std::string& path, uint64_t ply_size, int64_t ply_mtime_ns, std::stringstream* errs)
+//---------------------------------------------------------------------------------------------------------------
+{
+   octree_nodes.clear();
+   points = 0;
+   FILE* fp = fopen(path.c_str(), "rb");
+   if (fp == nullptr)
+      return false;
+   struct stat st;
+   bool ok = (fstat(fileno(fp), &st) == 0) && (fread(&header, sizeof(Header), 1, fp) == 1) &&
+             (memcmp(header.magic, OCTREE_MAGIC, sizeof(OCTREE_MAGIC)) == 0) && (header.version == VERSION) &&
+             (header.ply_size == ply_size) && (header.ply_mtime_ns == ply_mtime_ns) && (header.node_count > 0);
+   // The sections must lie within the file before the node table is allocated and the vertices are read from it
+   const uint64_t file_size = (ok) ? static_cast<uint64_t>(st.st_size) : 0;
+   auto is_within = [file_size](uint64_t offset, uint64_t count, uint64_t size) -> bool
+   {
+      return (offset <= file_size) && (count <= (file_size - offset) / size);
+   };
+   ok = (ok) && (is_within(header.nodes_offset, header.node_count, sizeof(Node))) &&
+        (is_within(header.vertices_offset, header.point_count, 8*sizeof(float))) &&
+        (is_within(header.indices_offset, header.point_count, sizeof(uint32_t))) &&
+        (header.node_count <= static_cast<uint64_t>(std::numeric_limits<int32_t>::max()));
+   if (ok)
+   {
+      octree_nodes.resize(header.node_count);
+      ok = (fseek(fp, static_cast<long>(header.nodes_offset), SEEK_SET) == 0) &&
+           (fread(octree_nodes.data(), sizeof(Node), octree_nodes.size(), fp) == octree_nodes.size());
+   }
+   fclose(fp);
+   // Children are appended after their parent (so select can't loop) and node ranges must lie within the points
+   for (size_t i=0; (ok) && (i<octree_nodes.size()); i++)
+   {
+      const Node& node = octree_nodes[i];
+      ok = (node.first <= header.point_count) && (node.count <= header.point_count - node.first);
+      for (int32_t child : node.children)
+         ok = (ok) && ( (child < 0) || ( (static_cast<size_t>(child) > i) &&
+                                         (static_cast<uint64_t>(child) < header.node_count) ) );
+   }
+   if (! ok)
+   {
+      if (errs) *errs << "PointOctree: " << path << " invalid or out of date";
+      octree_nodes.clear();
+      return false;
+   }
+   points = header.point_count;
+   return true;
+}
+
+void PointOctree::select(const float mvp[16], float projection_scale, float viewport_height, size_t point_budget,
+                         float max_error_pixels, std::vector<uint32_t>& visible) const
+//---------------------------------------------------------------------------------------------------------------
+{
+   visible.clear();
+   if (octree_nodes.empty()) return;
+   auto m = [mvp](int row, int col) { return mvp[col*4 + row]; };
+   // Frustum planes (Gribb & Hartmann): row3 +/- row0, row1, row2
+   float planes[6][4];
+   for (int i=0; i<3; i++)
+   {
+      for (int c=0; c<4; c++)
+      {
+         planes[i*2][c] = m(3, c) + m(i, c);
+         planes[i*2 + 1][c] = m(3, c) - m(i, c);
+      }
+   }
+   auto is_visible = [&planes](const Node& node) -> bool
+   {
+      for (const auto& pl : planes)
+      {
+         const float x = (pl[0] >= 0) ? node.max[0] : node.min[0];
+         const float y = (pl[1] >= 0) ? node.max[1] : node.min[1];
+         const float z = (pl[2] >= 0) ? node.max[2] : node.min[2];
+         if (pl[0]*x + pl[1]*y + pl[2]*z + pl[3] < 0)
+            return false;
+      }
+      return true;
+   };
+   const float pixels_per_unit = projection_scale * viewport_height / 2; // at distance 1
+   // Projected size (pixels) of length at the distance (clip w) of the node centre
+   auto projected = [&](const Node& node, float length) -> float
+   {
+      float c[3];
+      float radius = 0;
+      for (int d=0; d<3; d++)
+      {
+         c[d] = (node.min[d] + node.max[d]) / 2;
+         radius += (node.max[d] - node.min[d])*(node.max[d] - node.min[d]);
+      }
+      radius = std::sqrt(radius) / 2;
+      const float w = m(3, 0)*c[0] + m(3, 1)*c[1] + m(3, 2)*c[2] + m(3, 3);
+      if (w <= radius) // eye inside or very close to the node
+         return std::numeric_limits<float>::max();
+      return length * pixels_per_unit / w;
+   };
+
+   typedef std::pair<float, uint32_t> Candidate; // projected node size, node
+   std::priority_queue<Candidate> queue;
+   const Node& root = octree_nodes[0];
+   if (! is_visible(root)) return;
+   queue.push(Candidate(projected(root, root.max[0] - root.min[0]), 0));
+   size_t total = 0;
+   while (! queue.empty())
+   {
+      const uint32_t i = queue.top().second;
+      queue.pop();
+      const Node& node = octree_nodes[i];
+      if ( (total + node.count > point_budget) && (! visible.empty()) )
+         break;
+      visible.push_back(i);
+      total += node.count;
+      if (projected(node, node.spacing) <= max_error_pixels)
+         continue;
+      for (int32_t child : node.children)
+      {
+         if (child < 0) continue;
+         const Node& cn = octree_nodes[child];
+         if (is_visible(cn))
+            queue.push(Candidate(projected(cn, cn.max[0] - cn.min[0]), static_cast<uint32_t>(child)));
+      }
+   }
+}
+
+bool OctreeNodeCache::open(const std::string& path, const PointOctree& octree, size_t budget_bytes,
+                           std::stringstream* errs)
+//-------------------------------------------------------------------------------------------------------------
+{
+   close();
+   fd = ::open(path.c_str(), O_RDONLY);
+   if (fd < 0)
+   {
+      if (errs) *errs << "OctreeNodeCache: Could not open " << path << ": " << strerror(errno);
+      return false;
+   }
+   tree = &octree;
+   budget = budget_bytes;
+   must_stop = false;
+   io_thread = std::thread(&OctreeNodeCache::io, this);
+   return true;
+}
+
+void OctreeNodeCache::close()
+//---------------------------
+{
+   {
+      std::lock_guard<std::mutex> lock(mutex);
+      must_stop = true;
+   }
+   cv.notify_all();
+   if (io_thread.joinable())
+      io_thread.join();
+   if (fd >= 0)
+      ::close(fd);
+   fd = -1;
+   pending.clear();
+   queued.clear();
+   failed.clear();
+   resident.clear();
+   lru.clear();
+   bytes = 0;
+}
+
+bool OctreeNodeCache::request(uint32_t node)
+//------------------------------------------
+{
+   {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (failed.find(node) != failed.end())
+         return false;
+      if ( (resident.find(node) != resident.end()) || (! queued.insert(node).second) )
+         return true;
+      pending.push_back(node);
+   }
+   cv.notify_one();
+   return true;
+}
+
+std::shared_ptr<const std::vector<float>> OctreeNodeCache::get(uint32_t node)
+//---------------------------------------------------------------------------
+{
+   std::lock_guard<std::mutex> lock(mutex);
+   auto it = resident.find(node);
+   if (it == resident.end())
+      return nullptr;
+   lru.splice(lru.begin(), lru, it->second.lru_pos);
+   return it->second.vertices;
+}
+
+void OctreeNodeCache::io()
+//------------------------
+{
+   const uint64_t vertices_offset = tree->file_header().vertices_offset;
+   while (true)
+   {
+      uint32_t node;
+      {
+         std::unique_lock<std::mutex> lock(mutex);
+         cv.wait(lock, [this]() { return (must_stop) || (! pending.empty()); });
+         if (must_stop) return;
+         // Most recent requests are the most relevant to the current view
+         node = pending.back();
+         pending.pop_back();
+      }
+      const PointOctree::Node& n = tree->node(node);
+      std::shared_ptr<std::vector<float>> vertices = std::make_shared<std::vector<float>>(n.count*8);
+      const size_t size = n.count*8*sizeof(float);
+      off_t offset = static_cast<off_t>(vertices_offset + n.first*8*sizeof(float));
+      size_t done = 0;
+      int err = 0;
+      char* dest = reinterpret_cast<char*>(vertices->data());
+      while (done < size)
+      {
+         ssize_t r = pread(fd, dest + done, size - done, offset + static_cast<off_t>(done));
+         if (r <= 0)
+         {
+            if ( (r < 0) && (errno == EINTR) ) continue;
+            err = (r < 0) ? errno : 0;
+            break;
+         }
+         done += static_cast<size_t>(r);
+      }
+      std::lock_guard<std::mutex> lock(mutex);
+      queued.erase(node);
+      if (done != size)
+      {
+         // Not requested again, else the renderer would keep waiting for the node
+         failed.insert(node);
+         if (failed.size() == 1)
+            std::cerr << "OctreeNodeCache: Error reading octree node " << node << " ("
+                      << ((err != 0) ? strerror(err) : "unexpected end of file")
+                      << "), nodes which can't be read are not drawn" << std::endl;
+         continue;
+      }
+      lru.push_front(node);
+      resident[node] = Entry{vertices, lru.begin()};
+      bytes += size;
+      evict();
+   }
+}
+
+void OctreeNodeCache::evict()
+//---------------------------
+{
+   while ( (bytes > budget) && (lru.size() > 1) )
+   {
+      const uint32_t node = lru.back();
+      lru.pop_back();
+      auto it = resident.find(node);
+      if (it != resident.end())
+      {
+         bytes -= it->second.vertices->size()*sizeof(float);
+         resident.erase(it);
+      }
+   }
+}
@@ -0,0 +1,152 @@
+#ifndef _POINTOCTREE_H_
+#define _POINTOCTREE_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <sstream>
+#include <vector>
+#include <list>
+#include <deque>
+#include <unordered_map>
+#include <unordered_set>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+#include <functional>
+
+/*
+ * Level of detail octree for point clouds which are too large to be uploaded to the GPU in full.
+ * Each inner node holds a spatially uniform subsample of the points in its cube (at most one point per cell of a
+ * SUBSAMPLE_GRID^3 grid) and passes the remainder on to its children, so a node together with all its ancestors is a
+ * progressively denser representation of its region (additive LOD). Leaves hold the remaining points.
+ * The octree is stored in a file (<plyfile>.pnpoctree) containing the node table followed by the vertices (in the
+ * 8 float VBO layout used by PointCloudWin) reordered so that the points of every node are contiguous, followed by
+ * the original index of each reordered point. Nodes are then streamed from disk into a RAM LRU (OctreeNodeCache)
+ * on a background thread as they are selected for display (see select).
+ */
+class PointOctree
+//===============
+{
+public:
+   static constexpr uint32_t VERSION = 1;
+   static constexpr int SUBSAMPLE_GRID = 64;
+
+   struct Node
+   {
+      float min[3], max[3];
+      int32_t children[8];
+      uint64_t first, count; // range in the reordered point order
+      uint32_t level;
+      float spacing;        // approximate distance between the points of the node
+   };
+
+   struct Header
+   {
+      char magic[8];
+      uint32_t version, reserved;
+      uint64_t ply_size;
+      int64_t ply_mtime_ns;
+      uint64_t node_count, point_count, nodes_offset, vertices_offset, indices_offset;
+   };
+
+   struct Params
+   {
+      size_t leaf_capacity = 65536;
+      uint32_t max_depth = 21;
+   };
+
+   /*
+    * Builds the octree for n points. get_point(i, xyz) must return the (transformed, as displayed) coordinates of
+    * point i. order receives the original index of each point in octree order. The positions are not copied: the
+    * build makes one pass over the points of each inner node (a pass per level over the cloud), calling get_point in
+    * ascending i within a node, so a memory mapped source (the point cloud cache vertex block) is read forwards and
+    * only order and the partition scratch space (5 bytes per point of the node being split) are held in memory.
+    */
+   bool build(size_t n, const std::function<void(size_t, float*)>& get_point, std::vector<uint32_t>& order,
+              const Params& params);
+   bool build(size_t n, const std::function<void(size_t, float*)>& get_point, std::vector<uint32_t>& order)
+   {
+      return build(n, get_point, order, Params());
+   }
+
+   // Writes the octree file. vertex(i) must return the 8 float vertex of original point i.
+   bool write(const std::string& path, uint64_t ply_size, int64_t ply_mtime_ns, const std::vector<uint32_t>& order,
+              const std::function<const float*(size_t)>& vertex, std::stringstream* errs =nullptr);
+
+   /*
+    * Reads the node table of an octree file if it matches the PLY file size and modification time. The section
+    * offsets are checked against the file size and the child indices and point ranges of the nodes against the
+    * header, so a truncated or corrupt file is rejected (and rebuilt by the caller).
+    */
+   bool read(const std::string& path, uint64_t ply_size, int64_t ply_mtime_ns, std::stringstream* errs =nullptr);
+
+   const std::vector<Node>& nodes() const { return octree_nodes; }
+   const Node& node(size_t i) const { return octree_nodes[i]; }
+   size_t point_count() const { return points; }
+   const Header& file_header() const { return header; }
+
+   /*
+    * Chooses the nodes to draw. mvp is the column major (as glm) model-view-projection matrix, projection_scale is
+    * P[1][1] (1/tan(fovy/2)) and viewport_height is in pixels. Nodes outside the frustum are culled and nodes are
+    * refined in order of their projected size while the projected point spacing of the parent exceeds
+    * max_error_pixels and the total point count stays within point_budget. The root is always included if visible.
+    */
+   void select(const float mvp[16], float projection_scale, float viewport_height, size_t point_budget,
+               float max_error_pixels, std::vector<uint32_t>& visible) const;
+
+   static std::string octree_path(const std::string& plyfile) { return plyfile + ".pnpoctree"; }
+
+private:
+   std::vector<Node> octree_nodes;
+   size_t points = 0;
+   Header header{};
+};
+
+/*
+ * RAM LRU cache of octree node vertex blocks read from the octree file on a background thread. request() queues
+ * a node for loading (without blocking), get() returns the vertices of a resident node (and marks it as recently
+ * used). The cache evicts least recently used nodes when the total size exceeds the budget.
+ */
+class OctreeNodeCache
+//===================
+{
+public:
+   OctreeNodeCache() = default;
+   OctreeNodeCache(const OctreeNodeCache&) = delete;
+   OctreeNodeCache& operator=(const OctreeNodeCache&) = delete;
+   ~OctreeNodeCache() { close(); }
+
+   bool open(const std::string& path, const PointOctree& octree, size_t budget_bytes, std::stringstream* errs =nullptr);
+   void close();
+
+   // Returns false (without queuing it) if reading the node failed, in which case it can't be drawn.
+   bool request(uint32_t node);
+   // Returns null if the node is not resident.
+   std::shared_ptr<const std::vector<float>> get(uint32_t node);
+   size_t resident_bytes() const { return bytes; }
+
+private:
+   int fd = -1;
+   const PointOctree* tree = nullptr;
+   size_t budget = 0, bytes = 0;
+   std::mutex mutex;
+   std::condition_variable cv;
+   std::deque<uint32_t> pending;
+   std::unordered_set<uint32_t> queued, failed;
+   std::list<uint32_t> lru;
+   struct Entry
+   {
+      std::shared_ptr<const std::vector<float>> vertices;
+      std::list<uint32_t>::iterator lru_pos;
+   };
+   std::unordered_map<uint32_t, Entry> resident;
+   std::thread io_thread;
+   bool must_stop = false;
+
+   void io();
+   void evict();
+};
+#endif //_POINTOCTREE_H_
@@ -0,0 +1,182 @@
+#ifndef _RAYPICK_H_
+#define _RAYPICK_H_
+
+#include <cstddef>
+#include <cmath>
+#include <limits>
+#include <queue>
+#include <initializer_list>
+#include <vector>
+#include <algorithm>
+
+#include "glm/glm.hpp"
+
+/*
+ * Picking of the point nearest to the ray origin O within radius2 (squared) of the line through O with (unit)
+ * direction ray. Points closer to O win, ties go to the lower index and the point at index skip is never picked.
+ * ray_pick_kdtree traverses a nanoflann kd-tree best first, culling nodes whose bounding box (grown by the pick
+ * radius) the line misses or which are further from O than the current hit, while ray_pick_brute_force tests every
+ * point and is kept as the reference implementation (see RayPickMode). Both return the point count if nothing is hit.
+ * The _if variants take a predicate excluding points by index instead of a single skipped index (see PointIndex).
+ */
+enum class RayPickMode { KDTREE, BRUTE_FORCE, VERIFY };
+
+template <typename Source, typename Excluded>
+size_t ray_pick_brute_force_if(const Source& points, const glm::vec3& O, const glm::vec3& ray, float radius2,
+                               Excluded excluded, float& dist)
+//-------------------------------------------------------------------------------------------------------------
+{
+   const size_t n = points.kdtree_get_point_count();
+   size_t hit = n;
+   dist = std::numeric_limits<float>::max();
+   for (size_t i=0; i<n; i++)
+   {
+      if (excluded(i)) continue;
+      auto p = points.get(i);
+      glm::vec3 C(p.x, p.y, p.z);
+      glm::vec3 OC = O - C;
+      float b = glm::dot(ray, OC);
+      float c = glm::dot(OC, OC) - radius2;
+      float disc2 = b*b - c;
+      if (disc2 >= 0)
+      {
+         float d = glm::distance(O, C);
+         if (d < dist)
+         {
+            hit = i;
+            dist = d;
+         }
+      }
+   }
+   return hit;
+}
+
+template <typename Source>
+size_t ray_pick_brute_force(const Source& points, const glm::vec3& O, const glm::vec3& ray, float radius2,
+                            size_t skip, float& dist)
+//----------------------------------------------------------------------------------------------------------------
+{
+   return ray_pick_brute_force_if(points, O, ray, radius2, [skip](size_t i) { return (i == skip); }, dist);
+}
+
+namespace raypick_detail
+{
+   struct Box { float lo[3], hi[3]; };
+
+   // Does the line O + t*ray (any t) pass through box grown by r ?
+   inline bool line_hits_box(const glm::vec3& O, const glm::vec3& ray, const Box& box, float r)
+   {
+      float tmin = std::numeric_limits<float>::lowest(), tmax = std::numeric_limits<float>::max();
+      for (int d=0; d<3; d++)
+      {
+         const float lo = box.lo[d] - r, hi = box.hi[d] + r;
+         if (std::fabs(ray[d]) < 1e-12f)
+         {
+            if ( (O[d] < lo) || (O[d] > hi) ) return false;
+            continue;
+         }
+         float t1 = (lo - O[d]) / ray[d], t2 = (hi - O[d]) / ray[d];
+         if (t1 > t2) std::swap(t1, t2);
+         tmin = std::max(tmin, t1);
+         tmax = std::min(tmax, t2);
+         if (tmin > tmax) return false;
+      }
+      return true;
+   }
+
+   // Lower bound of the distance from O to any point in box
+   inline float distance_to_box(const glm::vec3& O, const Box& box)
+   {
+      float d2 = 0;
+      for (int d=0; d<3; d++)
+      {
+         const float e = (O[d] < box.lo[d]) ? box.lo[d] - O[d] : ((O[d] > box.hi[d]) ? O[d] - box.hi[d] : 0.0f);
+         d2 += e*e;
+      }
+      return std::sqrt(d2);
+   }
+}
+
+template <typename KDTree, typename Excluded>
+size_t ray_pick_kdtree_if(const KDTree& index, const glm::vec3& O, const glm::vec3& ray, float radius2,
+                          Excluded excluded, float& dist)
+//--------------------------------------------------------------------------------------------------------
+{
+   using namespace raypick_detail;
+   typedef typename KDTree::NodePtr NodePtr;
+   struct Candidate
+   {
+      float lower;
+      NodePtr node;
+      Box box;
+      bool operator<(const Candidate& other) const { return lower > other.lower; } // min heap on lower
+   };
+
+   const auto& points = index.dataset;
+   const size_t n = points.kdtree_get_point_count();
+   size_t hit = n;
+   dist = std::numeric_limits<float>::max();
+   if ( (index.root_node == nullptr) || (n == 0) ) return hit;
+   const float r = std::sqrt(radius2)*1.0001f + 1e-6f; // grown slightly so rounding cannot cull a boundary hit
+   Box root;
+   for (int d=0; d<3; d++)
+   {
+      root.lo[d] = index.root_bbox[d].low;
+      root.hi[d] = index.root_bbox[d].high;
+   }
+   std::priority_queue<Candidate> queue;
+   if (line_hits_box(O, ray, root, r))
+      queue.push(Candidate{distance_to_box(O, root), index.root_node, root});
+   while (! queue.empty())
+   {
+      Candidate candidate = queue.top();
+      queue.pop();
+      if (candidate.lower > dist)
+         break;
+      const NodePtr node = candidate.node;
+      if ( (node->child1 == nullptr) && (node->child2 == nullptr) )
+      {
+         for (size_t j=node->node_type.lr.left; j<node->node_type.lr.right; j++)
+         {
+            const size_t i = index.vind[j];
+            if (excluded(i)) continue;
+            auto p = points.get(i);
+            glm::vec3 C(p.x, p.y, p.z);
+            glm::vec3 OC = O - C;
+            float b = glm::dot(ray, OC);
+            float c = glm::dot(OC, OC) - radius2;
+            if (b*b - c >= 0)
+            {
+               float d = glm::distance(O, C);
+               if ( (d < dist) || ( (d == dist) && (i < hit) ) )
+               {
+                  hit = i;
+                  dist = d;
+               }
+            }
+         }
+         continue;
+      }
+      const int feat = node->node_type.sub.divfeat;
+      Candidate child1{0, node->child1, candidate.box}, child2{0, node->child2, candidate.box};
+      child1.box.hi[feat] = std::min(child1.box.hi[feat], static_cast<float>(node->node_type.sub.divlow));
+      child2.box.lo[feat] = std::max(child2.box.lo[feat], static_cast<float>(node->node_type.sub.divhigh));
+      for (Candidate* child : { &child1, &child2 })
+      {
+         if (! line_hits_box(O, ray, child->box, r)) continue;
+         child->lower = distance_to_box(O, child->box);
+         if (child->lower <= dist)
+            queue.push(*child);
+      }
+   }
+   return hit;
+}
+
+template <typename KDTree>
+size_t ray_pick_kdtree(const KDTree& index, const glm::vec3& O, const glm::vec3& ray, float radius2, size_t skip,
+                       float& dist)
+//-----------------------------------------------------------------------------------------------------------------
+{
+   return ray_pick_kdtree_if(index, O, ray, radius2, [skip](size_t i) { return (i == skip); }, dist);
+}
+#endif //_RAYPICK_H_
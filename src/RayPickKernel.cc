@@ -0,0 +1,262 @@
+#include "RayPickKernel.h"
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define RAYPICK_X86
+#include <immintrin.h>
+#endif
+
+// Keep the compiler from fusing the multiplies and adds (the AVX-512 target implies FMA) so the kernels round as the
+// scalar loop does and pick the same point when one lies on the radius boundary (checked by RayPickMode::VERIFY).
+#if defined(__clang__)
+#pragma clang fp contract(off)
+#elif defined(__GNUC__)
+#pragma GCC optimize("fp-contract=off")
+#endif
+
+// Indices within a kernel call are kept in 32 bit SIMD lanes so ray_pick_soa hands the kernels blocks of at most
+// BLOCK_SIZE points. skip is local to the block (-1 if not in it), excluded (nullptr if none) is the exclusion bitmap
+// from the start of the block (BLOCK_SIZE being a multiple of 64 and the SIMD loops starting at 0, the bits of a
+// vector never straddle two words) and the kernels return the squared distance.
+static constexpr size_t BLOCK_SIZE = size_t(1) << 30;
+
+typedef long (*pick_kernel_t)(const float* x, const float* y, const float* z, long n, const float O[3],
+                              const float ray[3], float radius2, long skip, const uint64_t* excluded, float& best_d2);
+
+// The lanes bits of the exclusion bitmap starting at point i
+static inline unsigned excluded_bits(const uint64_t* excluded, long i, unsigned lanes_mask)
+{
+   return static_cast<unsigned>(excluded[i >> 6] >> (i & 63)) & lanes_mask;
+}
+
+static long pick_scalar(const float* x, const float* y, const float* z, long start, long n, const float O[3],
+                        const float ray[3], float radius2, long skip, const uint64_t* excluded, long hit,
+                        float& best_d2)
+//-----------------------------------------------------------------------------------------------------------
+{
+   for (long i=start; i<n; i++)
+   {
+      if ( (i == skip) || ( (excluded != nullptr) && (excluded_bits(excluded, i, 1)) ) ) continue;
+      const float dx = O[0] - x[i], dy = O[1] - y[i], dz = O[2] - z[i];
+      const float b = ray[0]*dx + ray[1]*dy + ray[2]*dz;
+      const float d2 = dx*dx + dy*dy + dz*dz;
+      if ( (b*b - (d2 - radius2) >= 0) && (d2 < best_d2) )
+      {
+         hit = i;
+         best_d2 = d2;
+      }
+   }
+   return hit;
+}
+
+#ifdef RAYPICK_X86
+// Reduces the per lane minima, ties going to the lowest index as in the scalar loop.
+static long reduce_lanes(const float* d2, const int* indices, int lanes, float& best_d2)
+//--------------------------------------------------------------------------------------
+{
+   long hit = -1;
+   best_d2 = std::numeric_limits<float>::max();
+   for (int l=0; l<lanes; l++)
+   {
+      if (indices[l] < 0) continue;
+      if ( (d2[l] < best_d2) || ( (d2[l] == best_d2) && (indices[l] < hit) ) )
+      {
+         best_d2 = d2[l];
+         hit = indices[l];
+      }
+   }
+   return hit;
+}
+
+static long pick_sse2(const float* x, const float* y, const float* z, long n, const float O[3],
+                      const float ray[3], float radius2, long skip, const uint64_t* excluded, float& best_d2)
+//-------------------------------------------------------------------------------------------------
+{
+   const __m128i lane_bits = _mm_setr_epi32(1, 2, 4, 8);
+   const __m128 ox = _mm_set1_ps(O[0]), oy = _mm_set1_ps(O[1]), oz = _mm_set1_ps(O[2]);
+   const __m128 rx = _mm_set1_ps(ray[0]), ry = _mm_set1_ps(ray[1]), rz = _mm_set1_ps(ray[2]);
+   const __m128 r2 = _mm_set1_ps(radius2), zero = _mm_setzero_ps();
+   const __m128i step = _mm_set1_epi32(4), skipv = _mm_set1_epi32(static_cast<int>(skip));
+   __m128 best = _mm_set1_ps(std::numeric_limits<float>::max());
+   __m128i best_i = _mm_set1_epi32(-1), idx = _mm_setr_epi32(0, 1, 2, 3);
+   long i = 0;
+   for (; i+4<=n; i+=4)
+   {
+      const __m128 dx = _mm_sub_ps(ox, _mm_loadu_ps(x + i)), dy = _mm_sub_ps(oy, _mm_loadu_ps(y + i)),
+                   dz = _mm_sub_ps(oz, _mm_loadu_ps(z + i));
+      const __m128 b = _mm_add_ps(_mm_add_ps(_mm_mul_ps(rx, dx), _mm_mul_ps(ry, dy)), _mm_mul_ps(rz, dz));
+      const __m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+      const __m128 disc = _mm_sub_ps(_mm_mul_ps(b, b), _mm_sub_ps(d2, r2));
+      __m128 m = _mm_and_ps(_mm_cmpge_ps(disc, zero), _mm_cmplt_ps(d2, best));
+      m = _mm_andnot_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(idx, skipv)), m);
+      if (excluded != nullptr)
+      {
+         const __m128i bits = _mm_set1_epi32(static_cast<int>(excluded_bits(excluded, i, 0xF)));
+         const __m128i is_excluded = _mm_cmpeq_epi32(_mm_and_si128(bits, lane_bits), lane_bits);
+         m = _mm_andnot_ps(_mm_castsi128_ps(is_excluded), m);
+      }
+      best = _mm_or_ps(_mm_and_ps(m, d2), _mm_andnot_ps(m, best));
+      const __m128i mi = _mm_castps_si128(m);
+      best_i = _mm_or_si128(_mm_and_si128(mi, idx), _mm_andnot_si128(mi, best_i));
+      idx = _mm_add_epi32(idx, step);
+   }
+   alignas(16) float d2s[4];
+   alignas(16) int indices[4];
+   _mm_store_ps(d2s, best);
+   _mm_store_si128(reinterpret_cast<__m128i*>(indices), best_i);
+   long hit = reduce_lanes(d2s, indices, 4, best_d2);
+   return pick_scalar(x, y, z, i, n, O, ray, radius2, skip, excluded, hit, best_d2);
+}
+
+__attribute__((target("avx2")))
+static long pick_avx2(const float* x, const float* y, const float* z, long n, const float O[3],
+                      const float ray[3], float radius2, long skip, const uint64_t* excluded, float& best_d2)
+//-------------------------------------------------------------------------------------------------
+{
+   const __m256i lane_bits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+   const __m256 ox = _mm256_set1_ps(O[0]), oy = _mm256_set1_ps(O[1]), oz = _mm256_set1_ps(O[2]);
+   const __m256 rx = _mm256_set1_ps(ray[0]), ry = _mm256_set1_ps(ray[1]), rz = _mm256_set1_ps(ray[2]);
+   const __m256 r2 = _mm256_set1_ps(radius2), zero = _mm256_setzero_ps();
+   const __m256i step = _mm256_set1_epi32(8), skipv = _mm256_set1_epi32(static_cast<int>(skip));
+   __m256 best = _mm256_set1_ps(std::numeric_limits<float>::max());
+   __m256i best_i = _mm256_set1_epi32(-1), idx = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+   long i = 0;
+   for (; i+8<=n; i+=8)
+   {
+      const __m256 dx = _mm256_sub_ps(ox, _mm256_loadu_ps(x + i)), dy = _mm256_sub_ps(oy, _mm256_loadu_ps(y + i)),
+                   dz = _mm256_sub_ps(oz, _mm256_loadu_ps(z + i));
+      const __m256 b = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(rx, dx), _mm256_mul_ps(ry, dy)),
+                                     _mm256_mul_ps(rz, dz));
+      const __m256 d2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)),
+                                      _mm256_mul_ps(dz, dz));
+      const __m256 disc = _mm256_sub_ps(_mm256_mul_ps(b, b), _mm256_sub_ps(d2, r2));
+      __m256 m = _mm256_and_ps(_mm256_cmp_ps(disc, zero, _CMP_GE_OQ), _mm256_cmp_ps(d2, best, _CMP_LT_OQ));
+      m = _mm256_andnot_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(idx, skipv)), m);
+      if (excluded != nullptr)
+      {
+         const __m256i bits = _mm256_set1_epi32(static_cast<int>(excluded_bits(excluded, i, 0xFF)));
+         const __m256i is_excluded = _mm256_cmpeq_epi32(_mm256_and_si256(bits, lane_bits), lane_bits);
+         m = _mm256_andnot_ps(_mm256_castsi256_ps(is_excluded), m);
+      }
+      best = _mm256_blendv_ps(best, d2, m);
+      best_i = _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(best_i), _mm256_castsi256_ps(idx), m));
+      idx = _mm256_add_epi32(idx, step);
+   }
+   alignas(32) float d2s[8];
+   alignas(32) int indices[8];
+   _mm256_store_ps(d2s, best);
+   _mm256_store_si256(reinterpret_cast<__m256i*>(indices), best_i);
+   long hit = reduce_lanes(d2s, indices, 8, best_d2);
+   return pick_scalar(x, y, z, i, n, O, ray, radius2, skip, excluded, hit, best_d2);
+}
+
+__attribute__((target("avx512f")))
+static long pick_avx512(const float* x, const float* y, const float* z, long n, const float O[3],
+                        const float ray[3], float radius2, long skip, const uint64_t* excluded, float& best_d2)
+//---------------------------------------------------------------------------------------------------
+{
+   const __m512 ox = _mm512_set1_ps(O[0]), oy = _mm512_set1_ps(O[1]), oz = _mm512_set1_ps(O[2]);
+   const __m512 rx = _mm512_set1_ps(ray[0]), ry = _mm512_set1_ps(ray[1]), rz = _mm512_set1_ps(ray[2]);
+   const __m512 r2 = _mm512_set1_ps(radius2), zero = _mm512_setzero_ps();
+   const __m512i step = _mm512_set1_epi32(16), skipv = _mm512_set1_epi32(static_cast<int>(skip));
+   __m512 best = _mm512_set1_ps(std::numeric_limits<float>::max());
+   __m512i best_i = _mm512_set1_epi32(-1),
+           idx = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+   long i = 0;
+   for (; i+16<=n; i+=16)
+   {
+      const __m512 dx = _mm512_sub_ps(ox, _mm512_loadu_ps(x + i)), dy = _mm512_sub_ps(oy, _mm512_loadu_ps(y + i)),
+                   dz = _mm512_sub_ps(oz, _mm512_loadu_ps(z + i));
+      const __m512 b = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(rx, dx), _mm512_mul_ps(ry, dy)),
+                                     _mm512_mul_ps(rz, dz));
+      const __m512 d2 = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(dx, dx), _mm512_mul_ps(dy, dy)),
+                                      _mm512_mul_ps(dz, dz));
+      const __m512 disc = _mm512_sub_ps(_mm512_mul_ps(b, b), _mm512_sub_ps(d2, r2));
+      __mmask16 m = _mm512_cmp_ps_mask(disc, zero, _CMP_GE_OQ) & _mm512_cmp_ps_mask(d2, best, _CMP_LT_OQ) &
+                    _mm512_cmpneq_epi32_mask(idx, skipv);
+      if (excluded != nullptr)
+         m &= static_cast<__mmask16>(~excluded_bits(excluded, i, 0xFFFF));
+      best = _mm512_mask_blend_ps(m, best, d2);
+      best_i = _mm512_mask_blend_epi32(m, best_i, idx);
+      idx = _mm512_add_epi32(idx, step);
+   }
+   alignas(64) float d2s[16];
+   alignas(64) int indices[16];
+   _mm512_store_ps(d2s, best);
+   _mm512_store_si512(indices, best_i);
+   long hit = reduce_lanes(d2s, indices, 16, best_d2);
+   return pick_scalar(x, y, z, i, n, O, ray, radius2, skip, excluded, hit, best_d2);
+}
+#else
+static long pick_scalar_kernel(const float* x, const float* y, const float* z, long n, const float O[3],
+                               const float ray[3], float radius2, long skip, const uint64_t* excluded,
+                               float& best_d2)
+//------------------------------------------------------------------------------------------------------
+{
+   best_d2 = std::numeric_limits<float>::max();
+   return pick_scalar(x, y, z, 0, n, O, ray, radius2, skip, excluded, -1, best_d2);
+}
+#endif
+
+struct PickKernel
+{
+   pick_kernel_t kernel;
+   const char* name;
+};
+
+static PickKernel select_kernel()
+//-------------------------------
+{
+#ifdef RAYPICK_X86
+   __builtin_cpu_init();
+   if (__builtin_cpu_supports("avx512f"))
+      return PickKernel{ pick_avx512, "avx512" };
+   if (__builtin_cpu_supports("avx2"))
+      return PickKernel{ pick_avx2, "avx2" };
+   return PickKernel{ pick_sse2, "sse2" };
+#else
+   return PickKernel{ pick_scalar_kernel, "scalar" };
+#endif
+}
+
+static const PickKernel& kernel()
+{
+   static const PickKernel selected = select_kernel();
+   return selected;
+}
+
+const char* ray_pick_soa_kernel() { return kernel().name; }
+
+size_t ray_pick_soa(const float* x, const float* y, const float* z, size_t n, const float O[3], const float ray[3],
+                    float radius2, size_t skip, float& dist)
+//------------------------------------------------------------------------------------------------------------------
+{
+   return ray_pick_soa(x, y, z, n, O, ray, radius2, skip, nullptr, dist);
+}
+
+size_t ray_pick_soa(const float* x, const float* y, const float* z, size_t n, const float O[3], const float ray[3],
+                    float radius2, size_t skip, const uint64_t* excluded, float& dist)
+//------------------------------------------------------------------------------------------------------------------
+{
+   const pick_kernel_t pick = kernel().kernel;
+   size_t hit = n;
+   float best_d2 = std::numeric_limits<float>::max();
+   for (size_t base=0; base<n; base+=BLOCK_SIZE)
+   {
+      const size_t count = std::min(BLOCK_SIZE, n - base);
+      const long local_skip = ( (skip >= base) && (skip < base + count) ) ? static_cast<long>(skip - base) : -1;
+      float d2;
+      const long block_hit = pick(x + base, y + base, z + base, static_cast<long>(count), O, ray, radius2,
+                                  local_skip, (excluded != nullptr) ? excluded + base/64 : nullptr, d2);
+      if ( (block_hit >= 0) && (d2 < best_d2) )
+      {
+         best_d2 = d2;
+         hit = base + static_cast<size_t>(block_hit);
+      }
+   }
+   dist = (hit < n) ? std::sqrt(best_d2) : std::numeric_limits<float>::max();
+   return hit;
+}
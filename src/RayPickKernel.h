@@ -0,0 +1,39 @@
+#ifndef _RAYPICKKERNEL_H_
+#define _RAYPICKKERNEL_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+ * Vectorized brute force picking over points stored as separate x, y and z arrays (SoA). Returns the index of the
+ * point nearest to O among those within radius2 (squared) of the line through O with unit direction ray, skipping
+ * the point at index skip, with the distance to O in dist, or n if nothing is hit. Gives the same result as the scalar
+ * loop in ray_pick_brute_force (RayPick.h) up to rounding. The AVX-512, AVX2 (8 points per iteration) or SSE2
+ * (4 points) implementation is chosen at runtime from the CPU features with a scalar fallback on other architectures.
+ */
+size_t ray_pick_soa(const float* x, const float* y, const float* z, size_t n, const float O[3], const float ray[3],
+                    float radius2, size_t skip, float& dist);
+
+// As above also skipping the points whose bit is set in the excluded bitmap (point i being bit i % 64 of word i / 64)
+size_t ray_pick_soa(const float* x, const float* y, const float* z, size_t n, const float O[3], const float ray[3],
+                    float radius2, size_t skip, const uint64_t* excluded, float& dist);
+
+// Name of the implementation selected by ray_pick_soa (avx512, avx2, sse2 or scalar)
+const char* ray_pick_soa_kernel();
+
+struct PointsSoA
+{
+   std::vector<float> x, y, z;
+
+   void clear() { x.clear(); y.clear(); z.clear(); }
+   void reserve(size_t n) { x.reserve(n); y.reserve(n); z.reserve(n); }
+   void push_back(float px, float py, float pz) { x.push_back(px); y.push_back(py); z.push_back(pz); }
+   size_t size() const { return x.size(); }
+
+   size_t pick(const float O[3], const float ray[3], float radius2, size_t skip, float& dist) const
+   {
+      return ray_pick_soa(x.data(), y.data(), z.data(), x.size(), O, ray, radius2, skip, dist);
+   }
+};
+#endif //_RAYPICKKERNEL_H_
@@ -0,0 +1,201 @@
+#include "TiledDetector.h"
+
+#include <cmath>
+#include <mutex>
+#include <thread>
+#include <string>
+#include <exception>
+#include <algorithm>
+
+TiledDetector::TiledDetector(std::vector<cv::Ptr<cv::Feature2D>> detectors, const DetectorInfo& info, int tile_size) :
+   detectors(std::move(detectors)), overlap(margin(info))
+//-------------------------------------------------------------------------------------------------------------------
+{
+   // Tiles much smaller than the overlap would mostly detect in the overlap
+   tile = std::max(tile_size, 4*overlap);
+   auto it = info.parameters.find("nfeatures");
+   if (it != info.parameters.end())
+      max_features = std::max(std::stoi(it->second), 0);
+}
+
+// The margin is the border and descriptor support radius (in image pixels) of keypoints at the coarsest scale the
+// detector parameters allow. SIFT scales are limited only by the image size, so its margin covers the first four
+// octaves; larger keypoints near tile edges are lost.
+int TiledDetector::margin(const DetectorInfo& info)
+//-------------------------------------------------
+{
+   auto param = [&info](const char* name, double def) -> double
+   {
+      auto it = info.parameters.find(name);
+      return (it == info.parameters.end()) ? def : std::stod(it->second);
+   };
+   double radius = 64;
+   if (info.name == "ORB")
+      radius = std::max(param("edgeThreshold", 31), param("patchSize", 31))*
+               std::pow(param("scaleFactor", 1.2), param("nlevels", 8) - 1);
+   else if (info.name == "SIFT")
+      radius = 8*(10.61*param("sigma", 1.6) + 5); // 3σ histogram width * √2 * (4 + 1)/2 + SIFT_IMG_BORDER
+   else if (info.name == "SURF")
+      radius = 1.9*(9 + 6*(param("nOctaveLayers", 3) + 1))*std::pow(2, param("nOctaves", 4) - 1);
+   else if (info.name == "AKAZE")
+      radius = 10*std::sqrt(2)*1.6*std::pow(2, param("nOctaves", 4));
+   else if (info.name == "BRISK")
+      radius = 18*param("patternScale", 1)*std::pow(2, param("octaves", 3));
+   return static_cast<int>(std::ceil(radius)) + 1;
+}
+
+cv::Rect TiledDetector::window(const cv::Size& size, int tx, int ty) const
+//-------------------------------------------------------------------------
+{
+   return cv::Rect(tx*tile - overlap, ty*tile - overlap, tile + 2*overlap, tile + 2*overlap) &
+          cv::Rect(0, 0, size.width, size.height);
+}
+
+bool TiledDetector::parallel_tiles(int tiles, const std::atomic_bool& is_cancelled, std::atomic<int>& done, int total,
+                                   const std::function<void(int, int)>& progress,
+                                   const std::function<void(cv::Feature2D&, int)>& fn) const
+//---------------------------------------------------------------------------------------------------------------------
+{
+   std::atomic<int> next{0};
+   std::atomic_bool is_failed{false};
+   std::exception_ptr error;
+   std::mutex error_mutex;
+   auto worker = [&](size_t w)
+   {
+      cv::Feature2D& detector = *detectors[w];
+      for (int t = next.fetch_add(1); t < tiles; t = next.fetch_add(1))
+      {
+         if ( (is_cancelled) || (is_failed) ) return;
+         try
+         {
+            fn(detector, t);
+         }
+         catch (...)
+         {
+            std::lock_guard<std::mutex> lock(error_mutex);
+            if (! error)
+               error = std::current_exception();
+            is_failed = true;
+            return;
+         }
+         const int n = ++done;
+         if (progress)
+            progress(n, total);
+      }
+   };
+   const size_t n = std::min(detectors.size(), static_cast<size_t>(tiles));
+   std::vector<std::thread> workers;
+   for (size_t w=1; w<n; w++)
+      workers.emplace_back(worker, w);
+   worker(0);
+   for (std::thread& t : workers)
+      t.join();
+   if (error)
+      std::rethrow_exception(error);
+   return (! is_cancelled);
+}
+
+bool TiledDetector::detect(const cv::Mat& image, std::vector<cv::KeyPoint>& keypoints, cv::Mat& descriptors,
+                           bool is_remove_duplicates, int best, const std::atomic_bool& is_cancelled,
+                           std::function<void(int, int)> progress) const
+//-----------------------------------------------------------------------------------------------------------
+{
+   keypoints.clear();
+   descriptors.release();
+   if ( (image.empty()) || (detectors.empty()) ) return true;
+   const int cols = (image.cols + tile - 1) / tile, rows = (image.rows + tile - 1) / tile, tiles = cols*rows;
+   // A detector feature limit applies per tile so is reapplied to the merged keypoints
+   int retain = best;
+   if ( (tiles > 1) && (max_features > 0) && ( (retain <= 0) || (max_features < retain) ) )
+      retain = max_features;
+   const bool is_filtered = (is_remove_duplicates) || (retain > 0);
+   const int total = (is_filtered) ? 2*tiles : tiles;
+   auto owner = [this, cols, rows](const cv::Point2f& pt) -> int
+   {
+      const int tx = std::min(std::max(static_cast<int>(pt.x) / tile, 0), cols - 1),
+                ty = std::min(std::max(static_cast<int>(pt.y) / tile, 0), rows - 1);
+      return ty*cols + tx;
+   };
+   std::vector<std::vector<cv::KeyPoint>> tile_keypoints(tiles);
+   std::vector<cv::Mat> tile_descriptors(tiles);
+   std::atomic<int> done{0};
+
+   bool is_complete = parallel_tiles(tiles, is_cancelled, done, total, progress, [&](cv::Feature2D& detector, int t)
+   {
+      const cv::Rect win = window(image.size(), t % cols, t / cols);
+      std::vector<cv::KeyPoint>& kps = tile_keypoints[t];
+      cv::Mat desc;
+      if (is_filtered)
+         detector.detect(image(win), kps);
+      else
+         detector.detectAndCompute(image(win), cv::noArray(), kps, desc);
+      // Keep the keypoints (and descriptor rows) inside the tile, in image coordinates
+      std::vector<int> kept;
+      size_t j = 0;
+      for (size_t i=0; i<kps.size(); i++)
+      {
+         cv::KeyPoint kp = kps[i];
+         kp.pt.x += win.x;
+         kp.pt.y += win.y;
+         if (owner(kp.pt) != t) continue;
+         kps[j++] = kp;
+         kept.push_back(static_cast<int>(i));
+      }
+      kps.resize(j);
+      if ( (! desc.empty()) && (! kept.empty()) )
+      {
+         cv::Mat& owned = tile_descriptors[t];
+         owned.create(static_cast<int>(kept.size()), desc.cols, desc.type());
+         for (size_t k=0; k<kept.size(); k++)
+            desc.row(kept[k]).copyTo(owned.row(static_cast<int>(k)));
+      }
+   });
+   if (! is_complete) return false;
+
+   if (is_filtered)
+   {
+      std::vector<cv::KeyPoint> merged;
+      for (std::vector<cv::KeyPoint>& kps : tile_keypoints)
+      {
+         merged.insert(merged.end(), kps.begin(), kps.end());
+         kps.clear();
+      }
+      if (is_remove_duplicates)
+         cv::KeyPointsFilter::removeDuplicated(merged);
+      if (retain > 0)
+         cv::KeyPointsFilter::retainBest(merged, retain);
+      for (const cv::KeyPoint& kp : merged)
+         tile_keypoints[owner(kp.pt)].push_back(kp);
+
+      is_complete = parallel_tiles(tiles, is_cancelled, done, total, progress, [&](cv::Feature2D& detector, int t)
+      {
+         std::vector<cv::KeyPoint>& kps = tile_keypoints[t];
+         if (kps.empty()) return;
+         const cv::Rect win = window(image.size(), t % cols, t / cols);
+         for (cv::KeyPoint& kp : kps)
+         {
+            kp.pt.x -= win.x;
+            kp.pt.y -= win.y;
+         }
+         // compute drops keypoints it can't describe
+         detector.compute(image(win), kps, tile_descriptors[t]);
+         for (cv::KeyPoint& kp : kps)
+         {
+            kp.pt.x += win.x;
+            kp.pt.y += win.y;
+         }
+      });
+      if (! is_complete) return false;
+   }
+
+   std::vector<cv::Mat> described;
+   for (int t=0; t<tiles; t++)
+   {
+      keypoints.insert(keypoints.end(), tile_keypoints[t].begin(), tile_keypoints[t].end());
+      if (! tile_descriptors[t].empty())
+         described.push_back(tile_descriptors[t]);
+   }
+   if (! described.empty())
+      cv::vconcat(described, descriptors);
+   return true;
+}
@@ -0,0 +1,53 @@
+#ifndef _TILEDDETECTOR_H_
+#define _TILEDDETECTOR_H_
+
+#include <atomic>
+#include <functional>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/features2d/features2d.hpp>
+
+#include "types.h"
+
+/*
+ * Feature detection over large images split into tile_size square tiles which are processed in parallel, one
+ * cv::Feature2D per worker thread (detectors keep per call state so can't be shared between threads). Each tile is
+ * detected over a window extended by a margin (derived from the detector parameters so that keypoints near the tile
+ * edge get the same border and descriptor support as in the full image) and owns only the keypoints inside the tile,
+ * so there are no duplicates across tiles. When keypoints are filtered (duplicates removed, best n retained or the
+ * detector has a feature count limit which would otherwise apply per tile) detection and description run as separate
+ * passes with the filter applied to the merged keypoints in between, so only the surviving keypoints are described.
+ */
+class TiledDetector
+//=================
+{
+public:
+   // info describes the detectors (as set by ImageWindow::create_detector), which must all be configured the same.
+   TiledDetector(std::vector<cv::Ptr<cv::Feature2D>> detectors, const DetectorInfo& info, int tile_size =1024);
+
+   // Overlap in pixels a tile window needs for the detector described by info
+   static int margin(const DetectorInfo& info);
+
+   /*
+    * Detects (and describes) the keypoints of image. best > 0 retains only the best (by response) keypoints.
+    * progress(done, total) is called from the worker threads after each tile. Returns false if cancelled (checked
+    * between tiles), exceptions thrown by the detectors are rethrown.
+    */
+   bool detect(const cv::Mat& image, std::vector<cv::KeyPoint>& keypoints, cv::Mat& descriptors,
+               bool is_remove_duplicates, int best, const std::atomic_bool& is_cancelled,
+               std::function<void(int, int)> progress =nullptr) const;
+
+private:
+   std::vector<cv::Ptr<cv::Feature2D>> detectors;
+   int overlap, tile, max_features = 0;
+
+   // Tile window (tile extended by overlap) of the tile containing (tx, ty)
+   cv::Rect window(const cv::Size& size, int tx, int ty) const;
+
+   // Runs fn(detector, tile) for tiles tiles in parallel, false if cancelled
+   bool parallel_tiles(int tiles, const std::atomic_bool& is_cancelled, std::atomic<int>& done, int total,
+                       const std::function<void(int, int)>& progress,
+                       const std::function<void(cv::Feature2D&, int)>& fn) const;
+};
+#endif //_TILEDDETECTOR_H_
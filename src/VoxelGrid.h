@@ -0,0 +1,346 @@
+#ifndef _VOXELGRID_H_
+#define _VOXELGRID_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <thread>
+#include <algorithm>
+
+#include "types.h"
+
+/*
+ * Load time voxel grid downsampling. The points are binned into cubic voxels of side leaf_size (in PLY units) and one
+ * point is kept per occupied voxel: by default the representative, the scan point nearest the voxel centre, so kept
+ * points (and therefore saved matches) are real scan points, or with is_centroid the mean position and colour of the
+ * voxel. If target_count is set instead of leaf_size the leaf size giving at most (and close to) target_count points
+ * is searched for. leaf_size and target_count both 0 disables the filter.
+ */
+struct VoxelGridOptions
+{
+   float leaf_size = 0;
+   size_t target_count = 0;
+   bool is_centroid = false;
+
+   bool enabled() const { return ( (leaf_size > 0) || (target_count > 0) ); }
+};
+
+/*
+ * Kept points in order of their original (PLY) index, index[i] being the PLY index of kept point i (the
+ * representative, or the lowest index in the voxel for centroids). points and colors (RGBA8, red in the low byte) are
+ * only filled for centroids.
+ */
+struct VoxelGridResult
+{
+   std::vector<uint64_t> index;
+   std::vector<Real3<float>> points;
+   std::vector<uint32_t> colors;
+   float leaf_size = 0;
+};
+
+namespace voxelgrid_detail
+{
+   struct Voxel
+   {
+      uint64_t index;
+      float best;
+      uint32_t count;
+      double x, y, z, r, g, b, a;
+   };
+
+   struct Grid
+   {
+      float lo[3], leaf;
+
+      // Voxel coordinates are packed 21 bits per axis
+      inline uint64_t key(const Real3<float>& p) const
+      {
+         const uint64_t ix = static_cast<uint64_t>((p.x - lo[0]) / leaf),
+                        iy = static_cast<uint64_t>((p.y - lo[1]) / leaf),
+                        iz = static_cast<uint64_t>((p.z - lo[2]) / leaf);
+         return std::min<uint64_t>(ix, 0x1FFFFF) | (std::min<uint64_t>(iy, 0x1FFFFF) << 21) |
+                (std::min<uint64_t>(iz, 0x1FFFFF) << 42);
+      }
+
+      inline float centre_distance2(const Real3<float>& p, uint64_t key) const
+      {
+         const float cx = lo[0] + (static_cast<float>(key & 0x1FFFFF) + 0.5f)*leaf,
+                     cy = lo[1] + (static_cast<float>((key >> 21) & 0x1FFFFF) + 0.5f)*leaf,
+                     cz = lo[2] + (static_cast<float>((key >> 42) & 0x1FFFFF) + 0.5f)*leaf;
+         return (p.x - cx)*(p.x - cx) + (p.y - cy)*(p.y - cy) + (p.z - cz)*(p.z - cz);
+      }
+   };
+
+   inline uint64_t mix(uint64_t key)
+   {
+      key ^= key >> 33; key *= 0xff51afd7ed558ccdULL; key ^= key >> 33;
+      return key;
+   }
+
+   inline size_t partition(uint64_t key, size_t partitions) { return static_cast<size_t>(mix(key) % partitions); }
+
+   // Open addressing (linear probing) map from voxel key to a slot number allocated in insertion order
+   class VoxelTable
+   {
+   public:
+      VoxelTable() : keys(1024, EMPTY), values(1024), mask(1023) {}
+
+      size_t size() const { return count; }
+
+      // Slot of key, allocating the next slot if key is new (is_new set)
+      uint32_t find_or_insert(uint64_t key, bool& is_new)
+      {
+         if ((count + 1)*2 > keys.size())
+            grow();
+         size_t h = static_cast<size_t>(mix(key >> 1)) & mask;
+         while (keys[h] != EMPTY)
+         {
+            if (keys[h] == key)
+            {
+               is_new = false;
+               return values[h];
+            }
+            h = (h + 1) & mask;
+         }
+         keys[h] = key;
+         values[h] = static_cast<uint32_t>(count);
+         is_new = true;
+         return static_cast<uint32_t>(count++);
+      }
+
+   private:
+      static constexpr uint64_t EMPTY = ~uint64_t(0); // not a key, keys use 63 bits
+      std::vector<uint64_t> keys;
+      std::vector<uint32_t> values;
+      size_t mask, count = 0;
+
+      void grow()
+      {
+         std::vector<uint64_t> old_keys(keys.size()*2, EMPTY);
+         std::vector<uint32_t> old_values(values.size()*2);
+         old_keys.swap(keys);
+         old_values.swap(values);
+         mask = keys.size() - 1;
+         for (size_t i=0; i<old_keys.size(); i++)
+         {
+            if (old_keys[i] == EMPTY) continue;
+            size_t h = static_cast<size_t>(mix(old_keys[i] >> 1)) & mask;
+            while (keys[h] != EMPTY)
+               h = (h + 1) & mask;
+            keys[h] = old_keys[i];
+            values[h] = old_values[i];
+         }
+      }
+   };
+
+   // Runs fn(t) for t in [0, threads) concurrently
+   template <typename F>
+   void run(size_t threads, F fn)
+   {
+      std::vector<std::thread> workers;
+      for (size_t t=1; t<threads; t++)
+         workers.emplace_back(fn, t);
+      fn(0);
+      for (std::thread& worker : workers)
+         worker.join();
+   }
+
+   // Voxel keys of the points and the point indices grouped by the hash partition of their key (see bin)
+   struct Binning
+   {
+      float leaf = 0;              // leaf size of the grid binned for
+      std::vector<uint64_t> keys;  // key of point i
+      std::vector<uint64_t> order; // point indices of partition p in order[start[p], start[p + 1]), ascending
+      std::vector<size_t> start;
+   };
+
+   /*
+    * Computes the voxel key of each point once, in parallel over index ranges, counting the keys of each range per
+    * partition, then scatters the indices into partition order using the prefix sums of the counts. Each partition's
+    * thread then visits only its own points, in ascending index order as a scan of all points would.
+    */
+   template <typename Point>
+   void bin(size_t n, Point point, const Grid& grid, size_t partitions, Binning& binning)
+   {
+      binning.leaf = grid.leaf;
+      binning.keys.resize(n);
+      binning.order.resize(n);
+      const size_t range = (n + partitions - 1) / partitions;
+      std::vector<size_t> offsets(partitions*partitions, 0); // [range][partition], counts then scatter offsets
+      run(partitions, [&](size_t t)
+      {
+         size_t* count = &offsets[t*partitions];
+         for (size_t i=t*range; i<std::min(n, (t + 1)*range); i++)
+         {
+            const uint64_t key = grid.key(point(i));
+            binning.keys[i] = key;
+            count[partition(key, partitions)]++;
+         }
+      });
+      binning.start.assign(partitions + 1, 0);
+      size_t total = 0;
+      for (size_t p=0; p<partitions; p++)
+      {
+         binning.start[p] = total;
+         for (size_t t=0; t<partitions; t++)
+         {
+            const size_t count = offsets[t*partitions + p];
+            offsets[t*partitions + p] = total;
+            total += count;
+         }
+      }
+      binning.start[partitions] = total;
+      run(partitions, [&](size_t t)
+      {
+         size_t* offset = &offsets[t*partitions];
+         for (size_t i=t*range; i<std::min(n, (t + 1)*range); i++)
+            binning.order[offset[partition(binning.keys[i], partitions)]++] = i;
+      });
+   }
+
+   // Number of occupied voxels, each thread hashing the voxels of its partition.
+   template <typename Point>
+   size_t count(size_t n, Point point, const Grid& grid, size_t threads, Binning& binning)
+   {
+      bin(n, point, grid, threads, binning);
+      std::vector<size_t> counts(threads, 0);
+      run(threads, [&](size_t t)
+      {
+         VoxelTable voxels;
+         bool is_new;
+         for (size_t k=binning.start[t]; k<binning.start[t + 1]; k++)
+            voxels.find_or_insert(binning.keys[binning.order[k]], is_new);
+         counts[t] = voxels.size();
+      });
+      size_t total = 0;
+      for (size_t c : counts) total += c;
+      return total;
+   }
+}
+
+/*
+ * point(i) returns the untransformed position of PLY point i and color(i) its RGBA8 colour (only called for centroids
+ * of coloured clouds, is_color). Binning is parallel over threads hash partitions of the voxels, the voxel keys being
+ * computed once per pass (see voxelgrid_detail::bin).
+ */
+template <typename Point, typename Color>
+VoxelGridResult voxel_grid(size_t n, Point point, Color color, bool is_color, const VoxelGridOptions& options,
+                           unsigned threads)
+//------------------------------------------------------------------------------------------------------------
+{
+   using namespace voxelgrid_detail;
+   VoxelGridResult result;
+   if ( (n == 0) || (! options.enabled()) ) return result;
+   const size_t partitions = std::max(threads, 1u);
+   Grid grid;
+   float hi[3];
+   grid.lo[0] = grid.lo[1] = grid.lo[2] = std::numeric_limits<float>::max();
+   hi[0] = hi[1] = hi[2] = std::numeric_limits<float>::lowest();
+   for (size_t i=0; i<n; i++)
+   {
+      const Real3<float> p = point(i);
+      grid.lo[0] = std::min(grid.lo[0], p.x); hi[0] = std::max(hi[0], p.x);
+      grid.lo[1] = std::min(grid.lo[1], p.y); hi[1] = std::max(hi[1], p.y);
+      grid.lo[2] = std::min(grid.lo[2], p.z); hi[2] = std::max(hi[2], p.z);
+   }
+   const float extent = std::max(std::max(hi[0] - grid.lo[0], hi[1] - grid.lo[1]), hi[2] - grid.lo[2]);
+   const float min_leaf = std::max(extent / 0x1FFFFF, std::numeric_limits<float>::min()); // 21 bit voxel coordinates
+   grid.leaf = std::max(options.leaf_size, min_leaf);
+   Binning binning;
+   if ( (options.leaf_size <= 0) && (options.target_count > 0) )
+   {
+      // Bisect (geometrically) for the smallest leaf size giving at most target_count voxels
+      const float volume = std::max((hi[0] - grid.lo[0])*(hi[1] - grid.lo[1])*(hi[2] - grid.lo[2]),
+                                    min_leaf*min_leaf*min_leaf);
+      float lo_leaf = min_leaf, hi_leaf = std::max(extent, min_leaf);
+      grid.leaf = std::min(std::max(std::cbrt(volume / static_cast<float>(options.target_count)), lo_leaf), hi_leaf);
+      for (int iteration=0; iteration<12; iteration++)
+      {
+         const size_t voxels = count(n, point, grid, partitions, binning);
+         if (voxels > options.target_count)
+            lo_leaf = grid.leaf;
+         else
+         {
+            hi_leaf = grid.leaf;
+            if (voxels >= options.target_count - options.target_count/20) break; // within 5%
+         }
+         grid.leaf = std::sqrt(lo_leaf*hi_leaf);
+      }
+      grid.leaf = hi_leaf;
+   }
+   result.leaf_size = grid.leaf;
+   if (binning.leaf != grid.leaf) // else binned by the last count
+      bin(n, point, grid, partitions, binning);
+
+   std::vector<std::vector<Voxel>> kept(partitions);
+   run(partitions, [&](size_t t)
+   {
+      VoxelTable table;
+      std::vector<Voxel>& voxels = kept[t];
+      bool is_new;
+      for (size_t k=binning.start[t]; k<binning.start[t + 1]; k++)
+      {
+         const size_t i = binning.order[k];
+         const Real3<float> p = point(i);
+         const uint64_t key = binning.keys[i];
+         const uint32_t slot = table.find_or_insert(key, is_new);
+         if (options.is_centroid)
+         {
+            if (is_new)
+               voxels.push_back(Voxel{i, 0, 0, 0, 0, 0, 0, 0, 0, 0});
+            Voxel& voxel = voxels[slot];
+            voxel.count++;
+            voxel.x += p.x; voxel.y += p.y; voxel.z += p.z;
+            if (is_color)
+            {
+               const uint32_t c = color(i);
+               voxel.r += c & 0xFF; voxel.g += (c >> 8) & 0xFF; voxel.b += (c >> 16) & 0xFF; voxel.a += c >> 24;
+            }
+         }
+         else
+         {
+            const float d = grid.centre_distance2(p, key);
+            if (is_new)
+               voxels.push_back(Voxel{i, d, 1, 0, 0, 0, 0, 0, 0, 0});
+            else if (d < voxels[slot].best)
+            {
+               voxels[slot].index = i;
+               voxels[slot].best = d;
+            }
+         }
+      }
+   });
+
+   binning = Binning();
+   std::vector<Voxel> all;
+   for (std::vector<Voxel>& part : kept)
+   {
+      all.insert(all.end(), part.begin(), part.end());
+      std::vector<Voxel>().swap(part);
+   }
+   std::sort(all.begin(), all.end(), [](const Voxel& a, const Voxel& b) { return a.index < b.index; });
+   result.index.reserve(all.size());
+   for (const Voxel& voxel : all)
+      result.index.push_back(voxel.index);
+   if (options.is_centroid)
+   {
+      result.points.reserve(all.size());
+      if (is_color)
+         result.colors.reserve(all.size());
+      for (const Voxel& voxel : all)
+      {
+         const double c = voxel.count;
+         result.points.emplace_back(static_cast<float>(voxel.x / c), static_cast<float>(voxel.y / c),
+                                    static_cast<float>(voxel.z / c));
+         if (is_color)
+            result.colors.push_back(static_cast<uint32_t>(std::lround(voxel.r / c)) |
+                                    (static_cast<uint32_t>(std::lround(voxel.g / c)) << 8) |
+                                    (static_cast<uint32_t>(std::lround(voxel.b / c)) << 16) |
+                                    (static_cast<uint32_t>(std::lround(voxel.a / c)) << 24));
+      }
+   }
+   return result;
+}
+#endif //_VOXELGRID_H_
@@ -76,6 +76,26 @@ int main(int argc, char *argv[])
    parser.addOption({"f", "Flip Y and Z axis for point cloud data."});
    parser.addOption(QCommandLineOption("r", "Click radius for 2D features", "click-radius", "5"));
    parser.addOption({"b", "Choose only best (by response) 2D feature if multiple features are in click radius."});
+   parser.addOption({"C", "Do not read or write the point cloud cache (<plyfile>.pnpcache)."});
+   parser.addOption(QCommandLineOption("O", "Use the out of core octree renderer for point clouds with more than this "
+                                            "number of points", "octree-points", "20000000"));
+   parser.addOption(QCommandLineOption("V", "Point cloud GPU vertex format (float, packed or quantized)",
+                                       "vertex-format", "packed"));
+   parser.addOption(QCommandLineOption("R", "Point cloud ray picking (kdtree, brute or verify to compare both)",
+                                       "pick-mode", "kdtree"));
+   parser.addOption(QCommandLineOption("j", "Number of threads used to build the point cloud kd-tree (default all cores)",
+                                       "threads", "0"));
+   parser.addOption(QCommandLineOption("D", "Voxel grid downsample the point cloud on load with this leaf size",
+                                       "leaf-size", "0"));
+   parser.addOption(QCommandLineOption("N", "Voxel grid downsample the point cloud on load to at most this many points",
+                                       "points", "0"));
+   parser.addOption({"A", "Keep voxel centroids instead of the scan point nearest each voxel centre when downsampling."});
+   parser.addOption(QCommandLineOption("X", "Remove point cloud outliers whose mean neighbour distance is more than this "
+                                            "many standard deviations above the mean (0 off). Not supported for "
+                                            "octree rendered point clouds (see -O)", "sigma", "0"));
+   parser.addOption(QCommandLineOption("K", "Number of nearest neighbours used for outlier removal", "neighbours", "8"));
+   parser.addOption({"Z", "Sort the point cloud into Morton (Z) order on load for spatial memory locality."});
+   parser.addOption({"T", "Render each OpenGL window on its own thread."});
    parser.process(a);
    std::string shaders_dir = parser.value("s").toStdString();
    filesystem::path shaders_path = filesystem::canonical(filesystem::path(shaders_dir.c_str()));
@@ -115,6 +135,74 @@ int main(int argc, char *argv[])
       return 1;
    }
    bool is_best_response = parser.isSet("b");
+   bool is_cache = ! parser.isSet("C");
+   s = parser.value("O").toStdString();
+   long long octree_points = strtoll(s.c_str(), nullptr, 10);
+   if (octree_points <= 0)
+   {
+      std::cerr << "Invalid octree point threshold (-O " << s << ")" << std::endl;
+      return 1;
+   }
+   s = parser.value("V").toStdString();
+   VertexFormat vertex_format;
+   if (! parse_vertex_format(s, vertex_format))
+   {
+      std::cerr << "Invalid vertex format (-V " << s << ")" << std::endl;
+      return 1;
+   }
+   s = parser.value("R").toStdString();
+   RayPickMode pick_mode;
+   if (s == "kdtree")
+      pick_mode = RayPickMode::KDTREE;
+   else if (s == "brute")
+      pick_mode = RayPickMode::BRUTE_FORCE;
+   else if (s == "verify")
+      pick_mode = RayPickMode::VERIFY;
+   else
+   {
+      std::cerr << "Invalid ray picking mode (-R " << s << ")" << std::endl;
+      return 1;
+   }
+   s = parser.value("j").toStdString();
+   long index_threads = strtol(s.c_str(), nullptr, 10);
+   if (index_threads < 0)
+   {
+      std::cerr << "Invalid kd-tree build thread count (-j " << s << ")" << std::endl;
+      return 1;
+   }
+   VoxelGridOptions voxel_options;
+   s = parser.value("D").toStdString();
+   voxel_options.leaf_size = strtof(s.c_str(), nullptr);
+   if (voxel_options.leaf_size < 0)
+   {
+      std::cerr << "Invalid voxel grid leaf size (-D " << s << ")" << std::endl;
+      return 1;
+   }
+   s = parser.value("N").toStdString();
+   long long voxel_points = strtoll(s.c_str(), nullptr, 10);
+   if (voxel_points < 0)
+   {
+      std::cerr << "Invalid voxel grid point count (-N " << s << ")" << std::endl;
+      return 1;
+   }
+   voxel_options.target_count = static_cast<size_t>(voxel_points);
+   voxel_options.is_centroid = parser.isSet("A");
+   OutlierOptions outlier_options;
+   s = parser.value("X").toStdString();
+   outlier_options.sigma = strtof(s.c_str(), nullptr);
+   if (outlier_options.sigma < 0)
+   {
+      std::cerr << "Invalid outlier removal standard deviation multiplier (-X " << s << ")" << std::endl;
+      return 1;
+   }
+   s = parser.value("K").toStdString();
+   long outlier_k = strtol(s.c_str(), nullptr, 10);
+   if (outlier_k < 1)
+   {
+      std::cerr << "Invalid outlier removal neighbour count (-K " << s << ")" << std::endl;
+      return 1;
+   }
+   outlier_options.k = static_cast<size_t>(outlier_k);
    const QStringList args = parser.positionalArguments();
    std::string plyfile, imgfile;
 
@@ -153,15 +241,25 @@ int main(int argc, char *argv[])
       std::cerr << "Matcher window creation msg" << std::endl;
       return 1;
    }
+   matcher->set_vertex_format(vertex_format);
    cv::Mat chessboard;
    chessboard_mat(27, chessboard);
    pointcloud = new PointCloudWin("PointCloud", 1024, 768, "shaders/pointcloud/",plyfile, matcher,
                                   scale, is_flipped, false, GLSL_VER,  OPENGL_MAJOR, OPENGL_MINOR);
    if (point_size > 0)
       pointcloud->set_point_size(point_size);
+   pointcloud->set_use_cache(is_cache);
+   pointcloud->set_octree(static_cast<size_t>(octree_points));
+   pointcloud->set_vertex_format(vertex_format);
+   pointcloud->set_pick_mode(pick_mode);
+   if (index_threads > 0)
+      pointcloud->set_index_threads(static_cast<unsigned>(index_threads));
+   pointcloud->set_voxel_grid(voxel_options);
+   pointcloud->set_outlier_filter(outlier_options);
+   pointcloud->set_morton_order(parser.isSet("Z"));
    cv::Rect R(0, 0, chessboard.cols, chessboard.rows);
-   matcher->update_image(chessboard, R, nullptr);
-   gl_executor.start({pointcloud, matcher}, true);
+   matcher->update_image(chessboard, R, std::vector<features_t>());
+   gl_executor.start({pointcloud, matcher}, true, parser.isSet("T"));
    ImageWindow imgwin(matcher);
    imgwin.setApplication(&a);
    matcher->set_image_view(&imgwin);
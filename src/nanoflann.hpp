@@ -55,6 +55,7 @@
 #include <cmath>   // for abs()
 #include <cstdlib> // for abs()
 #include <limits>
+#include <future>
 
 // Avoid conflicting declaration of min/max macros in windows headers
 #if !defined(NOMINMAX) && (defined(_WIN32) || defined(_WIN32_)  || defined(WIN32) || defined(_WIN64))
@@ -493,11 +494,12 @@ namespace nanoflann
 	/**  Parameters (see README.md) */
 	struct KDTreeSingleIndexAdaptorParams
 	{
-		KDTreeSingleIndexAdaptorParams(size_t _leaf_max_size = 10) :
-			leaf_max_size(_leaf_max_size)
+		KDTreeSingleIndexAdaptorParams(size_t _leaf_max_size = 10, unsigned int _n_thread_build = 1) :
+			leaf_max_size(_leaf_max_size), n_thread_build(_n_thread_build)
 		{}
 
 		size_t leaf_max_size;
+		unsigned int n_thread_build; //!< Number of threads used by buildIndex (1 = serial). The tree is identical.
 	};
 
 	/** Search options for KDTreeSingleIndexAdaptor::findNeighbors() */
@@ -662,6 +664,26 @@ namespace nanoflann
 			return mem;
 		}
 
+		/** Takes ownership of the blocks of other (which is left empty), keeping the current block for allocation. */
+		void adopt(PooledAllocator& other)
+		{
+			if (other.base == NULL) return;
+			void* tail = other.base;
+			while (static_cast<void**>(tail)[0] != NULL)
+				tail = static_cast<void**>(tail)[0];
+			if (base == NULL) {
+				base = other.base;
+				remaining = 0;
+			}
+			else {
+				static_cast<void**>(tail)[0] = static_cast<void**>(base)[0];
+				static_cast<void**>(base)[0] = other.base;
+			}
+			usedMemory += other.usedMemory;
+			wastedMemory += other.wastedMemory + other.remaining;
+			other.internal_init();
+		}
+
 	};
 	/** @} */
 
@@ -915,7 +937,12 @@ namespace nanoflann
 		 */
 		NodePtr divideTree(Derived &obj, const IndexType left, const IndexType right, BoundingBox& bbox)
 		{
-			NodePtr node = obj.pool.template allocate<Node>(); // allocate memory
+			return divideTree(obj, obj.pool, left, right, bbox);
+		}
+
+		NodePtr divideTree(Derived &obj, PooledAllocator& pool, const IndexType left, const IndexType right, BoundingBox& bbox)
+		{
+			NodePtr node = pool.template allocate<Node>(); // allocate memory
 
 			/* If too few exemplars remain, then make this a leaf node. */
 			if ( (right - left) <= static_cast<IndexType>(obj.m_leaf_max_size) ) {
@@ -945,11 +972,11 @@ namespace nanoflann
 
 				BoundingBox left_bbox(bbox);
 				left_bbox[cutfeat].high = cutval;
-				node->child1 = divideTree(obj, left, left + idx, left_bbox);
+				node->child1 = divideTree(obj, pool, left, left + idx, left_bbox);
 
 				BoundingBox right_bbox(bbox);
 				right_bbox[cutfeat].low = cutval;
-				node->child2 = divideTree(obj, left + idx, right, right_bbox);
+				node->child2 = divideTree(obj, pool, left + idx, right, right_bbox);
 
 				node->node_type.sub.divlow = left_bbox[cutfeat].high;
 				node->node_type.sub.divhigh = right_bbox[cutfeat].low;
@@ -963,6 +990,49 @@ namespace nanoflann
 			return node;
 		}
 
+		/**
+		 * As divideTree but the first \a depth levels build their left subtree on a new thread. Each thread allocates
+		 * from its own pool which is then adopted by the parent pool, so the tree is identical to the serial build.
+		 */
+		NodePtr divideTreeConcurrent(Derived &obj, PooledAllocator& pool, const IndexType left, const IndexType right, BoundingBox& bbox, int depth)
+		{
+			if ( (depth <= 0) || ((right - left) <= static_cast<IndexType>(CONCURRENT_BUILD_MIN_SIZE)) )
+				return divideTree(obj, pool, left, right, bbox);
+			NodePtr node = pool.template allocate<Node>();
+			IndexType idx;
+			int cutfeat;
+			DistanceType cutval;
+			middleSplit_(obj, &obj.vind[0] + left, right - left, idx, cutfeat, cutval, bbox);
+
+			node->node_type.sub.divfeat = cutfeat;
+
+			BoundingBox left_bbox(bbox);
+			left_bbox[cutfeat].high = cutval;
+			PooledAllocator left_pool;
+			std::future<NodePtr> left_node = std::async(std::launch::async, [&]()
+			{
+				return divideTreeConcurrent(obj, left_pool, left, left + idx, left_bbox, depth - 1);
+			});
+
+			BoundingBox right_bbox(bbox);
+			right_bbox[cutfeat].low = cutval;
+			node->child2 = divideTreeConcurrent(obj, pool, left + idx, right, right_bbox, depth - 1);
+			node->child1 = left_node.get();
+			pool.adopt(left_pool);
+
+			node->node_type.sub.divlow = left_bbox[cutfeat].high;
+			node->node_type.sub.divhigh = right_bbox[cutfeat].low;
+
+			for (int i = 0; i < (DIM > 0 ? DIM : obj.dim); ++i) {
+				bbox[i].low = std::min(left_bbox[i].low, right_bbox[i].low);
+				bbox[i].high = std::max(left_bbox[i].high, right_bbox[i].high);
+			}
+			return node;
+		}
+
+		/** Subtrees smaller than this are not split across threads by divideTreeConcurrent */
+		static const size_t CONCURRENT_BUILD_MIN_SIZE = 16384;
+
 		void middleSplit_(Derived &obj, IndexType* ind, IndexType count, IndexType& index, int& cutfeat, DistanceType& cutval, const BoundingBox& bbox)
 		{
 			const DistanceType EPS = static_cast<DistanceType>(0.00001);
@@ -1222,7 +1292,13 @@ namespace nanoflann
 			BaseClassRef::m_size_at_index_build = BaseClassRef::m_size;
 			if(BaseClassRef::m_size == 0) return;
 			computeBoundingBox(BaseClassRef::root_bbox);
-			BaseClassRef::root_node = this->divideTree(*this, 0, BaseClassRef::m_size, BaseClassRef::root_bbox );   // construct the tree
+			if (index_params.n_thread_build > 1) {
+				int depth = 0;
+				while ((1u << depth) < index_params.n_thread_build) ++depth;
+				BaseClassRef::root_node = this->divideTreeConcurrent(*this, BaseClassRef::pool, 0, BaseClassRef::m_size, BaseClassRef::root_bbox, depth);
+			}
+			else
+				BaseClassRef::root_node = this->divideTree(*this, 0, BaseClassRef::m_size, BaseClassRef::root_bbox );   // construct the tree
 		}
 
 		/** \name Query methods
@@ -1543,7 +1619,13 @@ namespace nanoflann
 			BaseClassRef::m_size_at_index_build = BaseClassRef::m_size;
 			if(BaseClassRef::m_size == 0) return;
 			computeBoundingBox(BaseClassRef::root_bbox);
-			BaseClassRef::root_node = this->divideTree(*this, 0, BaseClassRef::m_size, BaseClassRef::root_bbox );   // construct the tree
+			if (index_params.n_thread_build > 1) {
+				int depth = 0;
+				while ((1u << depth) < index_params.n_thread_build) ++depth;
+				BaseClassRef::root_node = this->divideTreeConcurrent(*this, BaseClassRef::pool, 0, BaseClassRef::m_size, BaseClassRef::root_bbox, depth);
+			}
+			else
+				BaseClassRef::root_node = this->divideTree(*this, 0, BaseClassRef::m_size, BaseClassRef::root_bbox );   // construct the tree
 		}
 
 		/** \name Query methods
@@ -1849,7 +1931,8 @@ namespace nanoflann
 				for(int i = 0; i < pos; i++) {
 					for(int j = 0; j < static_cast<int>(index[i].vind.size()); j++) {
 						index[pos].vind.push_back(index[i].vind[j]);
-						treeIndex[index[i].vind[j]] = pos;
+						if (treeIndex[index[i].vind[j]] != -1) // keep removed points removed
+							treeIndex[index[i].vind[j]] = pos;
 					}
 					index[i].vind.clear();
 					index[i].freeIndex(index[i]);
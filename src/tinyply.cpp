@@ -11,6 +11,9 @@
 #include <type_traits>
 #include <iostream>
 #include <cstring>
+#include <charconv>
+#include <thread>
+#include <atomic>
 
 using namespace tinyply;
 using namespace std;
@@ -91,6 +94,9 @@ struct PlyFile::PlyFileImpl
 
     bool parse_header(std::istream & is);
     void parse_data(std::istream & is, bool firstPass);
+    bool parse_fixed_element_binary(const PlyElement & element, std::istream & is, bool firstPass);
+    bool read_ascii_parallel(std::istream & is);
+    void allocate_buffers();
     void read_header_format(std::istream & is);
     void read_header_element(std::istream & is);
     void read_header_property(std::istream & is);
@@ -167,6 +173,83 @@ template<typename T> void ply_cast_ascii(void * dest, std::istream & is)
     *(static_cast<T *>(dest)) = ply_read_ascii<T>(is);
 }
 
+// Copies n values of size N from a strided (interleaved) source to a strided destination, optionally byte swapping.
+// N and swap are compile time constants so the loop body reduces to a load/(bswap)/store the compiler can vectorize.
+template<size_t N, bool Swap> void ply_deinterleave(uint8_t * dest, size_t destStride, const uint8_t * src, size_t srcStride, size_t n)
+{
+    for (size_t i = 0; i < n; ++i)
+    {
+        uint8_t v[N];
+        std::memcpy(v, src + i * srcStride, N);
+        if (Swap) std::reverse(v, v + N);
+        std::memcpy(dest + i * destStride, v, N);
+    }
+}
+
+template<bool Swap> void ply_deinterleave(size_t size, uint8_t * dest, size_t destStride, const uint8_t * src, size_t srcStride, size_t n)
+{
+    switch (size)
+    {
+        case 1: ply_deinterleave<1, false>(dest, destStride, src, srcStride, n); break;
+        case 2: ply_deinterleave<2, Swap>(dest, destStride, src, srcStride, n); break;
+        case 4: ply_deinterleave<4, Swap>(dest, destStride, src, srcStride, n); break;
+        case 8: ply_deinterleave<8, Swap>(dest, destStride, src, srcStride, n); break;
+        default: throw std::invalid_argument("invalid ply property");
+    }
+}
+
+// Locale independent ASCII number parsing for the parallel ASCII reader. p is advanced past the token; tokens never
+// extend past end (the end of the current line).
+inline const char * ply_skip_space(const char * p, const char * end)
+{
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) ++p;
+    return p;
+}
+
+template<typename T> bool ply_parse_ascii(const char *& p, const char * end, T & v)
+{
+    p = ply_skip_space(p, end);
+    if (p < end && *p == '+') ++p;
+    auto result = std::from_chars(p, end, v);
+    if (result.ec != std::errc()) return false;
+    p = result.ptr;
+    return true;
+}
+
+inline bool ply_parse_ascii(const Type t, const char *& p, const char * end, uint8_t * dest)
+{
+    switch (t)
+    {
+        case Type::INT8:    { int32_t v; if (!ply_parse_ascii(p, end, v)) return false; *reinterpret_cast<int8_t *>(dest) = static_cast<int8_t>(v); return true; }
+        case Type::UINT8:   { uint32_t v; if (!ply_parse_ascii(p, end, v)) return false; *dest = static_cast<uint8_t>(v); return true; }
+        case Type::INT16:   { int16_t v; if (!ply_parse_ascii(p, end, v)) return false; std::memcpy(dest, &v, sizeof(v)); return true; }
+        case Type::UINT16:  { uint16_t v; if (!ply_parse_ascii(p, end, v)) return false; std::memcpy(dest, &v, sizeof(v)); return true; }
+        case Type::INT32:   { int32_t v; if (!ply_parse_ascii(p, end, v)) return false; std::memcpy(dest, &v, sizeof(v)); return true; }
+        case Type::UINT32:  { uint32_t v; if (!ply_parse_ascii(p, end, v)) return false; std::memcpy(dest, &v, sizeof(v)); return true; }
+        case Type::FLOAT32: { float v; if (!ply_parse_ascii(p, end, v)) return false; std::memcpy(dest, &v, sizeof(v)); return true; }
+        case Type::FLOAT64: { double v; if (!ply_parse_ascii(p, end, v)) return false; std::memcpy(dest, &v, sizeof(v)); return true; }
+        case Type::INVALID: break;
+    }
+    return false;
+}
+
+inline bool ply_skip_ascii(const char *& p, const char * end)
+{
+    p = ply_skip_space(p, end);
+    if (p == end) return false;
+    while (p < end && *p != ' ' && *p != '\t' && *p != '\r') ++p;
+    return true;
+}
+
+// Returns the end of the line starting at p (the '\n' or end) and sets blank if the line contains only whitespace.
+inline const char * ply_line_end(const char * p, const char * end, bool & blank)
+{
+    const char * eol = static_cast<const char *>(std::memchr(p, '\n', end - p));
+    if (eol == nullptr) eol = end;
+    blank = (ply_skip_space(p, eol) == eol);
+    return eol;
+}
+
 size_t find_element(const std::string & key, const std::vector<PlyElement> & list)
 {
     for (size_t i = 0; i < list.size(); i++) if (list[i].name == key) return i;
@@ -330,9 +413,18 @@ void PlyFile::PlyFileImpl::write_property_binary(Type t, std::ostream & os, uint
 
 void PlyFile::PlyFileImpl::read(std::istream & is)
 {
+    if (!isBinary && read_ascii_parallel(is)) return;
+
     // Parse but only get the data size
     parse_data(is, true);
+    allocate_buffers();
+
+    // Populate the data
+    parse_data(is, false);
+}
 
+void PlyFile::PlyFileImpl::allocate_buffers()
+{
     std::vector<std::shared_ptr<PlyData>> buffers;
     for (auto & entry : userData) buffers.push_back(entry.second.data);
 
@@ -351,9 +443,6 @@ void PlyFile::PlyFileImpl::read(std::istream & is)
             }
         }
     }
-
-    // Populate the data
-    parse_data(is, false);
 }
 
 void PlyFile::PlyFileImpl::write(std::ostream & os, bool _isBinary)
@@ -557,6 +646,7 @@ void PlyFile::PlyFileImpl::parse_data(std::istream & is, bool firstPass)
 
     for (auto & element : elements)
     {
+        if (isBinary && parse_fixed_element_binary(element, is, firstPass)) continue;
         for (size_t count = 0; count < element.size; ++count)
         {
             for (auto & property : element.properties)
@@ -599,6 +689,296 @@ void PlyFile::PlyFileImpl::parse_data(std::istream & is, bool firstPass)
     if (firstPass) is.seekg(start, is.beg);
 }
 
+// Elements whose properties are all fixed size (no lists) are read in large blocks of whole elements with a single
+// istream::read per block and then de-interleaved (and byte swapped if required) into the requested buffers, instead
+// of one istream::read per property per element. Returns false if the element contains a list property.
+bool PlyFile::PlyFileImpl::parse_fixed_element_binary(const PlyElement & element, std::istream & is, bool firstPass)
+{
+    struct FixedProperty
+    {
+        ParsingHelper * helper;
+        size_t srcOffset, destOffset, size;
+    };
+
+    size_t elementStride = 0;
+    for (auto & property : element.properties)
+    {
+        if (property.isList) return false;
+        elementStride += PropertyTable[property.propertyType].stride;
+    }
+    if (elementStride == 0 || element.size == 0) return true;
+
+    // Properties requested together share a cursor and are interleaved in their destination buffer in element order,
+    // so the destination stride of each helper is the total size of its properties within this element.
+    std::vector<FixedProperty> requested;
+    std::map<PlyCursor *, size_t> destStrides;
+    size_t srcOffset = 0;
+    for (auto & property : element.properties)
+    {
+        const size_t size = PropertyTable[property.propertyType].stride;
+        auto cursorIt = userData.find(make_key(element.name, property.name));
+        if (cursorIt != userData.end())
+        {
+            ParsingHelper * helper = &cursorIt->second;
+            size_t & destStride = destStrides[helper->cursor.get()];
+            requested.push_back({ helper, srcOffset, destStride, size });
+            destStride += size;
+        }
+        srcOffset += size;
+    }
+
+    if (firstPass || requested.empty())
+    {
+        for (auto & r : requested) r.helper->cursor->totalSizeBytes += element.size * r.size;
+        is.seekg(static_cast<std::streamoff>(element.size * elementStride), is.cur);
+        return true;
+    }
+
+    const size_t chunkElements = std::max<size_t>(1, (4 * 1024 * 1024) / elementStride);
+    std::vector<uint8_t> chunk(std::min(chunkElements, element.size) * elementStride);
+    for (size_t done = 0; done < element.size; )
+    {
+        const size_t n = std::min(chunkElements, element.size - done);
+        is.read(reinterpret_cast<char *>(chunk.data()), n * elementStride);
+        if (static_cast<size_t>(is.gcount()) != n * elementStride) throw std::runtime_error("unexpected end of file reading element " + element.name);
+        for (auto & r : requested)
+        {
+            const size_t destStride = destStrides[r.helper->cursor.get()];
+            uint8_t * dest = r.helper->data->buffer.get() + r.helper->cursor->byteOffset + r.destOffset;
+            if (isBigEndian) ply_deinterleave<true>(r.size, dest, destStride, chunk.data() + r.srcOffset, elementStride, n);
+            else ply_deinterleave<false>(r.size, dest, destStride, chunk.data() + r.srcOffset, elementStride, n);
+        }
+        for (auto & entry : destStrides) entry.first->byteOffset += n * entry.second;
+        done += n;
+    }
+    return true;
+}
+
+// Parallel ASCII reader. The body is read into memory in one call and split on line boundaries into one chunk per
+// thread. A first parallel pass counts the records (non blank lines) in each chunk so that every chunk knows the index of
+// its first record. Elements without list properties are then parsed in parallel with from_chars, each record being
+// written directly to its final position in the destination buffers so the results are merged in file order without
+// any copying. Elements with list properties (whose destination offsets depend on all preceding lists) are parsed
+// sequentially. Returns false (with the stream position restored) if the body does not have exactly one record per line,
+// in which case the caller falls back to the stream based parser.
+bool PlyFile::PlyFileImpl::read_ascii_parallel(std::istream & is)
+{
+    struct AsciiProperty
+    {
+        Type type = Type::INVALID;
+        bool isList = false;
+        Type listType = Type::INVALID;
+        ParsingHelper * helper = nullptr;
+        size_t destOffset = 0, destStride = 0, size = 0;
+    };
+    struct AsciiElement
+    {
+        std::vector<AsciiProperty> properties;
+        size_t firstRecord = 0;
+        bool hasList = false, isRequested = false;
+        const char * start = nullptr;
+    };
+
+    const auto start = is.tellg();
+    if (start < 0) return false;
+    is.seekg(0, is.end);
+    const auto stop = is.tellg();
+    is.seekg(start, is.beg);
+    if (stop < start) return false;
+    std::vector<char> body(static_cast<size_t>(stop - start));
+    is.read(body.data(), body.size());
+    auto restore = [&]() -> bool { is.clear(); is.seekg(start, is.beg); return false; };
+    if (static_cast<size_t>(is.gcount()) != body.size()) return restore();
+    const char * begin = body.data();
+    const char * end = begin + body.size();
+
+    std::vector<AsciiElement> ascii(elements.size());
+    size_t totalRecords = 0;
+    for (size_t k = 0; k < elements.size(); ++k)
+    {
+        const PlyElement & element = elements[k];
+        AsciiElement & ae = ascii[k];
+        ae.firstRecord = totalRecords;
+        totalRecords += element.size;
+        std::map<PlyCursor *, size_t> destStrides; // as for binary, properties sharing a cursor are interleaved
+        for (auto & property : element.properties)
+        {
+            AsciiProperty ap;
+            ap.type = property.propertyType;
+            ap.isList = property.isList;
+            ap.listType = property.listType;
+            ap.size = PropertyTable[property.propertyType].stride;
+            if (ap.isList) ae.hasList = true;
+            auto cursorIt = userData.find(make_key(element.name, property.name));
+            if (cursorIt != userData.end())
+            {
+                ap.helper = &cursorIt->second;
+                size_t & destStride = destStrides[ap.helper->cursor.get()];
+                ap.destOffset = destStride;
+                destStride += ap.size;
+                ae.isRequested = true;
+            }
+            ae.properties.push_back(ap);
+        }
+        for (auto & ap : ae.properties)
+            if (ap.helper != nullptr) ap.destStride = destStrides[ap.helper->cursor.get()];
+    }
+
+    const size_t hardwareThreads = std::max<unsigned>(1, std::thread::hardware_concurrency());
+    const size_t threadCount = std::max<size_t>(1, std::min(hardwareThreads, body.size() / (1024 * 1024)));
+    std::vector<const char *> bounds(threadCount + 1, end);
+    bounds[0] = begin;
+    for (size_t i = 1; i < threadCount; ++i)
+    {
+        const char * p = std::max(begin + (body.size() * i) / threadCount, bounds[i - 1]);
+        const char * eol = static_cast<const char *>(std::memchr(p, '\n', end - p));
+        bounds[i] = (eol == nullptr) ? end : eol + 1;
+    }
+
+    auto parallel = [threadCount](const std::function<void(size_t)> & f)
+    {
+        if (threadCount == 1) { f(0); return; }
+        std::vector<std::thread> threads;
+        for (size_t i = 0; i < threadCount; ++i) threads.emplace_back(f, i);
+        for (auto & t : threads) t.join();
+    };
+
+    // Pass 1: count records per chunk
+    std::vector<size_t> chunkRecords(threadCount + 1, 0);
+    parallel([&](size_t i)
+    {
+        size_t n = 0;
+        bool blank;
+        for (const char * p = bounds[i]; p < bounds[i + 1]; )
+        {
+            const char * eol = ply_line_end(p, bounds[i + 1], blank);
+            if (!blank) ++n;
+            p = eol + 1;
+        }
+        chunkRecords[i + 1] = n;
+    });
+    for (size_t i = 1; i <= threadCount; ++i) chunkRecords[i] += chunkRecords[i - 1];
+    if (chunkRecords[threadCount] != totalRecords) return restore();
+
+    // Locate the first line of each element containing lists for the sequential parse
+    for (auto & ae : ascii)
+    {
+        if (!ae.hasList || !ae.isRequested) continue;
+        const size_t chunk = std::upper_bound(chunkRecords.begin(), chunkRecords.end(), ae.firstRecord) - chunkRecords.begin() - 1;
+        size_t record = chunkRecords[chunk];
+        bool blank;
+        for (const char * p = bounds[chunk]; p < bounds[chunk + 1]; )
+        {
+            const char * eol = ply_line_end(p, bounds[chunk + 1], blank);
+            if (!blank && record++ == ae.firstRecord) { ae.start = p; break; }
+            p = eol + 1;
+        }
+    }
+
+    // Sequential parse of an element containing list properties, either sizing (firstPass) or filling the buffers.
+    auto parse_list_element = [&](size_t k, bool firstPass)
+    {
+        AsciiElement & ae = ascii[k];
+        const char * p = ae.start;
+        bool blank;
+        for (size_t n = 0; n < elements[k].size; )
+        {
+            const char * eol = ply_line_end(p, end, blank);
+            if (!blank)
+            {
+                for (auto & ap : ae.properties)
+                {
+                    size_t listSize = 1;
+                    if (ap.isList)
+                    {
+                        uint8_t count[8] = { 0 };
+                        if (!ply_parse_ascii(ap.listType, p, eol, count)) throw std::runtime_error("malformed ascii list in element " + elements[k].name);
+                        switch (ap.listType)
+                        {
+                            case Type::INT8: case Type::UINT8: listSize = count[0]; break;
+                            case Type::INT16: case Type::UINT16: { uint16_t v; std::memcpy(&v, count, sizeof(v)); listSize = v; break; }
+                            default: { uint32_t v; std::memcpy(&v, count, sizeof(v)); listSize = v; break; }
+                        }
+                    }
+                    for (size_t j = 0; j < listSize; ++j)
+                    {
+                        if (ap.helper == nullptr || firstPass)
+                        {
+                            if (!ply_skip_ascii(p, eol)) throw std::runtime_error("malformed ascii record in element " + elements[k].name);
+                            if (ap.helper != nullptr) ap.helper->cursor->totalSizeBytes += ap.size;
+                        }
+                        else
+                        {
+                            auto & cursor = *ap.helper->cursor;
+                            if (!ply_parse_ascii(ap.type, p, eol, ap.helper->data->buffer.get() + cursor.byteOffset)) throw std::runtime_error("malformed ascii record in element " + elements[k].name);
+                            cursor.byteOffset += ap.size;
+                        }
+                    }
+                }
+                ++n;
+            }
+            p = eol + 1;
+        }
+    };
+
+    for (size_t k = 0; k < elements.size(); ++k)
+    {
+        if (!ascii[k].isRequested) continue;
+        if (ascii[k].hasList) parse_list_element(k, true);
+        else
+        {
+            for (auto & ap : ascii[k].properties)
+                if (ap.helper != nullptr) ap.helper->cursor->totalSizeBytes += elements[k].size * ap.size;
+        }
+    }
+    allocate_buffers();
+
+    // Pass 2: parallel parse of elements without lists directly into their final positions
+    std::atomic_bool isMalformed{ false };
+    parallel([&](size_t i)
+    {
+        size_t record = chunkRecords[i];
+        size_t k = 0;
+        bool blank;
+        for (const char * p = bounds[i]; p < bounds[i + 1] && !isMalformed; )
+        {
+            const char * eol = ply_line_end(p, bounds[i + 1], blank);
+            if (!blank)
+            {
+                while (k + 1 < ascii.size() && record >= ascii[k + 1].firstRecord) ++k;
+                const AsciiElement & ae = ascii[k];
+                if (ae.isRequested && !ae.hasList)
+                {
+                    const size_t index = record - ae.firstRecord;
+                    const char * q = p;
+                    for (auto & ap : ae.properties)
+                    {
+                        bool isOk;
+                        if (ap.helper == nullptr) isOk = ply_skip_ascii(q, eol);
+                        else isOk = ply_parse_ascii(ap.type, q, eol, ap.helper->data->buffer.get() + index * ap.destStride + ap.destOffset);
+                        if (!isOk) { isMalformed = true; break; }
+                    }
+                }
+                ++record;
+            }
+            p = eol + 1;
+        }
+    });
+    if (isMalformed) throw std::runtime_error("malformed ascii ply record");
+
+    for (size_t k = 0; k < elements.size(); ++k)
+    {
+        if (!ascii[k].isRequested) continue;
+        if (ascii[k].hasList) parse_list_element(k, false);
+        else
+        {
+            for (auto & ap : ascii[k].properties)
+                if (ap.helper != nullptr) ap.helper->cursor->byteOffset = ap.helper->cursor->totalSizeBytes;
+        }
+    }
+    return true;
+}
+
 ///////////////////////////////////
 // Pass-Through Public Interface //
 ///////////////////////////////////